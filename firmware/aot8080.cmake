@@ -0,0 +1,50 @@
+# Ahead-of-time translation (CPU8080_AOT, see cpu8080_aot.h): the built-in
+# programs in programs.h and the ROM images in CPU8080_AOT_ROMS become C
+# compiled into the target.
+
+set(CPU8080_AOT_ROMS "" CACHE STRING "ROM images to translate ahead of time, FILE[@ADDR] (hex address, default 0000) or Intel HEX, separated by ;")
+
+set(AOT8080_FIRMWARE_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+# Generate the translation for target and add it with the lookup code.
+# The host build has aot8080 as a target of its own, a cross build builds
+# it with the host compiler first.
+function(aot8080_add_translation target)
+    if(TARGET aot8080)
+        set(tool $<TARGET_FILE:aot8080>)
+        set(tool_target aot8080)
+    else()
+        if(NOT TARGET aot8080_host)
+            include(ExternalProject)
+            ExternalProject_Add(aot8080_host
+                    SOURCE_DIR ${AOT8080_FIRMWARE_DIR}/host/aot8080
+                    BINARY_DIR ${CMAKE_BINARY_DIR}/aot8080
+                    CMAKE_ARGS -DCMAKE_BUILD_TYPE=Release
+                    BUILD_ALWAYS 1
+                    INSTALL_COMMAND ""
+            )
+        endif()
+        set(tool ${CMAKE_BINARY_DIR}/aot8080/aot8080${CMAKE_HOST_EXECUTABLE_SUFFIX})
+        set(tool_target aot8080_host)
+    endif()
+
+    # Relative ROM paths are from the source directory
+    set(roms)
+    set(rom_args)
+    foreach(rom IN LISTS CPU8080_AOT_ROMS)
+        string(REGEX MATCH "@[0-9A-Fa-f]+$" addr ${rom})
+        string(REGEX REPLACE "@[0-9A-Fa-f]+$" "" file ${rom})
+        get_filename_component(file ${file} ABSOLUTE BASE_DIR ${CMAKE_SOURCE_DIR})
+        list(APPEND roms ${file})
+        list(APPEND rom_args ${file}${addr})
+    endforeach()
+
+    set(out ${CMAKE_CURRENT_BINARY_DIR}/${target}_aot.c)
+    add_custom_command(OUTPUT ${out}
+            COMMAND ${tool} -p -o ${out} ${rom_args}
+            DEPENDS ${tool_target} ${AOT8080_FIRMWARE_DIR}/programs.h ${roms}
+            COMMENT "Translating 8080 programs to C for ${target}"
+            VERBATIM
+    )
+    target_sources(${target} PRIVATE ${out} ${AOT8080_FIRMWARE_DIR}/cpu8080_aot.c)
+endfunction()
@@ -0,0 +1,440 @@
+#include "bench.h"
+#include "cpu8080.h"
+#include "disasm.h"
+#include "programs.h"
+#if CPU8080_JIT
+#include "cpu8080_jit.h"
+#endif
+#include "cpu8080_lanes.h"
+#include <stdio.h>
+#include <string.h>
+
+// Cycles per cpu8080_run() call, between checks of the budget
+#define BENCH_CHUNK (1u << 24)
+
+// Budget for workloads that halt by themselves, in case one never does
+#define BENCH_HALT_CAP 10000000000ull
+
+static bus_t bus;
+static cpu8080_t cpu;
+#if CPU8080_TCACHE
+static cpu8080_tcache_t tcache;
+#endif
+#if CPU8080_JIT
+static cpu8080_jit_t jit;
+static bool jit_tried;
+#endif
+#if CPU8080_LANES
+static cpu8080_lanes_t lanes;
+static uint8_t lanes_ram[CPU8080_LANES * CPU8080_LANE_STRIDE];
+#endif
+
+// --- Workloads ---
+
+static uint16_t load_counter(bus_t *b) {
+    load_program(b, PROG_COUNTER_ADDR, prog_counter, PROG_COUNTER_SIZE);
+    return PROG_COUNTER_ADDR;
+}
+
+static uint16_t load_memfill(bus_t *b) {
+    load_program(b, PROG_MEMFILL_ADDR, prog_memfill, PROG_MEMFILL_SIZE);
+    return PROG_MEMFILL_ADDR;
+}
+
+static uint16_t load_fibonacci(bus_t *b) {
+    load_program(b, PROG_FIBONACCI_ADDR, prog_fibonacci, PROG_FIBONACCI_SIZE);
+    return PROG_FIBONACCI_ADDR;
+}
+
+static uint16_t load_delay_count(bus_t *b) {
+    load_program(b, PROG_DELAY_COUNT_ADDR, prog_delay_count, PROG_DELAY_COUNT_SIZE);
+    return PROG_DELAY_COUNT_ADDR;
+}
+
+static uint16_t load_stack_test(bus_t *b) {
+    load_program(b, PROG_STACK_TEST_ADDR, prog_stack_test, PROG_STACK_TEST_SIZE);
+    return PROG_STACK_TEST_ADDR;
+}
+
+// Opcode mix: every opcode but HLT once per pass, then HLT after the last
+// pass. Operands and a few set-up instructions keep control flow going
+// straight through: jumps and calls target the next instruction, RETs get
+// it pushed first, the RST vectors hold a RET, and memory and stack
+// accesses land in a scratch area away from the code.
+#define MIX_START   0x0040
+#define MIX_DATA    0x8000
+#define MIX_COUNTER 0x8100
+#define MIX_STACK   0x9000
+#define MIX_PASSES  10000
+
+static uint16_t emit(bus_t *b, uint16_t pc, uint8_t byte) {
+    memory_write(b, pc, byte);
+    return pc + 1;
+}
+
+static uint16_t emit3(bus_t *b, uint16_t pc, uint8_t op, uint16_t word) {
+    pc = emit(b, pc, op);
+    pc = emit(b, pc, word & 0xFF);
+    return emit(b, pc, word >> 8);
+}
+
+// Reads or writes (HL)
+static bool uses_m(uint8_t op) {
+    if (op == 0x76) return false;
+    if (op >= 0x34 && op <= 0x36) return true;
+    if (op >= 0x40 && op < 0x80) return (op & 7) == 6 || ((op >> 3) & 7) == 6;
+    if (op >= 0x80 && op < 0xC0) return (op & 7) == 6;
+    return false;
+}
+
+static bool is_ret(uint8_t op) {
+    return (op & 0xC7) == 0xC0 || op == 0xC9 || op == 0xD9;
+}
+
+static bool is_jump_or_call(uint8_t op) {
+    return (op & 0xC7) == 0xC2 || (op & 0xC7) == 0xC4 ||
+           op == 0xC3 || op == 0xCB || op == 0xCD || op == 0xDD || op == 0xED || op == 0xFD;
+}
+
+static uint16_t load_opcode_mix(bus_t *b) {
+    for (int v = 0; v < 8; v++) {
+        emit(b, v * 8, 0xC9);                           // RST n: RET
+    }
+
+    uint16_t pc = MIX_START;
+    pc = emit3(b, pc, 0x21, MIX_PASSES);                // LXI H, passes
+    pc = emit3(b, pc, 0x22, MIX_COUNTER);               // SHLD counter
+    uint16_t top = pc;
+    pc = emit3(b, pc, 0x31, MIX_STACK);                 // LXI SP, stack
+
+    for (int i = 0; i < 256; i++) {
+        uint8_t op = i;
+        if (op == 0x76) continue;
+
+        if (uses_m(op)) {
+            pc = emit3(b, pc, 0x21, MIX_DATA);          // LXI H, data
+        } else if (op == 0x02 || op == 0x0A) {
+            pc = emit3(b, pc, 0x01, MIX_DATA);          // LXI B, data
+        } else if (op == 0x12 || op == 0x1A) {
+            pc = emit3(b, pc, 0x11, MIX_DATA);          // LXI D, data
+        } else if (op == 0xF9) {
+            pc = emit3(b, pc, 0x21, MIX_STACK);         // LXI H, stack
+        } else if (op == 0xE9) {
+            pc = emit3(b, pc, 0x21, pc + 4);            // LXI H, after PCHL
+        } else if (is_ret(op)) {
+            pc = emit3(b, pc, 0x21, pc + 5);            // LXI H, after RET
+            pc = emit(b, pc, 0xE5);                     // PUSH H
+        }
+
+        memory_write(b, pc, op);
+        int len = disasm_get_length(b, MEMORY_BANK_CURRENT, pc);
+        pc++;
+        if (len == 2) {
+            pc = emit(b, pc, (op == 0xD3 || op == 0xDB) ? 0xFF : 0x5A);
+        } else if (len == 3) {
+            uint16_t word = is_jump_or_call(op) ? pc + 2 : op == 0x31 ? MIX_STACK : MIX_DATA;
+            pc = emit(b, pc, word & 0xFF);
+            pc = emit(b, pc, word >> 8);
+        }
+    }
+
+    pc = emit3(b, pc, 0x2A, MIX_COUNTER);               // LHLD counter
+    pc = emit(b, pc, 0x2B);                             // DCX H
+    pc = emit3(b, pc, 0x22, MIX_COUNTER);               // SHLD counter
+    pc = emit(b, pc, 0x7C);                             // MOV A, H
+    pc = emit(b, pc, 0xB5);                             // ORA L
+    pc = emit3(b, pc, 0xC2, top);                       // JNZ top
+    emit(b, pc, 0x76);                                  // HLT
+    return MIX_START;
+}
+
+// Arithmetic kernel: adds up i*i for i = 255..1 into a 16-bit total at
+// 1002, KERNEL_PASSES times, multiplying by shift-and-add, then halts
+//
+// 0000: LXI SP, 2000
+// 0003: LXI H, 0000  ; total = 0
+// 0006: SHLD 1002
+// 0009: LXI H, passes
+// 000C: SHLD 1000
+// 000F: MVI C, FF    ; pass: i = 255
+// 0011: MOV E, C     ; DE = i
+// 0012: MVI D, 00
+// 0014: MOV A, C     ; HL = A * DE
+// 0015: CALL 0031
+// 0018: XCHG
+// 0019: LHLD 1002    ; total += i * i
+// 001C: DAD D
+// 001D: SHLD 1002
+// 0020: DCR C
+// 0021: JNZ 0011
+// 0024: LHLD 1000    ; next pass
+// 0027: DCX H
+// 0028: SHLD 1000
+// 002B: MOV A, H
+// 002C: ORA L
+// 002D: JNZ 000F
+// 0030: HLT
+// 0031: LXI H, 0000  ; multiply: HL = A * DE
+// 0034: MVI B, 08
+// 0036: DAD H        ; HL <<= 1
+// 0037: RAL          ; next multiplier bit into carry
+// 0038: JNC 003C
+// 003B: DAD D
+// 003C: DCR B
+// 003D: JNZ 0036
+// 0040: RET
+//
+#define KERNEL_PASSES 256
+
+static const uint8_t prog_kernel[] = {
+    0x31, 0x00, 0x20,
+    0x21, 0x00, 0x00,
+    0x22, 0x02, 0x10,
+    0x21, KERNEL_PASSES & 0xFF, KERNEL_PASSES >> 8,
+    0x22, 0x00, 0x10,
+    0x0E, 0xFF,
+    0x59,
+    0x16, 0x00,
+    0x79,
+    0xCD, 0x31, 0x00,
+    0xEB,
+    0x2A, 0x02, 0x10,
+    0x19,
+    0x22, 0x02, 0x10,
+    0x0D,
+    0xC2, 0x11, 0x00,
+    0x2A, 0x00, 0x10,
+    0x2B,
+    0x22, 0x00, 0x10,
+    0x7C,
+    0xB5,
+    0xC2, 0x0F, 0x00,
+    0x76,
+    0x21, 0x00, 0x00,
+    0x06, 0x08,
+    0x29,
+    0x17,
+    0xD2, 0x3C, 0x00,
+    0x19,
+    0x05,
+    0xC2, 0x36, 0x00,
+    0xC9
+};
+
+static uint16_t load_kernel(bus_t *b) {
+    load_program(b, 0x0000, prog_kernel, sizeof(prog_kernel));
+    return 0x0000;
+}
+
+const bench_workload_t bench_workloads[] = {
+    { "counter",     load_counter,     false },
+    { "memfill",     load_memfill,     false },
+    { "fibonacci",   load_fibonacci,   false },
+    { "delay_count", load_delay_count, false },
+    { "stack_test",  load_stack_test,  false },
+    { "opcode_mix",  load_opcode_mix,  true },
+    { "kernel",      load_kernel,      true },
+};
+const int bench_workload_count = sizeof(bench_workloads) / sizeof(bench_workloads[0]);
+
+// --- Engines ---
+
+const char *bench_engine_name(bench_engine_t engine) {
+    static const char *const names[BENCH_ENGINES] = { "interp", "tcache", "jit", "aot", "lanes" };
+    return names[engine];
+}
+
+bool bench_engine_available(bench_engine_t engine) {
+    switch (engine) {
+        case BENCH_INTERP:
+            return true;
+        case BENCH_TCACHE:
+            return CPU8080_TCACHE;
+        case BENCH_JIT:
+#if CPU8080_JIT
+            if (!jit_tried) {
+                cpu8080_jit_init(&jit, CPU8080_JIT_DEFAULT_ARENA);
+                jit_tried = true;
+            }
+            return jit.code != NULL;
+#else
+            return false;
+#endif
+        case BENCH_AOT:
+            return CPU8080_AOT;
+        case BENCH_LANES:
+            return CPU8080_LANES > 0;
+        default:
+            return false;
+    }
+}
+
+static void prepare(bench_engine_t engine) {
+    memory_init(&bus);
+    cpu8080_init(&cpu, &bus);
+    cpu.tcache = NULL;
+#if CPU8080_TCACHE
+    if (engine != BENCH_INTERP) {
+        cpu8080_attach_tcache(&cpu, &tcache);
+    }
+#endif
+#if CPU8080_AOT
+    tcache.aot = engine == BENCH_AOT;
+#endif
+#if CPU8080_JIT
+    if (engine == BENCH_JIT) {
+        cpu8080_attach_jit(&cpu, &jit);
+    }
+#endif
+    (void)engine;
+}
+
+#if CPU8080_LANES
+// Every lane runs its own copy of w from the same start, so they stay in
+// lockstep and the result is the throughput of a full set of lanes
+static void bench_run_lanes(const bench_workload_t *w, uint64_t cycles,
+                            int repeat, bench_clock_t clock, bench_result_t *r) {
+    for (int i = 0; i < repeat; i++) {
+        memory_init(&bus);
+        cpu8080_init(&cpu, &bus);
+        cpu.pc = w->load(&bus);
+        cpu8080_lanes_init(&lanes, lanes_ram);
+        for (int lane = 0; lane < CPU8080_LANES; lane++) {
+            memcpy(cpu8080_lane_ram(&lanes, lane), bus.ram, MEMORY_SIZE);
+            cpu8080_lane_set(&lanes, lane, &cpu);
+        }
+
+        uint64_t limit = w->halts ? BENCH_HALT_CAP : cycles;
+        uint64_t t0 = clock();
+        while (lanes.cycles[0] < limit) {
+            bool running = false;
+            for (int lane = 0; lane < CPU8080_LANES; lane++) {
+                running |= !lanes.halted[lane];
+            }
+            if (!running) break;
+            uint64_t left = limit - lanes.cycles[0];
+            cpu8080_lanes_run(&lanes, left < BENCH_CHUNK ? left : BENCH_CHUNK);
+        }
+        uint64_t ns = clock() - t0;
+
+        if (ns < r->ns) r->ns = ns;
+        r->cycles = r->instructions = 0;
+        for (int lane = 0; lane < CPU8080_LANES; lane++) {
+            r->cycles += lanes.cycles[lane];
+            r->instructions += lanes.instructions[lane];
+        }
+        r->halted = lanes.halted[0];
+    }
+    cpu8080_lane_get(&lanes, 0, &cpu);
+}
+#endif
+
+static void bench_run_cpu(const bench_workload_t *w, bench_engine_t engine, uint64_t cycles,
+                          int repeat, bench_clock_t clock, bench_result_t *r) {
+    for (int i = 0; i < repeat; i++) {
+        prepare(engine);
+        cpu.pc = w->load(&bus);
+
+        uint64_t limit = w->halts ? BENCH_HALT_CAP : cycles;
+        uint64_t done = 0;
+        uint64_t t0 = clock();
+        while (!cpu.halted && done < limit) {
+            uint64_t left = limit - done;
+            done += cpu8080_run(&cpu, left < BENCH_CHUNK ? left : BENCH_CHUNK);
+        }
+        uint64_t ns = clock() - t0;
+
+        if (ns < r->ns) r->ns = ns;
+        r->cycles = done;
+        r->instructions = cpu.instructions;
+        r->halted = cpu.halted;
+    }
+}
+
+void bench_run(const bench_workload_t *w, bench_engine_t engine, uint64_t cycles,
+               int repeat, bench_clock_t clock, bench_result_t *r) {
+    r->ns = UINT64_MAX;
+#if CPU8080_LANES
+    if (engine == BENCH_LANES) {
+        bench_run_lanes(w, cycles, repeat, clock, r);
+    } else
+#endif
+    {
+        bench_run_cpu(w, engine, cycles, repeat, clock, r);
+    }
+
+    const uint8_t regs[12] = {
+        cpu.a, cpu8080_get_f(&cpu), cpu.b, cpu.c, cpu.d, cpu.e, cpu.h, cpu.l,
+        cpu.sp & 0xFF, cpu.sp >> 8, cpu.pc & 0xFF, cpu.pc >> 8
+    };
+    memcpy(r->regs, regs, sizeof(regs));
+}
+
+// --- Output ---
+
+void bench_json_begin(const char *target, uint64_t cycles, int repeat) {
+    printf("{\"target\":\"%s\",\"config\":{\"dispatch\":\"%s\",\"lazy_flags\":%s,"
+           "\"tcache\":%s,\"jit\":%s,\"aot\":%s,\"lanes\":%d},\"cycles\":%llu,\"repeat\":%d,\"results\":[\n",
+           target, CPU8080_DISPATCH == CPU8080_DISPATCH_TABLE ? "table" : "switch",
+           CPU8080_LAZY_FLAGS ? "true" : "false", CPU8080_TCACHE ? "true" : "false",
+           CPU8080_JIT ? "true" : "false", CPU8080_AOT ? "true" : "false", CPU8080_LANES, (unsigned long long)cycles, repeat);
+}
+
+void bench_json_result(const bench_workload_t *w, bench_engine_t engine,
+                       const bench_result_t *r, bool first) {
+    double ns = r->ns ? (double)r->ns : 1.0;
+    printf("%s{\"workload\":\"%s\",\"engine\":\"%s\",\"cycles\":%llu,\"instructions\":%llu,"
+           "\"ns\":%llu,\"ns_per_insn\":%.3f,\"mhz\":%.3f,\"cycles_per_sec\":%.0f,"
+           "\"halted\":%s,\"regs\":\"",
+           first ? "" : ",\n", w->name, bench_engine_name(engine),
+           (unsigned long long)r->cycles, (unsigned long long)r->instructions,
+           (unsigned long long)r->ns,
+           r->instructions ? r->ns / (double)r->instructions : 0.0,
+           r->cycles * 1e3 / ns, r->cycles * 1e9 / ns,
+           r->halted ? "true" : "false");
+    for (int i = 0; i < 12; i++) {
+        printf("%02X", r->regs[i]);
+    }
+    printf("\"}");
+}
+
+void bench_json_end(void) {
+    printf("\n]}\n");
+}
+
+void bench_run_all(const char *target, uint64_t cycles, int repeat, bench_clock_t clock) {
+    bool first = true;
+    bench_json_begin(target, cycles, repeat);
+    for (int i = 0; i < bench_workload_count; i++) {
+        for (int e = 0; e < BENCH_ENGINES; e++) {
+            if (!bench_engine_available(e)) continue;
+            bench_result_t r;
+            bench_run(&bench_workloads[i], e, cycles, repeat, clock, &r);
+            bench_json_result(&bench_workloads[i], e, &r, first);
+            first = false;
+        }
+    }
+    bench_json_end();
+}
+
+// Copy the string value after key into out
+static bool json_string(const char *line, const char *key, char *out, int size) {
+    const char *p = strstr(line, key);
+    if (!p) return false;
+    p += strlen(key);
+    int n = 0;
+    while (*p && *p != '"' && n < size - 1) {
+        out[n++] = *p++;
+    }
+    out[n] = '\0';
+    return *p == '"';
+}
+
+bool bench_parse_line(const char *line, char *workload, int workload_size,
+                      char *engine, int engine_size, double *mhz) {
+    if (!json_string(line, "\"workload\":\"", workload, workload_size)) return false;
+    if (!json_string(line, "\"engine\":\"", engine, engine_size)) return false;
+    const char *p = strstr(line, "\"mhz\":");
+    if (!p) return false;
+    return sscanf(p + 6, "%lf", mhz) == 1;
+}
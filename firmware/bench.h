@@ -0,0 +1,73 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory.h"
+
+// Throughput benchmark shared by the host, node and RP2040 runners. Each
+// workload is loaded into a fresh machine and run with every engine this
+// build has, and the results are printed as JSON with printf so they reach
+// a terminal, a file or the USB CDC port alike.
+//
+// Workloads are the programs in programs.h, an opcode mix that executes all
+// 256 opcodes, and an arithmetic kernel (sum of squares by shift-and-add
+// multiply). The last two end in HLT after a fixed number of passes, the
+// programs loop forever and are stopped after a cycle budget.
+
+typedef enum {
+    BENCH_INTERP,   // cpu8080_step() loop, no translation cache
+    BENCH_TCACHE,   // translated blocks on micro-ops
+    BENCH_JIT,      // translated blocks compiled to native code
+    BENCH_AOT,      // translated blocks, the programs from C built in ahead of time
+    BENCH_LANES,    // CPU8080_LANES copies in lockstep, totals over all lanes
+    BENCH_ENGINES
+} bench_engine_t;
+
+typedef struct {
+    const char *name;
+    // Load the workload and return its start address
+    uint16_t (*load)(bus_t *bus);
+    bool halts;     // ends in HLT rather than running to the budget
+} bench_workload_t;
+
+typedef struct {
+    uint64_t cycles;        // summed over the lanes for BENCH_LANES
+    uint64_t instructions;
+    uint64_t ns;            // best of the repeats
+    uint8_t regs[12];       // A F B C D E H L, SP and PC low byte first
+    bool halted;
+} bench_result_t;
+
+// Monotonic time in nanoseconds, supplied by the runner
+typedef uint64_t (*bench_clock_t)(void);
+
+extern const bench_workload_t bench_workloads[];
+extern const int bench_workload_count;
+
+const char *bench_engine_name(bench_engine_t engine);
+
+// False for engines this build doesn't have
+bool bench_engine_available(bench_engine_t engine);
+
+// Run w on a fresh machine repeat times and keep the fastest run. Workloads
+// that don't halt are stopped after cycles cycles.
+void bench_run(const bench_workload_t *w, bench_engine_t engine, uint64_t cycles,
+               int repeat, bench_clock_t clock, bench_result_t *r);
+
+// JSON output: one result object per line, so results can be read back by
+// bench_parse_line() and the surrounding noise of a serial capture skipped
+void bench_json_begin(const char *target, uint64_t cycles, int repeat);
+void bench_json_result(const bench_workload_t *w, bench_engine_t engine,
+                       const bench_result_t *r, bool first);
+void bench_json_end(void);
+
+// Run every workload with every available engine and print the JSON
+void bench_run_all(const char *target, uint64_t cycles, int repeat, bench_clock_t clock);
+
+// Pick workload, engine and emulated MHz out of a result line. Returns
+// false for any other line.
+bool bench_parse_line(const char *line, char *workload, int workload_size,
+                      char *engine, int engine_size, double *mhz);
+
+#endif
@@ -0,0 +1,43 @@
+/**
+ * Benchmark runner for the RP2040
+ *
+ * Separate firmware image (microcomputer_bench) that runs the bench.h
+ * workloads once a USB CDC terminal connects and prints the results as
+ * JSON. Any key runs them again. Capture the output and compare it against
+ * a baseline with the host runner's -C option.
+ */
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "pico/stdio_usb.h"
+#include "bench.h"
+
+// The board is far slower than a host, so the looping programs get a
+// smaller budget than the host runner's default
+#define BENCH_PICO_CYCLES 2000000
+#define BENCH_PICO_REPEAT 1
+
+static uint64_t clock_ns(void) {
+    return time_us_64() * 1000;
+}
+
+int main() {
+    stdio_init_all();
+
+    #define PICO_DEFAULT_LED_PIN 25
+    gpio_init(PICO_DEFAULT_LED_PIN);
+    gpio_set_dir(PICO_DEFAULT_LED_PIN, GPIO_OUT);
+
+    while (true) {
+        while (!stdio_usb_connected()) {
+            sleep_ms(10);
+        }
+        gpio_put(PICO_DEFAULT_LED_PIN, 1);
+        bench_run_all("rp2040", BENCH_PICO_CYCLES, BENCH_PICO_REPEAT, clock_ns);
+        gpio_put(PICO_DEFAULT_LED_PIN, 0);
+
+        // Wait for a key to run again
+        while (getchar_timeout_us(100000) == PICO_ERROR_TIMEOUT) {
+        }
+    }
+}
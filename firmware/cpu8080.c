@@ -1,8 +1,17 @@
 #include "cpu8080.h"
+#include "cpu8080_ops.h"
 #include "memory.h"
 #include <stddef.h>
 
-void cpu8080_init(cpu8080_t *cpu) {
+#if CPU8080_JIT
+#include "cpu8080_jit.h"
+#endif
+#if CPU8080_AOT
+#include "cpu8080_aot.h"
+#endif
+
+void cpu8080_init(cpu8080_t *cpu, bus_t *bus) {
+    cpu->bus = bus;
     cpu->a = cpu->f = 0;
     cpu->b = cpu->c = 0;
     cpu->d = cpu->e = 0;
@@ -11,44 +20,162 @@ void cpu8080_init(cpu8080_t *cpu) {
     cpu->pc = 0;
     cpu->halted = false;
     cpu->inte = false;
+    cpu->lazy_res = 0;
+    cpu->lazy_ac = 0;
+    cpu->lazy_pending = false;
+    cpu->breakpoint = 0;
+    cpu->breakpoint_enabled = false;
+    cpu->tcache = NULL;
+    cpu->block_done = 0;
+    cpu->instructions = 0;
+    cpu->cycles = 0;
+    cpu->irq = 0;
+    cpu->int_at = 0;
+    cpu->attention = EVENT_NEVER;
+    cpu->events = NULL;
 }
 
 void cpu8080_reset(cpu8080_t *cpu) {
     cpu->pc = 0;
     cpu->halted = false;
+    cpu->inte = false;
+    cpu->irq = 0;
+    cpu8080_update_attention(cpu);
+}
+
+// Z/S/P flags for every 8-bit result, expanded by the preprocessor
+#define PARITY_EVEN(v) (!(((v) ^ ((v) >> 1) ^ ((v) >> 2) ^ ((v) >> 3) ^ \
+                           ((v) >> 4) ^ ((v) >> 5) ^ ((v) >> 6) ^ ((v) >> 7)) & 1))
+#define ZSP(v)   (((v) == 0 ? FLAG_Z : 0) | ((v) & FLAG_S) | (PARITY_EVEN(v) ? FLAG_P : 0))
+#define ZSP4(v)  ZSP(v), ZSP((v) + 1), ZSP((v) + 2), ZSP((v) + 3)
+#define ZSP16(v) ZSP4(v), ZSP4((v) + 4), ZSP4((v) + 8), ZSP4((v) + 12)
+#define ZSP64(v) ZSP16(v), ZSP16((v) + 16), ZSP16((v) + 32), ZSP16((v) + 48)
+
+const uint8_t cpu8080_zsp_table[256] = { ZSP64(0), ZSP64(64), ZSP64(128), ZSP64(192) };
+
+static uint8_t fetch(cpu8080_t *cpu) {
+    return memory_read(cpu->bus, cpu->pc++);
 }
 
-static uint8_t parity(uint8_t v) {
-    v ^= v >> 4;
-    v ^= v >> 2;
-    v ^= v >> 1;
-    return (~v) & 1;
+static uint16_t fetch16(cpu8080_t *cpu) {
+    uint8_t lo = fetch(cpu);
+    uint8_t hi = fetch(cpu);
+    return (hi << 8) | lo;
 }
 
-static void set_flags_zsp(cpu8080_t *cpu, uint8_t val) {
-    cpu->f &= ~(FLAG_Z | FLAG_S | FLAG_P);
-    if (val == 0) cpu->f |= FLAG_Z;
-    if (val & 0x80) cpu->f |= FLAG_S;
-    if (parity(val)) cpu->f |= FLAG_P;
+void cpu8080_update_attention(cpu8080_t *cpu) {
+    uint64_t at = cpu->events ? event_next(cpu->events) : EVENT_NEVER;
+    if (cpu->irq && cpu->inte && cpu->int_at < at) at = cpu->int_at;
+    cpu->attention = at;
 }
 
-static void set_flags_add(cpu8080_t *cpu, uint8_t a, uint8_t b, uint8_t cy) {
-    uint16_t res = a + b + cy;
-    set_flags_zsp(cpu, res & 0xFF);
-    cpu->f &= ~(FLAG_C | FLAG_AC);
-    if (res > 0xFF) cpu->f |= FLAG_C;
-    if ((a & 0x0F) + (b & 0x0F) + cy > 0x0F) cpu->f |= FLAG_AC;
+void cpu8080_irq_raise(cpu8080_t *cpu, uint8_t level) {
+    cpu->irq |= 1 << level;
+    cpu8080_update_attention(cpu);
 }
 
-static void set_flags_sub(cpu8080_t *cpu, uint8_t a, uint8_t b, uint8_t cy) {
-    uint16_t res = a - b - cy;
-    set_flags_zsp(cpu, res & 0xFF);
-    cpu->f &= ~(FLAG_C | FLAG_AC);
-    if (res > 0xFF) cpu->f |= FLAG_C;
-    if ((int)(a & 0x0F) - (int)(b & 0x0F) - (int)cy < 0) cpu->f |= FLAG_AC;
+void cpu8080_irq_clear(cpu8080_t *cpu, uint8_t level) {
+    cpu->irq &= ~(1 << level);
+    cpu8080_update_attention(cpu);
 }
 
-static uint8_t *get_reg(cpu8080_t *cpu, uint8_t r) {
+void cpu8080_attach_events(cpu8080_t *cpu, event_queue_t *q) {
+    cpu->events = q;
+    cpu8080_update_attention(cpu);
+}
+
+bool cpu8080_schedule(cpu8080_t *cpu, uint64_t cycle, event_fn_t fn, void *ctx) {
+    if (!cpu->events || !event_schedule(cpu->events, cycle, fn, ctx)) return false;
+    cpu8080_update_attention(cpu);
+    return true;
+}
+
+void cpu8080_cancel(cpu8080_t *cpu, event_fn_t fn, void *ctx) {
+    if (!cpu->events) return;
+    event_cancel(cpu->events, fn, ctx);
+    cpu8080_update_attention(cpu);
+}
+
+// EI runs with cpu->cycles at its start. Letting interrupts in from one
+// cycle past its end means the next boundary that can take one is after
+// the following instruction.
+static void enable_interrupts(cpu8080_t *cpu) {
+    cpu->inte = true;
+    cpu->int_at = cpu->cycles + 5;
+    cpu8080_update_attention(cpu);
+}
+
+static void disable_interrupts(cpu8080_t *cpu) {
+    cpu->inte = false;
+    cpu8080_update_attention(cpu);
+}
+
+// Run the device events due by now
+static void run_due_events(cpu8080_t *cpu) {
+    if (cpu->events) {
+        event_run_due(cpu->events, cpu->cycles);
+    }
+}
+
+// Whether service() takes an interrupt once the due events have run
+static inline bool interrupt_ready(const cpu8080_t *cpu) {
+    return cpu->irq && cpu->inte && cpu->cycles >= cpu->int_at;
+}
+
+// Called at an instruction boundary at or past cpu->attention: run the
+// events due, then take an interrupt if one is let in, as RST n.
+// Returns the cycles used.
+static uint32_t service(cpu8080_t *cpu) {
+    uint32_t cycles = 0;
+    run_due_events(cpu);
+    if (interrupt_ready(cpu)) {
+        uint8_t level = 0;
+        while (!(cpu->irq & (1 << level))) level++;
+        cpu->irq &= ~(1 << level);
+        cpu->inte = false;
+        cpu->halted = false;
+        push16(cpu, cpu->pc);
+        cpu->pc = level * 8;
+        cpu->instructions++;
+        cpu->cycles += 11;
+        cycles = 11;
+    }
+    cpu8080_update_attention(cpu);
+    return cycles;
+}
+
+// Loop idioms that cpu8080_run() advances in bulk: spin and countdown loops
+// with an empty body, and byte fill and copy loops over plain RAM. Only
+// whole iterations are skipped and the last one still runs normally, so
+// memory, registers, flags and cycles match stepping exactly.
+#define LOOP_BODY_NONE      0
+#define LOOP_BODY_FILL      1   // MOV M,A / INX H
+#define LOOP_BODY_FILL_INC  2   // MOV M,A / INR A / INX H
+#define LOOP_BODY_LOAD_DE   3   // LDAX D / MOV M,A / INX D / INX H (either order)
+#define LOOP_BODY_LOAD_HL   4   // MOV A,M / STAX D / INX D / INX H (either order)
+
+#define LOOP_TAIL_JMP       0   // JMP top
+#define LOOP_TAIL_DCR       1   // DCR r / JNZ top
+#define LOOP_TAIL_DCX       2   // DCX rp / MOV A,hi|lo / ORA lo|hi / JNZ top
+
+typedef struct {
+    uint8_t body;
+    uint8_t tail;
+    uint8_t counter;    // register counted down by the tail, high half for DCX
+    bool hi_first;      // DCX tail does MOV A,hi / ORA lo
+    uint8_t len;        // bytes of code
+    uint8_t cycles;     // cycles per iteration
+    uint8_t insns;      // instructions per iteration
+} loop_idiom_t;
+
+static const uint8_t loop_body_cycles[] = { 0, 12, 17, 24, 24 };
+static const uint8_t loop_body_insns[] = { 0, 2, 3, 4, 4 };
+
+// Registers (bit per index, B=0 ... A=7) each body leaves free for a counter
+static const uint8_t loop_dcr_counters[] = { 0xBF, 0x0F, 0x0F, 0x03, 0x03 };
+static const uint8_t loop_dcx_counters[] = { 0x15, 0x00, 0x00, 0x01, 0x01 };
+
+static uint8_t *reg_ptr(cpu8080_t *cpu, uint8_t r) {
     switch (r) {
         case 0: return &cpu->b;
         case 1: return &cpu->c;
@@ -56,59 +183,204 @@ static uint8_t *get_reg(cpu8080_t *cpu, uint8_t r) {
         case 3: return &cpu->e;
         case 4: return &cpu->h;
         case 5: return &cpu->l;
-        case 7: return &cpu->a;
-        default: return NULL;
+        default: return &cpu->a;
     }
 }
 
-static uint8_t read_reg(cpu8080_t *cpu, uint8_t r) {
-    if (r == 6) return memory_read(cpu8080_get_hl(cpu));
-    return *get_reg(cpu, r);
-}
+// Match a loop idiom at PC. Bytes are peeked, so a device mapped past PC
+// never sees the look-ahead.
+static bool loop_idiom_at(bus_t *bus, uint16_t pc, loop_idiom_t *lp) {
+    uint32_t at = pc;
+    uint8_t op = memory_peek(bus, MEMORY_BANK_CURRENT, at);
 
-static void write_reg(cpu8080_t *cpu, uint8_t r, uint8_t val) {
-    if (r == 6) memory_write(cpu8080_get_hl(cpu), val);
-    else *get_reg(cpu, r) = val;
+    lp->body = LOOP_BODY_NONE;
+    // Only the DCR and DCX tails set these, JMP loops leave them unused
+    lp->counter = 0;
+    lp->hi_first = false;
+    if (op == 0x77) {
+        if (memory_peek(bus, MEMORY_BANK_CURRENT, at + 1) == 0x23) {
+            lp->body = LOOP_BODY_FILL;
+            at += 2;
+        } else if (memory_peek(bus, MEMORY_BANK_CURRENT, at + 1) == 0x3C && memory_peek(bus, MEMORY_BANK_CURRENT, at + 2) == 0x23) {
+            lp->body = LOOP_BODY_FILL_INC;
+            at += 3;
+        } else {
+            return false;
+        }
+    } else if (op == 0x1A || op == 0x7E) {
+        uint8_t x = memory_peek(bus, MEMORY_BANK_CURRENT, at + 2);
+        uint8_t y = memory_peek(bus, MEMORY_BANK_CURRENT, at + 3);
+        if (memory_peek(bus, MEMORY_BANK_CURRENT, at + 1) != (op == 0x1A ? 0x77 : 0x12)) return false;
+        if (!((x == 0x13 && y == 0x23) || (x == 0x23 && y == 0x13))) return false;
+        lp->body = op == 0x1A ? LOOP_BODY_LOAD_DE : LOOP_BODY_LOAD_HL;
+        at += 4;
+    }
+
+    op = memory_peek(bus, MEMORY_BANK_CURRENT, at);
+    uint32_t target;
+    if (op == 0xC3) {
+        lp->tail = LOOP_TAIL_JMP;
+        target = at + 1;
+        at += 3;
+    } else if ((op & 0xC7) == 0x05) {
+        lp->tail = LOOP_TAIL_DCR;
+        lp->counter = (op >> 3) & 7;
+        if (!(loop_dcr_counters[lp->body] & (1 << lp->counter))) return false;
+        if (memory_peek(bus, MEMORY_BANK_CURRENT, at + 1) != 0xC2) return false;
+        target = at + 2;
+        at += 4;
+    } else if ((op & 0xCF) == 0x0B) {
+        lp->tail = LOOP_TAIL_DCX;
+        lp->counter = (op >> 3) & 6;
+        if (!(loop_dcx_counters[lp->body] & (1 << lp->counter))) return false;
+        uint8_t hi = lp->counter;
+        uint8_t lo = hi + 1;
+        uint8_t mov = memory_peek(bus, MEMORY_BANK_CURRENT, at + 1);
+        uint8_t ora = memory_peek(bus, MEMORY_BANK_CURRENT, at + 2);
+        lp->hi_first = mov == (0x78 | hi) && ora == (0xB0 | lo);
+        if (!lp->hi_first && !(mov == (0x78 | lo) && ora == (0xB0 | hi))) return false;
+        if (memory_peek(bus, MEMORY_BANK_CURRENT, at + 3) != 0xC2) return false;
+        target = at + 4;
+        at += 6;
+    } else {
+        return false;
+    }
+
+    if (at > 0x10000 || (memory_peek(bus, MEMORY_BANK_CURRENT, target) |
+                          memory_peek(bus, MEMORY_BANK_CURRENT, target + 1) << 8) != pc) return false;
+    lp->len = at - pc;
+    lp->cycles = loop_body_cycles[lp->body] + (lp->tail == LOOP_TAIL_JMP ? 10 :
+                                               lp->tail == LOOP_TAIL_DCR ? 15 : 24);
+    lp->insns = loop_body_insns[lp->body] + (lp->tail == LOOP_TAIL_JMP ? 1 :
+                                             lp->tail == LOOP_TAIL_DCR ? 2 : 4);
+    return true;
 }
 
-static uint8_t fetch(cpu8080_t *cpu) {
-    return memory_read(cpu->pc++);
+// Run as many whole iterations of the loop idiom at PC as fit in
+// cycle_budget, leaving the last one to the caller. Returns the cycles used.
+static uint32_t run_loop_idiom(cpu8080_t *cpu, uint32_t cycle_budget) {
+    bus_t *bus = cpu->bus;
+    loop_idiom_t lp;
+    uint32_t k, n;
+
+    if (!loop_idiom_at(bus, cpu->pc, &lp)) return 0;
+
+    // JMP $ never exits, so spin out the whole budget
+    if (lp.cycles == 10) {
+        cpu->instructions += (cycle_budget + 9) / 10;
+        return (cycle_budget + 9) / 10 * 10;
+    }
+
+    k = cycle_budget / lp.cycles;
+    uint8_t *hi = reg_ptr(cpu, lp.counter);
+    uint8_t *lo = reg_ptr(cpu, lp.counter + 1);
+    if (lp.tail == LOOP_TAIL_DCR) {
+        n = *hi ? *hi : 256;
+        if (k > n - 1) k = n - 1;
+    } else if (lp.tail == LOOP_TAIL_DCX) {
+        n = (*hi << 8) | *lo;
+        if (n == 0) n = 65536;
+        if (k > n - 1) k = n - 1;
+    }
+
+    if (lp.body != LOOP_BODY_NONE) {
+        bool copy = lp.body == LOOP_BODY_LOAD_DE || lp.body == LOOP_BODY_LOAD_HL;
+        uint16_t dst = lp.body == LOOP_BODY_LOAD_HL ? cpu8080_get_de(cpu) : cpu8080_get_hl(cpu);
+        uint16_t src = lp.body == LOOP_BODY_LOAD_HL ? cpu8080_get_hl(cpu) : cpu8080_get_de(cpu);
+
+        // Stop short of the end of memory and of the loop's own code, and
+        // leave anything that reaches past plain RAM to the interpreter
+        if (k > (uint32_t)MEMORY_SIZE - dst) k = MEMORY_SIZE - dst;
+        if (copy && k > (uint32_t)MEMORY_SIZE - src) k = MEMORY_SIZE - src;
+        if (dst < cpu->pc + lp.len && dst + k > cpu->pc) {
+            k = dst < cpu->pc ? cpu->pc - dst : 0;
+        }
+        if (k == 0 || !memory_is_ram(bus, dst, k) || (copy && !memory_is_ram(bus, src, k))) {
+            return 0;
+        }
+
+        if (copy) {
+            memory_copy(bus, dst, src, k);
+            cpu->a = memory_read(bus, dst + k - 1);
+            cpu8080_set_de(cpu, cpu8080_get_de(cpu) + k);
+        } else if (lp.body == LOOP_BODY_FILL_INC) {
+            memory_fill(bus, dst, cpu->a, 1, k);
+            cpu->a = alu_inr(cpu, cpu->a + k - 1);
+        } else {
+            memory_fill(bus, dst, cpu->a, 0, k);
+        }
+        cpu8080_set_hl(cpu, cpu8080_get_hl(cpu) + k);
+    } else if (k == 0) {
+        return 0;
+    }
+
+    if (lp.tail == LOOP_TAIL_DCR) {
+        *hi = alu_dcr(cpu, *hi - k + 1);    // flags as left by the k-th DCR
+    } else if (lp.tail == LOOP_TAIL_DCX) {
+        n -= k;
+        *hi = n >> 8;
+        *lo = n & 0xFF;
+        cpu->a = lp.hi_first ? *hi : *lo;
+        alu_ora(cpu, lp.hi_first ? *lo : *hi);
+    }
+    cpu->instructions += (uint64_t)k * lp.insns;
+    return k * lp.cycles;
 }
 
-static uint16_t fetch16(cpu8080_t *cpu) {
-    uint8_t lo = fetch(cpu);
-    uint8_t hi = fetch(cpu);
-    return (hi << 8) | lo;
+#if CPU8080_TCACHE && CPU8080_DISPATCH != CPU8080_DISPATCH_TABLE
+#error "CPU8080_TCACHE requires CPU8080_DISPATCH_TABLE"
+#endif
+
+#if CPU8080_JIT && !CPU8080_TCACHE
+#error "CPU8080_JIT requires CPU8080_TCACHE"
+#endif
+
+#if CPU8080_AOT && !CPU8080_TCACHE
+#error "CPU8080_AOT requires CPU8080_TCACHE"
+#endif
+
+#if CPU8080_DISPATCH == CPU8080_DISPATCH_SWITCH
+
+// Switch engine: decodes the hi/mid/lo opcode fields at run time.
+
+static uint8_t *get_reg(cpu8080_t *cpu, uint8_t r) {
+    switch (r) {
+        case 0: return &cpu->b;
+        case 1: return &cpu->c;
+        case 2: return &cpu->d;
+        case 3: return &cpu->e;
+        case 4: return &cpu->h;
+        case 5: return &cpu->l;
+        case 7: return &cpu->a;
+        default: return NULL;
+    }
 }
 
-static void push16(cpu8080_t *cpu, uint16_t val) {
-    memory_write(--cpu->sp, val >> 8);
-    memory_write(--cpu->sp, val & 0xFF);
+static uint8_t read_reg(cpu8080_t *cpu, uint8_t r) {
+    if (r == 6) return memory_read(cpu->bus, cpu8080_get_hl(cpu));
+    return *get_reg(cpu, r);
 }
 
-static uint16_t pop16(cpu8080_t *cpu) {
-    uint8_t lo = memory_read(cpu->sp++);
-    uint8_t hi = memory_read(cpu->sp++);
-    return (hi << 8) | lo;
+static void write_reg(cpu8080_t *cpu, uint8_t r, uint8_t val) {
+    if (r == 6) memory_write(cpu->bus, cpu8080_get_hl(cpu), val);
+    else *get_reg(cpu, r) = val;
 }
 
 static bool check_cond(cpu8080_t *cpu, uint8_t cond) {
     switch (cond) {
-        case 0: return !(cpu->f & FLAG_Z);  // NZ
-        case 1: return cpu->f & FLAG_Z;     // Z
-        case 2: return !(cpu->f & FLAG_C);  // NC
-        case 3: return cpu->f & FLAG_C;     // C
-        case 4: return !(cpu->f & FLAG_P);  // PO
-        case 5: return cpu->f & FLAG_P;     // PE
-        case 6: return !(cpu->f & FLAG_S);  // P
-        case 7: return cpu->f & FLAG_S;     // M
+        case 0: return !(flags_zsp(cpu) & FLAG_Z);  // NZ
+        case 1: return flags_zsp(cpu) & FLAG_Z;     // Z
+        case 2: return !(cpu->f & FLAG_C);          // NC
+        case 3: return cpu->f & FLAG_C;             // C
+        case 4: return !(flags_zsp(cpu) & FLAG_P);  // PO
+        case 5: return flags_zsp(cpu) & FLAG_P;     // PE
+        case 6: return !(flags_zsp(cpu) & FLAG_S);  // P
+        case 7: return flags_zsp(cpu) & FLAG_S;     // M
         default: return false;
     }
 }
 
-int cpu8080_step(cpu8080_t *cpu) {
-    if (cpu->halted) return 0;
-
+static int execute(cpu8080_t *cpu) {
     uint8_t op = fetch(cpu);
     uint8_t hi = (op >> 6) & 0x03;
     uint8_t mid = (op >> 3) & 0x07;
@@ -127,16 +399,15 @@ int cpu8080_step(cpu8080_t *cpu) {
     // ALU operations with register
     if (hi == 2) {
         uint8_t val = read_reg(cpu, lo);
-        uint8_t cy = (cpu->f & FLAG_C) ? 1 : 0;
         switch (mid) {
-            case 0: set_flags_add(cpu, cpu->a, val, 0); cpu->a += val; break;
-            case 1: { uint16_t r = cpu->a + val + cy; set_flags_add(cpu, cpu->a, val, cy); cpu->a = r; } break;
-            case 2: set_flags_sub(cpu, cpu->a, val, 0); cpu->a -= val; break;
-            case 3: { uint16_t r = cpu->a - val - cy; set_flags_sub(cpu, cpu->a, val, cy); cpu->a = r; } break;
-            case 4: cpu->a &= val; set_flags_zsp(cpu, cpu->a); cpu->f &= ~FLAG_C; cpu->f |= FLAG_AC; break;
-            case 5: cpu->a ^= val; set_flags_zsp(cpu, cpu->a); cpu->f &= ~(FLAG_C | FLAG_AC); break;
-            case 6: cpu->a |= val; set_flags_zsp(cpu, cpu->a); cpu->f &= ~(FLAG_C | FLAG_AC); break;
-            case 7: set_flags_sub(cpu, cpu->a, val, 0); break;  // CMP
+            case 0: alu_add(cpu, val); break;
+            case 1: alu_adc(cpu, val); break;
+            case 2: alu_sub(cpu, val); break;
+            case 3: alu_sbb(cpu, val); break;
+            case 4: alu_ana(cpu, val); break;
+            case 5: alu_xra(cpu, val); break;
+            case 6: alu_ora(cpu, val); break;
+            case 7: alu_cmp(cpu, val); break;
         }
         return (lo == 6) ? 7 : 4;
     }
@@ -148,10 +419,10 @@ int cpu8080_step(cpu8080_t *cpu) {
         case 0x21: cpu8080_set_hl(cpu, fetch16(cpu)); return 10;
         case 0x31: cpu->sp = fetch16(cpu); return 10;
 
-        case 0x02: memory_write(cpu8080_get_bc(cpu), cpu->a); return 7;
-        case 0x12: memory_write(cpu8080_get_de(cpu), cpu->a); return 7;
-        case 0x0A: cpu->a = memory_read(cpu8080_get_bc(cpu)); return 7;
-        case 0x1A: cpu->a = memory_read(cpu8080_get_de(cpu)); return 7;
+        case 0x02: memory_write(cpu->bus, cpu8080_get_bc(cpu), cpu->a); return 7;
+        case 0x12: memory_write(cpu->bus, cpu8080_get_de(cpu), cpu->a); return 7;
+        case 0x0A: cpu->a = memory_read(cpu->bus, cpu8080_get_bc(cpu)); return 7;
+        case 0x1A: cpu->a = memory_read(cpu->bus, cpu8080_get_de(cpu)); return 7;
 
         case 0x03: cpu8080_set_bc(cpu, cpu8080_get_bc(cpu) + 1); return 5;
         case 0x13: cpu8080_set_de(cpu, cpu8080_get_de(cpu) + 1); return 5;
@@ -165,25 +436,13 @@ int cpu8080_step(cpu8080_t *cpu) {
         case 0x04: case 0x0C: case 0x14: case 0x1C:
         case 0x24: case 0x2C: case 0x34: case 0x3C: {
             uint8_t r = mid;
-            uint8_t val = read_reg(cpu, r);
-            uint8_t ac = ((val & 0x0F) == 0x0F) ? FLAG_AC : 0;
-            val++;
-            write_reg(cpu, r, val);
-            set_flags_zsp(cpu, val);
-            cpu->f = (cpu->f & FLAG_C) | (cpu->f & ~(FLAG_Z | FLAG_S | FLAG_P | FLAG_AC)) | ac;
-            set_flags_zsp(cpu, val);
-            cpu->f = (cpu->f & ~FLAG_AC) | ac;
+            write_reg(cpu, r, alu_inr(cpu, read_reg(cpu, r)));
             return (r == 6) ? 10 : 5;
         }
         case 0x05: case 0x0D: case 0x15: case 0x1D:
         case 0x25: case 0x2D: case 0x35: case 0x3D: {
             uint8_t r = mid;
-            uint8_t val = read_reg(cpu, r);
-            uint8_t ac = ((val & 0x0F) == 0x00) ? FLAG_AC : 0;
-            val--;
-            write_reg(cpu, r, val);
-            set_flags_zsp(cpu, val);
-            cpu->f = (cpu->f & ~FLAG_AC) | ac;
+            write_reg(cpu, r, alu_dcr(cpu, read_reg(cpu, r)));
             return (r == 6) ? 10 : 5;
         }
 
@@ -193,7 +452,7 @@ int cpu8080_step(cpu8080_t *cpu) {
         case 0x1E: cpu->e = fetch(cpu); return 7;
         case 0x26: cpu->h = fetch(cpu); return 7;
         case 0x2E: cpu->l = fetch(cpu); return 7;
-        case 0x36: memory_write(cpu8080_get_hl(cpu), fetch(cpu)); return 10;
+        case 0x36: memory_write(cpu->bus, cpu8080_get_hl(cpu), fetch(cpu)); return 10;
         case 0x3E: cpu->a = fetch(cpu); return 7;
 
         case 0x07: {
@@ -246,34 +505,25 @@ int cpu8080_step(cpu8080_t *cpu) {
             return 10;
         }
 
-        case 0x22: memory_write_word(fetch16(cpu), cpu8080_get_hl(cpu)); return 16;
-        case 0x2A: cpu8080_set_hl(cpu, memory_read_word(fetch16(cpu))); return 16;
-        case 0x32: memory_write(fetch16(cpu), cpu->a); return 13;
-        case 0x3A: cpu->a = memory_read(fetch16(cpu)); return 13;
+        case 0x22: memory_write_word(cpu->bus, fetch16(cpu), cpu8080_get_hl(cpu)); return 16;
+        case 0x2A: cpu8080_set_hl(cpu, memory_read_word(cpu->bus, fetch16(cpu))); return 16;
+        case 0x32: memory_write(cpu->bus, fetch16(cpu), cpu->a); return 13;
+        case 0x3A: cpu->a = memory_read(cpu->bus, fetch16(cpu)); return 13;
 
         case 0x2F: cpu->a = ~cpu->a; return 4;
         case 0x37: cpu->f |= FLAG_C; return 4;
         case 0x3F: cpu->f ^= FLAG_C; return 4;
 
-        case 0x27: {
-            uint8_t cy = cpu->f & FLAG_C;
-            uint8_t add = 0;
-            if ((cpu->f & FLAG_AC) || (cpu->a & 0x0F) > 9) add |= 0x06;
-            if (cy || cpu->a > 0x99) { add |= 0x60; cy = FLAG_C; }
-            set_flags_add(cpu, cpu->a, add, 0);
-            cpu->a += add;
-            cpu->f |= cy;
-            return 4;
-        }
+        case 0x27: alu_daa(cpu); return 4;
 
-        case 0xC6: { uint8_t v = fetch(cpu); set_flags_add(cpu, cpu->a, v, 0); cpu->a += v; return 7; }
-        case 0xCE: { uint8_t v = fetch(cpu); uint8_t c = (cpu->f & FLAG_C) ? 1 : 0; set_flags_add(cpu, cpu->a, v, c); cpu->a += v + c; return 7; }
-        case 0xD6: { uint8_t v = fetch(cpu); set_flags_sub(cpu, cpu->a, v, 0); cpu->a -= v; return 7; }
-        case 0xDE: { uint8_t v = fetch(cpu); uint8_t c = (cpu->f & FLAG_C) ? 1 : 0; set_flags_sub(cpu, cpu->a, v, c); cpu->a -= v + c; return 7; }
-        case 0xE6: { uint8_t v = fetch(cpu); cpu->a &= v; set_flags_zsp(cpu, cpu->a); cpu->f &= ~FLAG_C; cpu->f |= FLAG_AC; return 7; }
-        case 0xEE: { uint8_t v = fetch(cpu); cpu->a ^= v; set_flags_zsp(cpu, cpu->a); cpu->f &= ~(FLAG_C | FLAG_AC); return 7; }
-        case 0xF6: { uint8_t v = fetch(cpu); cpu->a |= v; set_flags_zsp(cpu, cpu->a); cpu->f &= ~(FLAG_C | FLAG_AC); return 7; }
-        case 0xFE: { uint8_t v = fetch(cpu); set_flags_sub(cpu, cpu->a, v, 0); return 7; }
+        case 0xC6: alu_add(cpu, fetch(cpu)); return 7;
+        case 0xCE: alu_adc(cpu, fetch(cpu)); return 7;
+        case 0xD6: alu_sub(cpu, fetch(cpu)); return 7;
+        case 0xDE: alu_sbb(cpu, fetch(cpu)); return 7;
+        case 0xE6: alu_ana(cpu, fetch(cpu)); return 7;
+        case 0xEE: alu_xra(cpu, fetch(cpu)); return 7;
+        case 0xF6: alu_ora(cpu, fetch(cpu)); return 7;
+        case 0xFE: alu_cmp(cpu, fetch(cpu)); return 7;
 
         case 0xC3: cpu->pc = fetch16(cpu); return 10;
         case 0xC2: case 0xCA: case 0xD2: case 0xDA:
@@ -306,16 +556,16 @@ int cpu8080_step(cpu8080_t *cpu) {
         case 0xC5: push16(cpu, cpu8080_get_bc(cpu)); return 11;
         case 0xD5: push16(cpu, cpu8080_get_de(cpu)); return 11;
         case 0xE5: push16(cpu, cpu8080_get_hl(cpu)); return 11;
-        case 0xF5: push16(cpu, (cpu->a << 8) | (cpu->f | 0x02)); return 11;
+        case 0xF5: push16(cpu, (cpu->a << 8) | (cpu8080_get_f(cpu) | 0x02)); return 11;
 
         case 0xC1: cpu8080_set_bc(cpu, pop16(cpu)); return 10;
         case 0xD1: cpu8080_set_de(cpu, pop16(cpu)); return 10;
         case 0xE1: cpu8080_set_hl(cpu, pop16(cpu)); return 10;
-        case 0xF1: { uint16_t v = pop16(cpu); cpu->f = (v & 0xD7) | 0x02; cpu->a = v >> 8; return 10; }
+        case 0xF1: pop_psw(cpu, pop16(cpu)); return 10;
 
         case 0xE3: {
-            uint16_t tmp = memory_read_word(cpu->sp);
-            memory_write_word(cpu->sp, cpu8080_get_hl(cpu));
+            uint16_t tmp = memory_read_word(cpu->bus, cpu->sp);
+            memory_write_word(cpu->bus, cpu->sp, cpu8080_get_hl(cpu));
             cpu8080_set_hl(cpu, tmp);
             return 18;
         }
@@ -328,12 +578,631 @@ int cpu8080_step(cpu8080_t *cpu) {
         }
         case 0xF9: cpu->sp = cpu8080_get_hl(cpu); return 5;
 
-        case 0xDB: fetch(cpu); return 10;  // IN (stub)
-        case 0xD3: fetch(cpu); return 10;  // OUT (stub)
+        case 0xDB: cpu->a = memory_port_read(cpu->bus, fetch(cpu), cpu->cycles); return 10;  // IN
+        case 0xD3: memory_port_write(cpu->bus, fetch(cpu), cpu->a, cpu->cycles); return 10;  // OUT
 
-        case 0xFB: cpu->inte = true; return 4;
-        case 0xF3: cpu->inte = false; return 4;
+        case 0xFB: enable_interrupts(cpu); return 4;
+        case 0xF3: disable_interrupts(cpu); return 4;
 
         default: return 4;  // Undefined opcodes as NOP
     }
 }
+
+#else  // CPU8080_DISPATCH_TABLE
+
+// Table-driven engine: one specialized handler per opcode, so operand
+// registers, condition codes and cycle counts are all fixed at compile time.
+
+#define COND_NZ (!(flags_zsp(cpu) & FLAG_Z))
+#define COND_Z  (flags_zsp(cpu) & FLAG_Z)
+#define COND_NC (!(cpu->f & FLAG_C))
+#define COND_C  (cpu->f & FLAG_C)
+#define COND_PO (!(flags_zsp(cpu) & FLAG_P))
+#define COND_PE (flags_zsp(cpu) & FLAG_P)
+#define COND_P  (!(flags_zsp(cpu) & FLAG_S))
+#define COND_M  (flags_zsp(cpu) & FLAG_S)
+
+// With the translation cache, handlers get their operand already fetched in
+// imm and PC past the instruction, so the cache can run them from pre-decoded
+// micro-ops. Otherwise they fetch operands themselves, which is cheaper for
+// the plain interpreter. Most handlers take no operand and leave imm unused.
+#if CPU8080_TCACHE
+typedef int (*op_fn_t)(cpu8080_t *cpu, uint16_t imm);
+#define OP(code) static int op_##code(cpu8080_t *cpu, __attribute__((unused)) uint16_t imm)
+#define IMM8  ((uint8_t)imm)
+#define IMM16 imm
+#else
+typedef int (*op_fn_t)(cpu8080_t *cpu);
+#define OP(code) static int op_##code(cpu8080_t *cpu)
+#define IMM8  fetch(cpu)
+#define IMM16 fetch16(cpu)
+#endif
+
+#define LXI(code, rp)   OP(code) { cpu8080_set_##rp(cpu, IMM16); return 10; }
+#define INX(code, rp)   OP(code) { cpu8080_set_##rp(cpu, cpu8080_get_##rp(cpu) + 1); return 5; }
+#define DCX(code, rp)   OP(code) { cpu8080_set_##rp(cpu, cpu8080_get_##rp(cpu) - 1); return 5; }
+#define DAD(code, rp)   OP(code) { alu_dad(cpu, cpu8080_get_##rp(cpu)); return 10; }
+#define INR(code, r)    OP(code) { cpu->r = alu_inr(cpu, cpu->r); return 5; }
+#define DCR(code, r)    OP(code) { cpu->r = alu_dcr(cpu, cpu->r); return 5; }
+#define MVI(code, r)    OP(code) { cpu->r = IMM8; return 7; }
+
+#define MOV_RR(code, dst, src) OP(code) { cpu->dst = cpu->src; return 5; }
+#define MOV_RM(code, dst)      OP(code) { cpu->dst = memory_read(cpu->bus, cpu8080_get_hl(cpu)); return 7; }
+#define MOV_MR(code, src)      OP(code) { memory_write(cpu->bus, cpu8080_get_hl(cpu), cpu->src); return 7; }
+
+#define ALU_R(code, fn, src) OP(code) { fn(cpu, cpu->src); return 4; }
+#define ALU_M(code, fn)      OP(code) { fn(cpu, memory_read(cpu->bus, cpu8080_get_hl(cpu))); return 7; }
+#define ALU_I(code, fn)      OP(code) { fn(cpu, IMM8); return 7; }
+
+#define JCC(code, cond) OP(code) { uint16_t addr = IMM16; if (cond) cpu->pc = addr; return 10; }
+#define CCC(code, cond) OP(code) { \
+        uint16_t addr = IMM16; \
+        if (cond) { push16(cpu, cpu->pc); cpu->pc = addr; return 17; } \
+        return 11; \
+    }
+#define RCC(code, cond) OP(code) { if (cond) { cpu->pc = pop16(cpu); return 11; } return 5; }
+#define RST(code, vec)  OP(code) { push16(cpu, cpu->pc); cpu->pc = (vec); return 11; }
+#define PUSH(code, rp)  OP(code) { push16(cpu, cpu8080_get_##rp(cpu)); return 11; }
+#define POP(code, rp)   OP(code) { cpu8080_set_##rp(cpu, pop16(cpu)); return 10; }
+
+OP(0x00) { (void)cpu; return 4; }  // NOP (also undefined opcodes)
+
+LXI(0x01, bc) LXI(0x11, de) LXI(0x21, hl)
+OP(0x31) { cpu->sp = IMM16; return 10; }
+
+OP(0x02) { memory_write(cpu->bus, cpu8080_get_bc(cpu), cpu->a); return 7; }
+OP(0x12) { memory_write(cpu->bus, cpu8080_get_de(cpu), cpu->a); return 7; }
+OP(0x0A) { cpu->a = memory_read(cpu->bus, cpu8080_get_bc(cpu)); return 7; }
+OP(0x1A) { cpu->a = memory_read(cpu->bus, cpu8080_get_de(cpu)); return 7; }
+
+INX(0x03, bc) INX(0x13, de) INX(0x23, hl)
+OP(0x33) { cpu->sp++; return 5; }
+DCX(0x0B, bc) DCX(0x1B, de) DCX(0x2B, hl)
+OP(0x3B) { cpu->sp--; return 5; }
+
+INR(0x04, b) INR(0x0C, c) INR(0x14, d) INR(0x1C, e) INR(0x24, h) INR(0x2C, l) INR(0x3C, a)
+OP(0x34) { uint16_t hl = cpu8080_get_hl(cpu); memory_write(cpu->bus, hl, alu_inr(cpu, memory_read(cpu->bus, hl))); return 10; }
+DCR(0x05, b) DCR(0x0D, c) DCR(0x15, d) DCR(0x1D, e) DCR(0x25, h) DCR(0x2D, l) DCR(0x3D, a)
+OP(0x35) { uint16_t hl = cpu8080_get_hl(cpu); memory_write(cpu->bus, hl, alu_dcr(cpu, memory_read(cpu->bus, hl))); return 10; }
+
+MVI(0x06, b) MVI(0x0E, c) MVI(0x16, d) MVI(0x1E, e) MVI(0x26, h) MVI(0x2E, l) MVI(0x3E, a)
+OP(0x36) { memory_write(cpu->bus, cpu8080_get_hl(cpu), IMM8); return 10; }
+
+OP(0x07) {
+    uint8_t cy = (cpu->a & 0x80) >> 7;
+    cpu->a = (cpu->a << 1) | cy;
+    cpu->f = (cpu->f & ~FLAG_C) | cy;
+    return 4;
+}
+OP(0x0F) {
+    uint8_t cy = cpu->a & 0x01;
+    cpu->a = (cpu->a >> 1) | (cy << 7);
+    cpu->f = (cpu->f & ~FLAG_C) | cy;
+    return 4;
+}
+OP(0x17) {
+    uint8_t cy = (cpu->a & 0x80) >> 7;
+    cpu->a = (cpu->a << 1) | ((cpu->f & FLAG_C) ? 1 : 0);
+    cpu->f = (cpu->f & ~FLAG_C) | cy;
+    return 4;
+}
+OP(0x1F) {
+    uint8_t cy = cpu->a & 0x01;
+    cpu->a = (cpu->a >> 1) | ((cpu->f & FLAG_C) ? 0x80 : 0);
+    cpu->f = (cpu->f & ~FLAG_C) | cy;
+    return 4;
+}
+
+DAD(0x09, bc) DAD(0x19, de) DAD(0x29, hl)
+OP(0x39) { alu_dad(cpu, cpu->sp); return 10; }
+
+OP(0x22) { memory_write_word(cpu->bus, IMM16, cpu8080_get_hl(cpu)); return 16; }
+OP(0x2A) { cpu8080_set_hl(cpu, memory_read_word(cpu->bus, IMM16)); return 16; }
+OP(0x32) { memory_write(cpu->bus, IMM16, cpu->a); return 13; }
+OP(0x3A) { cpu->a = memory_read(cpu->bus, IMM16); return 13; }
+
+OP(0x2F) { cpu->a = ~cpu->a; return 4; }
+OP(0x37) { cpu->f |= FLAG_C; return 4; }
+OP(0x3F) { cpu->f ^= FLAG_C; return 4; }
+
+OP(0x27) { alu_daa(cpu); return 4; }
+
+// MOV r,r' / MOV r,M / MOV M,r / HLT
+MOV_RR(0x40, b, b) MOV_RR(0x41, b, c) MOV_RR(0x42, b, d) MOV_RR(0x43, b, e)
+MOV_RR(0x44, b, h) MOV_RR(0x45, b, l) MOV_RM(0x46, b) MOV_RR(0x47, b, a)
+MOV_RR(0x48, c, b) MOV_RR(0x49, c, c) MOV_RR(0x4A, c, d) MOV_RR(0x4B, c, e)
+MOV_RR(0x4C, c, h) MOV_RR(0x4D, c, l) MOV_RM(0x4E, c) MOV_RR(0x4F, c, a)
+MOV_RR(0x50, d, b) MOV_RR(0x51, d, c) MOV_RR(0x52, d, d) MOV_RR(0x53, d, e)
+MOV_RR(0x54, d, h) MOV_RR(0x55, d, l) MOV_RM(0x56, d) MOV_RR(0x57, d, a)
+MOV_RR(0x58, e, b) MOV_RR(0x59, e, c) MOV_RR(0x5A, e, d) MOV_RR(0x5B, e, e)
+MOV_RR(0x5C, e, h) MOV_RR(0x5D, e, l) MOV_RM(0x5E, e) MOV_RR(0x5F, e, a)
+MOV_RR(0x60, h, b) MOV_RR(0x61, h, c) MOV_RR(0x62, h, d) MOV_RR(0x63, h, e)
+MOV_RR(0x64, h, h) MOV_RR(0x65, h, l) MOV_RM(0x66, h) MOV_RR(0x67, h, a)
+MOV_RR(0x68, l, b) MOV_RR(0x69, l, c) MOV_RR(0x6A, l, d) MOV_RR(0x6B, l, e)
+MOV_RR(0x6C, l, h) MOV_RR(0x6D, l, l) MOV_RM(0x6E, l) MOV_RR(0x6F, l, a)
+MOV_MR(0x70, b) MOV_MR(0x71, c) MOV_MR(0x72, d) MOV_MR(0x73, e)
+MOV_MR(0x74, h) MOV_MR(0x75, l) OP(0x76) { cpu->halted = true; return 7; } MOV_MR(0x77, a)
+MOV_RR(0x78, a, b) MOV_RR(0x79, a, c) MOV_RR(0x7A, a, d) MOV_RR(0x7B, a, e)
+MOV_RR(0x7C, a, h) MOV_RR(0x7D, a, l) MOV_RM(0x7E, a) MOV_RR(0x7F, a, a)
+
+// ALU operations with register / memory operand
+ALU_R(0x80, alu_add, b) ALU_R(0x81, alu_add, c) ALU_R(0x82, alu_add, d) ALU_R(0x83, alu_add, e)
+ALU_R(0x84, alu_add, h) ALU_R(0x85, alu_add, l) ALU_M(0x86, alu_add) ALU_R(0x87, alu_add, a)
+ALU_R(0x88, alu_adc, b) ALU_R(0x89, alu_adc, c) ALU_R(0x8A, alu_adc, d) ALU_R(0x8B, alu_adc, e)
+ALU_R(0x8C, alu_adc, h) ALU_R(0x8D, alu_adc, l) ALU_M(0x8E, alu_adc) ALU_R(0x8F, alu_adc, a)
+ALU_R(0x90, alu_sub, b) ALU_R(0x91, alu_sub, c) ALU_R(0x92, alu_sub, d) ALU_R(0x93, alu_sub, e)
+ALU_R(0x94, alu_sub, h) ALU_R(0x95, alu_sub, l) ALU_M(0x96, alu_sub) ALU_R(0x97, alu_sub, a)
+ALU_R(0x98, alu_sbb, b) ALU_R(0x99, alu_sbb, c) ALU_R(0x9A, alu_sbb, d) ALU_R(0x9B, alu_sbb, e)
+ALU_R(0x9C, alu_sbb, h) ALU_R(0x9D, alu_sbb, l) ALU_M(0x9E, alu_sbb) ALU_R(0x9F, alu_sbb, a)
+ALU_R(0xA0, alu_ana, b) ALU_R(0xA1, alu_ana, c) ALU_R(0xA2, alu_ana, d) ALU_R(0xA3, alu_ana, e)
+ALU_R(0xA4, alu_ana, h) ALU_R(0xA5, alu_ana, l) ALU_M(0xA6, alu_ana) ALU_R(0xA7, alu_ana, a)
+ALU_R(0xA8, alu_xra, b) ALU_R(0xA9, alu_xra, c) ALU_R(0xAA, alu_xra, d) ALU_R(0xAB, alu_xra, e)
+ALU_R(0xAC, alu_xra, h) ALU_R(0xAD, alu_xra, l) ALU_M(0xAE, alu_xra) ALU_R(0xAF, alu_xra, a)
+ALU_R(0xB0, alu_ora, b) ALU_R(0xB1, alu_ora, c) ALU_R(0xB2, alu_ora, d) ALU_R(0xB3, alu_ora, e)
+ALU_R(0xB4, alu_ora, h) ALU_R(0xB5, alu_ora, l) ALU_M(0xB6, alu_ora) ALU_R(0xB7, alu_ora, a)
+ALU_R(0xB8, alu_cmp, b) ALU_R(0xB9, alu_cmp, c) ALU_R(0xBA, alu_cmp, d) ALU_R(0xBB, alu_cmp, e)
+ALU_R(0xBC, alu_cmp, h) ALU_R(0xBD, alu_cmp, l) ALU_M(0xBE, alu_cmp) ALU_R(0xBF, alu_cmp, a)
+
+ALU_I(0xC6, alu_add) ALU_I(0xCE, alu_adc) ALU_I(0xD6, alu_sub) ALU_I(0xDE, alu_sbb)
+ALU_I(0xE6, alu_ana) ALU_I(0xEE, alu_xra) ALU_I(0xF6, alu_ora) ALU_I(0xFE, alu_cmp)
+
+OP(0xC3) { cpu->pc = IMM16; return 10; }
+JCC(0xC2, COND_NZ) JCC(0xCA, COND_Z) JCC(0xD2, COND_NC) JCC(0xDA, COND_C)
+JCC(0xE2, COND_PO) JCC(0xEA, COND_PE) JCC(0xF2, COND_P) JCC(0xFA, COND_M)
+
+OP(0xCD) { uint16_t addr = IMM16; push16(cpu, cpu->pc); cpu->pc = addr; return 17; }
+CCC(0xC4, COND_NZ) CCC(0xCC, COND_Z) CCC(0xD4, COND_NC) CCC(0xDC, COND_C)
+CCC(0xE4, COND_PO) CCC(0xEC, COND_PE) CCC(0xF4, COND_P) CCC(0xFC, COND_M)
+
+OP(0xC9) { cpu->pc = pop16(cpu); return 10; }
+RCC(0xC0, COND_NZ) RCC(0xC8, COND_Z) RCC(0xD0, COND_NC) RCC(0xD8, COND_C)
+RCC(0xE0, COND_PO) RCC(0xE8, COND_PE) RCC(0xF0, COND_P) RCC(0xF8, COND_M)
+
+RST(0xC7, 0x00) RST(0xCF, 0x08) RST(0xD7, 0x10) RST(0xDF, 0x18)
+RST(0xE7, 0x20) RST(0xEF, 0x28) RST(0xF7, 0x30) RST(0xFF, 0x38)
+
+PUSH(0xC5, bc) PUSH(0xD5, de) PUSH(0xE5, hl)
+OP(0xF5) { push16(cpu, (cpu->a << 8) | (cpu8080_get_f(cpu) | 0x02)); return 11; }
+POP(0xC1, bc) POP(0xD1, de) POP(0xE1, hl)
+OP(0xF1) { pop_psw(cpu, pop16(cpu)); return 10; }
+
+OP(0xE3) {
+    uint16_t tmp = memory_read_word(cpu->bus, cpu->sp);
+    memory_write_word(cpu->bus, cpu->sp, cpu8080_get_hl(cpu));
+    cpu8080_set_hl(cpu, tmp);
+    return 18;
+}
+OP(0xE9) { cpu->pc = cpu8080_get_hl(cpu); return 5; }
+OP(0xEB) {
+    uint16_t tmp = cpu8080_get_de(cpu);
+    cpu8080_set_de(cpu, cpu8080_get_hl(cpu));
+    cpu8080_set_hl(cpu, tmp);
+    return 4;
+}
+OP(0xF9) { cpu->sp = cpu8080_get_hl(cpu); return 5; }
+
+OP(0xDB) { cpu->a = memory_port_read(cpu->bus, IMM8, cpu->cycles); return 10; }  // IN
+OP(0xD3) { memory_port_write(cpu->bus, IMM8, cpu->a, cpu->cycles); return 10; }  // OUT
+
+OP(0xFB) { enable_interrupts(cpu); return 4; }
+OP(0xF3) { disable_interrupts(cpu); return 4; }
+
+static const op_fn_t op_table[256] = {
+    op_0x00, op_0x01, op_0x02, op_0x03, op_0x04, op_0x05, op_0x06, op_0x07,
+    op_0x00, op_0x09, op_0x0A, op_0x0B, op_0x0C, op_0x0D, op_0x0E, op_0x0F,
+    op_0x00, op_0x11, op_0x12, op_0x13, op_0x14, op_0x15, op_0x16, op_0x17,
+    op_0x00, op_0x19, op_0x1A, op_0x1B, op_0x1C, op_0x1D, op_0x1E, op_0x1F,
+    op_0x00, op_0x21, op_0x22, op_0x23, op_0x24, op_0x25, op_0x26, op_0x27,
+    op_0x00, op_0x29, op_0x2A, op_0x2B, op_0x2C, op_0x2D, op_0x2E, op_0x2F,
+    op_0x00, op_0x31, op_0x32, op_0x33, op_0x34, op_0x35, op_0x36, op_0x37,
+    op_0x00, op_0x39, op_0x3A, op_0x3B, op_0x3C, op_0x3D, op_0x3E, op_0x3F,
+    op_0x40, op_0x41, op_0x42, op_0x43, op_0x44, op_0x45, op_0x46, op_0x47,
+    op_0x48, op_0x49, op_0x4A, op_0x4B, op_0x4C, op_0x4D, op_0x4E, op_0x4F,
+    op_0x50, op_0x51, op_0x52, op_0x53, op_0x54, op_0x55, op_0x56, op_0x57,
+    op_0x58, op_0x59, op_0x5A, op_0x5B, op_0x5C, op_0x5D, op_0x5E, op_0x5F,
+    op_0x60, op_0x61, op_0x62, op_0x63, op_0x64, op_0x65, op_0x66, op_0x67,
+    op_0x68, op_0x69, op_0x6A, op_0x6B, op_0x6C, op_0x6D, op_0x6E, op_0x6F,
+    op_0x70, op_0x71, op_0x72, op_0x73, op_0x74, op_0x75, op_0x76, op_0x77,
+    op_0x78, op_0x79, op_0x7A, op_0x7B, op_0x7C, op_0x7D, op_0x7E, op_0x7F,
+    op_0x80, op_0x81, op_0x82, op_0x83, op_0x84, op_0x85, op_0x86, op_0x87,
+    op_0x88, op_0x89, op_0x8A, op_0x8B, op_0x8C, op_0x8D, op_0x8E, op_0x8F,
+    op_0x90, op_0x91, op_0x92, op_0x93, op_0x94, op_0x95, op_0x96, op_0x97,
+    op_0x98, op_0x99, op_0x9A, op_0x9B, op_0x9C, op_0x9D, op_0x9E, op_0x9F,
+    op_0xA0, op_0xA1, op_0xA2, op_0xA3, op_0xA4, op_0xA5, op_0xA6, op_0xA7,
+    op_0xA8, op_0xA9, op_0xAA, op_0xAB, op_0xAC, op_0xAD, op_0xAE, op_0xAF,
+    op_0xB0, op_0xB1, op_0xB2, op_0xB3, op_0xB4, op_0xB5, op_0xB6, op_0xB7,
+    op_0xB8, op_0xB9, op_0xBA, op_0xBB, op_0xBC, op_0xBD, op_0xBE, op_0xBF,
+    op_0xC0, op_0xC1, op_0xC2, op_0xC3, op_0xC4, op_0xC5, op_0xC6, op_0xC7,
+    op_0xC8, op_0xC9, op_0xCA, op_0x00, op_0xCC, op_0xCD, op_0xCE, op_0xCF,
+    op_0xD0, op_0xD1, op_0xD2, op_0xD3, op_0xD4, op_0xD5, op_0xD6, op_0xD7,
+    op_0xD8, op_0x00, op_0xDA, op_0xDB, op_0xDC, op_0x00, op_0xDE, op_0xDF,
+    op_0xE0, op_0xE1, op_0xE2, op_0xE3, op_0xE4, op_0xE5, op_0xE6, op_0xE7,
+    op_0xE8, op_0xE9, op_0xEA, op_0xEB, op_0xEC, op_0x00, op_0xEE, op_0xEF,
+    op_0xF0, op_0xF1, op_0xF2, op_0xF3, op_0xF4, op_0xF5, op_0xF6, op_0xF7,
+    op_0xF8, op_0xF9, op_0xFA, op_0xFB, op_0xFC, op_0x00, op_0xFE, op_0xFF,
+};
+
+#if CPU8080_TCACHE
+
+// Instruction length, plus whether it may write memory or must end a
+// translated block (jumps, calls, returns, HLT, I/O and interrupt control).
+// I/O and EI also start a block, so cpu->cycles is only brought up to date
+// per block and is still exact for the device and the EI delay.
+#define OPI_LEN    0x03
+#define OPI_WRITES 0x04
+#define OPI_END    0x08
+#define OPI_SYNC   0x10
+
+#define I1 1
+#define I2 2
+#define I3 3
+#define W  OPI_WRITES
+#define E  OPI_END
+#define S  OPI_SYNC
+
+static const uint8_t op_info[256] = {
+    I1, I3, I1|W, I1, I1, I1, I2, I1, I1, I1, I1, I1, I1, I1, I2, I1,
+    I1, I3, I1|W, I1, I1, I1, I2, I1, I1, I1, I1, I1, I1, I1, I2, I1,
+    I1, I3, I3|W, I1, I1, I1, I2, I1, I1, I1, I3, I1, I1, I1, I2, I1,
+    I1, I3, I3|W, I1, I1|W, I1|W, I2|W, I1, I1, I1, I3, I1, I1, I1, I2, I1,
+    I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1,
+    I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1,
+    I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1,
+    I1|W, I1|W, I1|W, I1|W, I1|W, I1|W, I1|E, I1|W, I1, I1, I1, I1, I1, I1, I1, I1,
+    I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1,
+    I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1,
+    I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1,
+    I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1, I1,
+    I1|E, I1, I3|E, I3|E, I3|W|E, I1|W, I2, I1|W|E, I1|E, I1|E, I3|E, I1, I3|W|E, I3|W|E, I2, I1|W|E,
+    I1|E, I1, I3|E, I2|S|E, I3|W|E, I1|W, I2, I1|W|E, I1|E, I1, I3|E, I2|S|E, I3|W|E, I1, I2, I1|W|E,
+    I1|E, I1, I3|E, I1|W, I3|W|E, I1|W, I2, I1|W|E, I1|E, I1|E, I3|E, I1, I3|W|E, I1, I2, I1|W|E,
+    I1|E, I1, I3|E, I1|E, I3|W|E, I1|W, I2, I1|W|E, I1|E, I1, I3|E, I1|S|E, I3|W|E, I1, I2, I1|W|E,
+};
+
+#undef I1
+#undef I2
+#undef I3
+#undef W
+#undef E
+#undef S
+
+static inline int execute_op(cpu8080_t *cpu, uint8_t op) {
+    uint8_t len = op_info[op] & OPI_LEN;
+    uint16_t imm = 0;
+    if (len == 2) {
+        imm = fetch(cpu);
+    } else if (len == 3) {
+        imm = fetch16(cpu);
+    }
+    return op_table[op](cpu, imm);
+}
+
+static inline int execute(cpu8080_t *cpu) {
+    return execute_op(cpu, fetch(cpu));
+}
+
+#define TCACHE_SLOT(pc) (((pc) ^ ((pc) >> 8)) & (CPU8080_TCACHE_BLOCKS - 1))
+
+void cpu8080_attach_tcache(cpu8080_t *cpu, cpu8080_tcache_t *tc) {
+    for (int i = 0; i < CPU8080_TCACHE_BLOCKS; i++) {
+        tc->blocks[i].count = 0;
+        tc->blocks[i].pending = 0;
+#if CPU8080_JIT
+        tc->blocks[i].hits = 0;
+        tc->blocks[i].native = NULL;
+#endif
+#if CPU8080_AOT
+        tc->blocks[i].aot = NULL;
+#endif
+        tc->blocks[i].link[0] = tc->blocks[i].link[1] = NULL;
+    }
+#if CPU8080_JIT
+    tc->jit = NULL;
+#endif
+#if CPU8080_AOT
+    tc->aot = true;
+#endif
+    cpu->tcache = tc;
+}
+
+static void translate(cpu8080_t *cpu, cpu8080_block_t *blk, uint16_t pc) {
+    bus_t *bus = cpu->bus;
+    loop_idiom_t lp;
+    uint8_t info;
+
+    blk->start = pc;
+    blk->pending = pc;
+    blk->count = 0;
+    blk->link[0] = blk->link[1] = NULL;
+#if CPU8080_JIT
+    blk->hits = 0;
+    blk->native = NULL;
+#endif
+    do {
+        uint8_t op = memory_read(bus, pc);
+        info = op_info[op];
+        if ((info & OPI_SYNC) && blk->count > 0) break;
+        cpu8080_uop_t *u = &blk->uops[blk->count++];
+        u->fn = op_table[op];
+        u->op = op;
+        u->len = info & OPI_LEN;
+        u->writes = (info & OPI_WRITES) != 0;
+        u->imm = 0;
+        if (u->len == 2) {
+            u->imm = memory_read(bus, pc + 1);
+        } else if (u->len == 3) {
+            u->imm = memory_read(bus, pc + 1) | (memory_read(bus, pc + 2) << 8);
+        }
+        pc += u->len;
+    } while (!(info & OPI_END) && blk->count < CPU8080_TCACHE_UOPS);
+    blk->end = pc;
+    blk->loop = loop_idiom_at(bus, blk->start, &lp);
+
+    // A block is at most 48 bytes, so it spans one or two pages
+    blk->page[0] = blk->start / MEMORY_PAGE_SIZE;
+    blk->page[1] = (uint16_t)(pc - 1) / MEMORY_PAGE_SIZE;
+    for (int i = 0; i < 2; i++) {
+        bus->code_page[blk->page[i]] = 1;
+        blk->gen[i] = bus->code_gen[blk->page[i]];
+    }
+#if CPU8080_AOT
+    blk->aot = cpu->tcache->aot ? cpu8080_aot_lookup(bus, blk) : NULL;
+#endif
+}
+
+static uint32_t execute_block(cpu8080_t *cpu, const cpu8080_block_t *blk) {
+    const cpu8080_uop_t *u = blk->uops;
+    const cpu8080_uop_t *end = u + blk->count;
+    uint32_t cycles = 0;
+
+    for (; u < end; u++) {
+        cpu->pc += u->len;
+        cycles += u->fn(cpu, u->imm);
+        // Self-modifying code: leave as soon as the block went stale. The
+        // caller counts the whole block, take back what didn't run.
+        if (u->writes && !block_valid(cpu->bus, blk)) {
+            cpu->instructions -= end - u - 1;
+            break;
+        }
+    }
+    return cycles;
+}
+
+// Run what would have been one block through the interpreter
+static uint32_t interpret_block(cpu8080_t *cpu) {
+    uint32_t cycles = 0;
+    uint8_t op;
+    int count = 0;
+    do {
+        op = memory_read(cpu->bus, cpu->pc);
+        if ((op_info[op] & OPI_SYNC) && count > 0) break;
+        cpu->pc++;
+        cycles += execute_op(cpu, op);
+        count++;
+    } while (!(op_info[op] & OPI_END) && count < CPU8080_TCACHE_UOPS);
+    cpu->instructions += count;
+    return cycles;
+}
+
+// Longest a block can run: every instruction an XTHL
+#define BLOCK_MAX_CYCLES (18 * CPU8080_TCACHE_UOPS)
+
+// Stops a block short of cpu->attention, which the caller then reaches
+// instruction by instruction
+static uint32_t run_blocks(cpu8080_t *cpu, uint32_t cycle_budget) {
+    cpu8080_tcache_t *tc = cpu->tcache;
+    cpu8080_block_t *prev = NULL;
+    uint64_t base = cpu->cycles;
+    uint32_t cycles = 0;
+    uint32_t insns = 0;
+
+    while (cycles < cycle_budget && !cpu->halted) {
+        uint16_t pc = cpu->pc;
+        int side = 0;
+        cpu8080_block_t *blk = NULL;
+
+        // Exact for I/O and EI, which always start a block and aren't loop idioms
+        cpu->cycles = base + cycles;
+        if (cpu->cycles + BLOCK_MAX_CYCLES >= cpu->attention) break;
+
+        // Follow the chain from the previous block if it still leads here
+        if (prev) {
+            side = pc != prev->end;
+            blk = prev->link[side];
+        }
+        if (!blk || blk->start != pc || blk->count == 0 || !block_valid(cpu->bus, blk)) {
+            blk = &tc->blocks[TCACHE_SLOT(pc)];
+            if (blk->count == 0 || !block_valid(cpu->bus, blk)) {
+                translate(cpu, blk, pc);
+            } else if (blk->start != pc) {
+                // Don't evict a live block for code seen only once
+                if (blk->pending != pc) {
+                    blk->pending = pc;
+                    cycles += interpret_block(cpu);
+                    prev = NULL;
+                    continue;
+                }
+                translate(cpu, blk, pc);
+            }
+            if (prev) prev->link[side] = blk;
+        }
+
+        if (blk->loop) {
+            uint32_t limit = cycle_budget - cycles;
+            if (cpu->attention - cpu->cycles - BLOCK_MAX_CYCLES < limit) {
+                limit = cpu->attention - cpu->cycles - BLOCK_MAX_CYCLES;
+            }
+            cycles += run_loop_idiom(cpu, limit);
+            if (cycles >= cycle_budget) break;
+            // A fill or copy may have written to the loop's own page
+            if (!block_valid(cpu->bus, blk)) {
+                prev = NULL;
+                continue;
+            }
+        }
+
+#if CPU8080_AOT
+        if (blk->aot) {
+            cpu->block_done = blk->count;
+            cycles += blk->aot(cpu, blk);
+            insns += cpu->block_done;
+            prev = blk;
+            continue;
+        }
+#endif
+#if CPU8080_JIT
+        if (!blk->native && tc->jit && ++blk->hits == CPU8080_JIT_THRESHOLD) {
+            blk->native = cpu8080_jit_compile(tc->jit, tc, cpu, blk);
+        }
+        if (blk->native) {
+            cpu->block_done = blk->count;
+            cycles += blk->native(cpu);
+            insns += cpu->block_done;
+            prev = blk;
+            continue;
+        }
+#endif
+
+        cycles += execute_block(cpu, blk);
+        insns += blk->count;
+        prev = blk;
+    }
+    cpu->cycles = base + cycles;
+    cpu->instructions += insns;
+    return cycles;
+}
+
+#if CPU8080_AOT
+int cpu8080_execute_op(cpu8080_t *cpu, uint8_t op, uint16_t imm) {
+    return op_table[op](cpu, imm);
+}
+#endif
+
+#else
+
+static inline int execute(cpu8080_t *cpu) {
+    return op_table[fetch(cpu)](cpu);
+}
+
+#endif  // CPU8080_TCACHE
+
+#endif
+
+// Longest wait in HLT one cpu8080_step() covers
+#define STEP_MAX_WAIT (1u << 30)
+
+int cpu8080_step(cpu8080_t *cpu) {
+    int cycles = 0;
+    if (cpu->halted && !cpu8080_stopped(cpu) && cpu->cycles < cpu->attention) {
+        uint64_t wait = cpu->attention - cpu->cycles;
+        cycles = wait < STEP_MAX_WAIT ? wait : STEP_MAX_WAIT;
+        cpu->cycles += cycles;
+    }
+    if (cpu->cycles >= cpu->attention) {
+        cycles += service(cpu);
+    }
+    if (cycles || cpu->halted) return cycles;
+    cpu->instructions++;
+    cycles = execute(cpu);
+    cpu->cycles += cycles;
+    return cycles;
+}
+
+// Interpreter, stopping at cpu->attention as well
+static uint32_t run_instructions(cpu8080_t *cpu, uint32_t cycle_budget) {
+    uint32_t cycles = 0;
+    while (cycles < cycle_budget && !cpu->halted && cpu->cycles < cpu->attention) {
+        uint16_t pc = cpu->pc;
+        uint32_t n = execute(cpu);
+        cycles += n;
+        cpu->cycles += n;
+        cpu->instructions++;
+        if (cpu8080_at_breakpoint(cpu)) break;
+
+        // A backward branch may have entered a loop idiom. Skipping is off
+        // with a breakpoint set, which could sit inside the loop.
+        if (cpu->pc <= pc && cycles < cycle_budget && !cpu->breakpoint_enabled &&
+            cpu->cycles < cpu->attention) {
+            uint32_t limit = cycle_budget - cycles;
+            if (cpu->attention - cpu->cycles < limit) limit = cpu->attention - cpu->cycles;
+            n = run_loop_idiom(cpu, limit);
+            cycles += n;
+            cpu->cycles += n;
+        }
+    }
+    return cycles;
+}
+
+uint32_t cpu8080_run(cpu8080_t *cpu, uint32_t cycle_budget) {
+    uint32_t cycles = 0;
+    while (cycles < cycle_budget) {
+        if (cpu->cycles >= cpu->attention) {
+            cycles += service(cpu);
+            if (cycles >= cycle_budget) break;
+        }
+        if (cpu->halted) {
+            // Only an interrupt ends HLT, wait for the next event if it can
+            if (cpu8080_stopped(cpu)) break;
+            uint64_t wait = cpu->attention - cpu->cycles;
+            if (wait > cycle_budget - cycles) wait = cycle_budget - cycles;
+            cpu->cycles += wait;
+            cycles += wait;
+            continue;
+        }
+#if CPU8080_TCACHE
+        if (cpu->tcache && !cpu->breakpoint_enabled &&
+            cpu->cycles + BLOCK_MAX_CYCLES < cpu->attention) {
+            cycles += run_blocks(cpu, cycle_budget - cycles);
+            continue;
+        }
+#endif
+        cycles += run_instructions(cpu, cycle_budget - cycles);
+        if (cpu8080_at_breakpoint(cpu)) break;
+    }
+    return cycles;
+}
+
+int cpu8080_next_writes(cpu8080_t *cpu, uint16_t addr[2]) {
+    // The step runs the events due first, and they decide whether it takes
+    // an interrupt, so run them now. Running them early changes nothing:
+    // they see the same cycle count.
+    if (!cpu->halted && cpu->cycles >= cpu->attention) {
+        run_due_events(cpu);
+        cpu8080_update_attention(cpu);
+    }
+
+    // An interrupt taken by this step pushes PC instead. In HLT the step
+    // waits for the next event first, so assume it may come.
+    if (cpu->halted ? !cpu8080_stopped(cpu) : interrupt_ready(cpu)) {
+        addr[0] = cpu->sp - 1;
+        addr[1] = cpu->sp - 2;
+        return 2;
+    }
+    if (cpu->halted) return 0;
+
+    bus_t *bus = cpu->bus;
+    uint8_t op = memory_peek(bus, MEMORY_BANK_CURRENT, cpu->pc);
+    uint16_t imm = memory_peek(bus, MEMORY_BANK_CURRENT, cpu->pc + 1) |
+                   (memory_peek(bus, MEMORY_BANK_CURRENT, cpu->pc + 2) << 8);
+    switch (op) {
+    case 0x02: addr[0] = cpu8080_get_bc(cpu); return 1;                 // STAX B
+    case 0x12: addr[0] = cpu8080_get_de(cpu); return 1;                 // STAX D
+    case 0x22: addr[0] = imm; addr[1] = imm + 1; return 2;              // SHLD
+    case 0x32: addr[0] = imm; return 1;                                 // STA
+    case 0x34: case 0x35: case 0x36:                                    // INR/DCR/MVI M
+        addr[0] = cpu8080_get_hl(cpu); return 1;
+    case 0xE3: addr[0] = cpu->sp; addr[1] = cpu->sp + 1; return 2;      // XTHL
+    case 0xCD: addr[0] = cpu->sp - 1; addr[1] = cpu->sp - 2; return 2;  // CALL
+    }
+    if ((op & 0xF8) == 0x70 && op != 0x76) {                            // MOV M,r
+        addr[0] = cpu8080_get_hl(cpu);
+        return 1;
+    }
+    // PUSH, Ccc (taken or not) and RST
+    if ((op & 0xCF) == 0xC5 || (op & 0xC7) == 0xC4 || (op & 0xC7) == 0xC7) {
+        addr[0] = cpu->sp - 1;
+        addr[1] = cpu->sp - 2;
+        return 2;
+    }
+    return 0;
+}
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "memory.h"
+#include "events.h"
 
 #define FLAG_C  0x01
 #define FLAG_P  0x04
@@ -10,7 +12,104 @@
 #define FLAG_Z  0x40
 #define FLAG_S  0x80
 
+// Instruction dispatch engine, selected at build time:
+//   CPU8080_DISPATCH_SWITCH - decode opcode fields, then one big switch
+//   CPU8080_DISPATCH_TABLE  - 256-entry table of per-opcode handlers
+#define CPU8080_DISPATCH_SWITCH 0
+#define CPU8080_DISPATCH_TABLE  1
+
+#ifndef CPU8080_DISPATCH
+#define CPU8080_DISPATCH CPU8080_DISPATCH_TABLE
+#endif
+
+// Lazy flags: ALU ops only record their result and the Z/S/P/AC bits are
+// folded into f on demand. Always read F through cpu8080_get_f().
+#ifndef CPU8080_LAZY_FLAGS
+#define CPU8080_LAZY_FLAGS 0
+#endif
+
+// Translation cache (table engine only): cpu8080_run() decodes straight-line
+// runs of code once into blocks of micro-ops with their operands already
+// fetched, and re-runs them until a write to one of their pages stales them.
+#ifndef CPU8080_TCACHE
+#define CPU8080_TCACHE (CPU8080_DISPATCH == CPU8080_DISPATCH_TABLE)
+#endif
+
+#ifndef CPU8080_TCACHE_BLOCKS
+#define CPU8080_TCACHE_BLOCKS 256   // cached blocks, power of 2
+#endif
+
+#ifndef CPU8080_TCACHE_UOPS
+#define CPU8080_TCACHE_UOPS 16      // max instructions per block
+#endif
+
+// x86-64 recompiler for host builds (see cpu8080_jit.h), needs the cache
+#ifndef CPU8080_JIT
+#define CPU8080_JIT 0
+#endif
+
+#ifndef CPU8080_JIT_THRESHOLD
+#define CPU8080_JIT_THRESHOLD 64    // block entries before it is compiled
+#endif
+
+// Built-in programs and ROMs translated to C at build time (see
+// cpu8080_aot.h), needs the cache
+#ifndef CPU8080_AOT
+#define CPU8080_AOT 0
+#endif
+
+struct cpu8080;
+struct cpu8080_jit;
+struct cpu8080_block;
+
+// Compiled block: returns the cycles it used. When it leaves early because
+// a write made it stale, it first stores the micro-ops it completed in
+// cpu->block_done.
+typedef uint32_t (*cpu8080_native_t)(struct cpu8080 *cpu);
+
+// Ahead-of-time translated block, same contract as compiled code but told
+// which cache block it runs for, so it can check it is still valid
+typedef uint32_t (*cpu8080_aot_fn_t)(struct cpu8080 *cpu, const struct cpu8080_block *blk);
+
 typedef struct {
+    int (*fn)(struct cpu8080 *cpu, uint16_t imm);
+    uint16_t imm;
+    uint8_t op;         // opcode, for the recompiler
+    uint8_t len;
+    bool writes;        // may store to memory, block is rechecked after it
+} cpu8080_uop_t;
+
+typedef struct cpu8080_block {
+    uint16_t start;     // PC of the first instruction
+    uint16_t end;       // PC after the last instruction
+    uint16_t pending;   // other PC that missed on this slot, replaced on a second miss
+    uint8_t count;      // micro-ops in use, 0 for an empty slot
+    bool loop;          // a loop idiom starts here, run in bulk
+    uint8_t page[2];    // first and last page the code spans
+    uint32_t gen[2];    // bus->code_gen[page] at translation time
+    struct cpu8080_block *link[2];  // last successor reached at end / elsewhere
+#if CPU8080_JIT
+    uint32_t hits;      // entries since translation
+    cpu8080_native_t native;    // compiled block, or NULL
+#endif
+#if CPU8080_AOT
+    cpu8080_aot_fn_t aot;       // translated ahead of time, or NULL
+#endif
+    cpu8080_uop_t uops[CPU8080_TCACHE_UOPS];
+} cpu8080_block_t;
+
+typedef struct {
+    cpu8080_block_t blocks[CPU8080_TCACHE_BLOCKS];
+#if CPU8080_JIT
+    struct cpu8080_jit *jit;    // NULL keeps every block on micro-ops
+#endif
+#if CPU8080_AOT
+    bool aot;           // false ignores the code translated ahead of time
+#endif
+} cpu8080_tcache_t;
+
+typedef struct cpu8080 {
+    bus_t *bus;         // memory this CPU is wired to
     uint8_t a;
     uint8_t f;
     uint8_t b, c;
@@ -20,12 +119,69 @@ typedef struct {
     uint16_t pc;
     bool halted;
     bool inte;
+    uint8_t lazy_res;   // result the pending Z/S/P flags are derived from
+    uint8_t lazy_ac;    // bit 4 holds the pending AC flag
+    bool lazy_pending;
+    uint16_t breakpoint;
+    bool breakpoint_enabled;
+    cpu8080_tcache_t *tcache;   // NULL runs the plain interpreter
+    uint8_t block_done;         // micro-ops compiled code ran, see cpu8080_native_t
+    uint64_t instructions;      // executed since init, for throughput figures
+    uint64_t cycles;            // executed since init, the time stamp I/O devices see
+    uint8_t irq;                // requested RST levels, bit n for RST n
+    uint64_t int_at;            // first cycle EI lets an interrupt in
+    uint64_t attention;         // cycle the run loops stop at for events or an interrupt
+    event_queue_t *events;      // device timing, or NULL
 } cpu8080_t;
 
-void cpu8080_init(cpu8080_t *cpu);
+extern const uint8_t cpu8080_zsp_table[256];
+
+void cpu8080_init(cpu8080_t *cpu, bus_t *bus);
 void cpu8080_reset(cpu8080_t *cpu);
+
+// One instruction. Waiting in HLT, the step is instead the time up to the
+// next event, and the interrupt if that raised one.
 int cpu8080_step(cpu8080_t *cpu);
 
+// Execute instructions until at least cycle_budget cycles have been used,
+// the CPU halts, or PC reaches the breakpoint. The instruction at the
+// starting PC always runs, so a run can resume from a breakpoint.
+// Returns the number of cycles consumed. Both this and cpu8080_step() keep
+// cycles exact at every IN and OUT, and take events and interrupts at the
+// same instruction boundaries. A halted CPU that an event could still wake
+// lets the time pass up to it instead of returning.
+uint32_t cpu8080_run(cpu8080_t *cpu, uint32_t cycle_budget);
+
+// Interrupts: a requested level is taken at the next instruction boundary
+// with interrupts enabled, lowest level first, by running RST n. That clears
+// INTE and the request, and ends HLT. As on the 8080, the instruction after
+// EI always runs before an interrupt is taken.
+void cpu8080_irq_raise(cpu8080_t *cpu, uint8_t level);
+void cpu8080_irq_clear(cpu8080_t *cpu, uint8_t level);
+
+// Device timing: use q for cpu8080_schedule(), which calls fn at the first
+// instruction boundary at or after cycle (on the cpu->cycles clock). The
+// callbacks may raise interrupts and schedule again.
+void cpu8080_attach_events(cpu8080_t *cpu, event_queue_t *q);
+bool cpu8080_schedule(cpu8080_t *cpu, uint64_t cycle, event_fn_t fn, void *ctx);
+void cpu8080_cancel(cpu8080_t *cpu, event_fn_t fn, void *ctx);
+
+// Recompute when the run loops next need to stop, after inte, irq or the
+// event queue were changed other than through the calls above
+void cpu8080_update_attention(cpu8080_t *cpu);
+
+// Addresses the next cpu8080_step() may store to, without running it.
+// Fills up to two entries of addr and returns how many. Events already
+// due are run first, as the step would.
+int cpu8080_next_writes(cpu8080_t *cpu, uint16_t addr[2]);
+
+#if CPU8080_TCACHE
+// Use tc as the translation cache for cpu8080_run() and empty it. Runs with
+// the breakpoint enabled fall back to the interpreter, and a run may end up
+// to one block past cycle_budget.
+void cpu8080_attach_tcache(cpu8080_t *cpu, cpu8080_tcache_t *tc);
+#endif
+
 static inline uint16_t cpu8080_get_bc(cpu8080_t *cpu) { return (cpu->b << 8) | cpu->c; }
 static inline uint16_t cpu8080_get_de(cpu8080_t *cpu) { return (cpu->d << 8) | cpu->e; }
 static inline uint16_t cpu8080_get_hl(cpu8080_t *cpu) { return (cpu->h << 8) | cpu->l; }
@@ -34,4 +190,23 @@ static inline void cpu8080_set_bc(cpu8080_t *cpu, uint16_t v) { cpu->b = v >> 8;
 static inline void cpu8080_set_de(cpu8080_t *cpu, uint16_t v) { cpu->d = v >> 8; cpu->e = v & 0xFF; }
 static inline void cpu8080_set_hl(cpu8080_t *cpu, uint16_t v) { cpu->h = v >> 8; cpu->l = v & 0xFF; }
 
+// Halted with nothing that could end it: running on changes nothing. A
+// CPU halted with interrupts enabled and an event pending is only waiting.
+static inline bool cpu8080_stopped(const cpu8080_t *cpu) {
+    return cpu->halted && !(cpu->inte && cpu->attention != EVENT_NEVER);
+}
+
+static inline bool cpu8080_at_breakpoint(cpu8080_t *cpu) {
+    return cpu->breakpoint_enabled && cpu->pc == cpu->breakpoint;
+}
+
+static inline uint8_t cpu8080_get_f(cpu8080_t *cpu) {
+    if (cpu->lazy_pending) {
+        cpu->f = (cpu->f & ~(FLAG_Z | FLAG_S | FLAG_P | FLAG_AC)) |
+                 cpu8080_zsp_table[cpu->lazy_res] | (cpu->lazy_ac & FLAG_AC);
+        cpu->lazy_pending = false;
+    }
+    return cpu->f;
+}
+
 #endif
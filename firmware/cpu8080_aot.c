@@ -0,0 +1,34 @@
+#include "cpu8080_aot.h"
+#include "memory.h"
+#include <stddef.h>
+
+static const cpu8080_aot_block_t *find_block(const cpu8080_aot_image_t *img, uint16_t pc) {
+    uint32_t lo = 0, hi = img->count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (img->blocks[mid].start < pc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < img->count && img->blocks[lo].start == pc ? &img->blocks[lo] : NULL;
+}
+
+cpu8080_aot_fn_t cpu8080_aot_lookup(bus_t *bus, const cpu8080_block_t *blk) {
+    for (uint32_t i = 0; i < cpu8080_aot_image_count; i++) {
+        const cpu8080_aot_image_t *img = &cpu8080_aot_images[i];
+        if (blk->start < img->base || (uint32_t)(blk->start - img->base) >= img->size) continue;
+
+        const cpu8080_aot_block_t *ab = find_block(img, blk->start);
+        if (!ab || ab->end != blk->end) continue;
+
+        // Only if the code in memory is still the image's
+        const uint8_t *bytes = img->bytes + (blk->start - img->base);
+        uint16_t len = blk->end - blk->start;
+        uint16_t n = 0;
+        while (n < len && memory_read(bus, blk->start + n) == bytes[n]) n++;
+        if (n == len) return ab->fn;
+    }
+    return NULL;
+}
@@ -0,0 +1,49 @@
+#ifndef CPU8080_AOT_H
+#define CPU8080_AOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu8080.h"
+
+// Ahead-of-time translation (CPU8080_AOT=1). At build time aot8080
+// (host/aot8080/) turns the programs in programs.h and any ROM images in
+// CPU8080_AOT_ROMS into C, one function per block cut the way the
+// translation cache cuts them, found by following jumps, calls and RST
+// vectors from the load address. Flags come from the interpreter's own
+// helpers (cpu8080_ops.h), so results and cycles match cpu8080_step().
+//
+// When the cache translates a block that starts where a translated one
+// does and memory still holds the image's bytes there, the block runs the
+// C function instead of micro-ops. Code anywhere else, or bytes that were
+// patched or loaded over, stay on micro-ops. Translated blocks check their
+// pages after every write and leave early when they went stale, like
+// compiled code.
+
+typedef struct {
+    uint16_t start;     // PC of the first instruction
+    uint16_t end;       // PC after the last instruction
+    cpu8080_aot_fn_t fn;
+} cpu8080_aot_block_t;
+
+typedef struct {
+    const char *name;
+    uint16_t base;      // address of bytes[0]
+    uint32_t size;
+    const uint8_t *bytes;
+    const cpu8080_aot_block_t *blocks;  // sorted by start
+    uint32_t count;
+} cpu8080_aot_image_t;
+
+// Defined by the generated file
+extern const cpu8080_aot_image_t cpu8080_aot_images[];
+extern const uint32_t cpu8080_aot_image_count;
+
+// Translated function for the freshly translated blk, or NULL
+cpu8080_aot_fn_t cpu8080_aot_lookup(bus_t *bus, const cpu8080_block_t *blk);
+
+// Run opcode op with its operand imm and PC already past it, for the
+// instructions translated code leaves to the interpreter (HLT, I/O, EI/DI).
+// Returns the cycles used.
+int cpu8080_execute_op(cpu8080_t *cpu, uint8_t op, uint16_t imm);
+
+#endif
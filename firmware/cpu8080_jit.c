@@ -0,0 +1,260 @@
+// MAP_ANONYMOUS is not in strict ISO C mode
+#define _DEFAULT_SOURCE
+
+#include "cpu8080_jit.h"
+#include "memory.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#if !defined(__x86_64__)
+#error "cpu8080_jit.c emits x86-64 code"
+#endif
+
+// Worst case code for one block, checked before compiling
+#define JIT_MAX_BLOCK_BYTES (64 + CPU8080_TCACHE_UOPS * 128)
+
+// Offsets of the 8-bit registers in cpu8080_t, by opcode field (6 = M)
+static const int8_t reg_offset[8] = {
+    offsetof(cpu8080_t, b), offsetof(cpu8080_t, c),
+    offsetof(cpu8080_t, d), offsetof(cpu8080_t, e),
+    offsetof(cpu8080_t, h), offsetof(cpu8080_t, l),
+    -1, offsetof(cpu8080_t, a),
+};
+
+typedef struct {
+    uint8_t *p;
+    uint8_t *exit_fixups[CPU8080_TCACHE_UOPS * 2];
+    uint8_t exit_done[CPU8080_TCACHE_UOPS * 2];     // micro-ops completed at each
+    int num_fixups;
+} emitter_t;
+
+static void emit8(emitter_t *e, uint8_t v) { *e->p++ = v; }
+static void emit16(emitter_t *e, uint16_t v) { memcpy(e->p, &v, 2); e->p += 2; }
+static void emit32(emitter_t *e, uint32_t v) { memcpy(e->p, &v, 4); e->p += 4; }
+static void emit64(emitter_t *e, uint64_t v) { memcpy(e->p, &v, 8); e->p += 8; }
+
+static void emit_bytes(emitter_t *e, const uint8_t *bytes, int n) {
+    memcpy(e->p, bytes, n);
+    e->p += n;
+}
+
+// mov byte [rbx+off], imm8
+static void emit_store8_imm(emitter_t *e, int off, uint8_t v) {
+    emit8(e, 0xC6); emit8(e, 0x83); emit32(e, off); emit8(e, v);
+}
+
+// mov word [rbx+off], imm16
+static void emit_store16_imm(emitter_t *e, int off, uint16_t v) {
+    emit8(e, 0x66); emit8(e, 0xC7); emit8(e, 0x83); emit32(e, off); emit16(e, v);
+}
+
+// add r12d, imm32 (r12d holds the cycle count)
+static void emit_add_cycles(emitter_t *e, uint32_t n) {
+    if (n == 0) return;
+    emit8(e, 0x41); emit8(e, 0x81); emit8(e, 0xC4); emit32(e, n);
+}
+
+// mov rdi, rbx; mov esi, imm; mov rax, fn; call rax; add r12d, eax
+static void emit_call_handler(emitter_t *e, const cpu8080_uop_t *u) {
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xDF);
+    emit8(e, 0xBE); emit32(e, u->imm);
+    emit8(e, 0x48); emit8(e, 0xB8); emit64(e, (uint64_t)(uintptr_t)u->fn);
+    emit8(e, 0xFF); emit8(e, 0xD0);
+    emit8(e, 0x41); emit8(e, 0x01); emit8(e, 0xC4);
+}
+
+// Leave the block, done micro-ops in, if the page's generation moved:
+// mov rax, &gen; cmp dword [rax], imm32; jne exit
+static void emit_gen_check(emitter_t *e, const uint32_t *gen, uint32_t expected, int done) {
+    emit8(e, 0x48); emit8(e, 0xB8); emit64(e, (uint64_t)(uintptr_t)gen);
+    emit8(e, 0x81); emit8(e, 0x38); emit32(e, expected);
+    emit8(e, 0x0F); emit8(e, 0x85);
+    e->exit_done[e->num_fixups] = done;
+    e->exit_fixups[e->num_fixups++] = e->p;
+    emit32(e, 0);
+}
+
+// Emit u inline if it is simple enough. Returns its cycle count, or 0 if
+// the handler has to be called.
+static int emit_inline(emitter_t *e, const cpu8080_uop_t *u) {
+    uint8_t op = u->op;
+
+    if (op == 0x00) {                                   // NOP
+        return 4;
+    }
+    if (op >= 0x40 && op < 0x80 && op != 0x76) {        // MOV r,r'
+        int dst = reg_offset[(op >> 3) & 7];
+        int src = reg_offset[op & 7];
+        if (dst < 0 || src < 0) return 0;
+        // movzx eax, byte [rbx+src]; mov [rbx+dst], al
+        emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0x83); emit32(e, src);
+        emit8(e, 0x88); emit8(e, 0x83); emit32(e, dst);
+        return 5;
+    }
+    if ((op & 0xC7) == 0x06) {                          // MVI r
+        int dst = reg_offset[(op >> 3) & 7];
+        if (dst < 0) return 0;
+        emit_store8_imm(e, dst, (uint8_t)u->imm);
+        return 7;
+    }
+    if ((op & 0xCF) == 0x01) {                          // LXI rp
+        if (op == 0x31) {
+            emit_store16_imm(e, offsetof(cpu8080_t, sp), u->imm);
+        } else {
+            int hi = reg_offset[(op >> 3) & 6];
+            emit_store8_imm(e, hi, u->imm >> 8);
+            emit_store8_imm(e, hi + 1, u->imm & 0xFF);
+        }
+        return 10;
+    }
+    if (op == 0xEB) {                                   // XCHG
+        int de = offsetof(cpu8080_t, d);
+        int hl = offsetof(cpu8080_t, h);
+        // movzx eax, word [de]; movzx ecx, word [hl]; swap them back
+        emit8(e, 0x0F); emit8(e, 0xB7); emit8(e, 0x83); emit32(e, de);
+        emit8(e, 0x0F); emit8(e, 0xB7); emit8(e, 0x8B); emit32(e, hl);
+        emit8(e, 0x66); emit8(e, 0x89); emit8(e, 0x8B); emit32(e, de);
+        emit8(e, 0x66); emit8(e, 0x89); emit8(e, 0x83); emit32(e, hl);
+        return 4;
+    }
+    if (op == 0xC3) {                                   // JMP
+        emit_store16_imm(e, offsetof(cpu8080_t, pc), u->imm);
+        return 10;
+    }
+    return 0;
+}
+
+bool cpu8080_jit_init(cpu8080_jit_t *jit, size_t arena_size) {
+    void *code = mmap(NULL, arena_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code != MAP_FAILED && mprotect(code, arena_size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, arena_size);
+        code = MAP_FAILED;
+    }
+    jit->code = code == MAP_FAILED ? NULL : (uint8_t *)code;
+    jit->size = jit->code ? arena_size : 0;
+    jit->used = 0;
+    jit->compiled = 0;
+    jit->flushes = 0;
+    return jit->code != NULL;
+}
+
+void cpu8080_jit_free(cpu8080_jit_t *jit) {
+    if (jit->code) munmap(jit->code, jit->size);
+    jit->code = NULL;
+    jit->size = jit->used = 0;
+}
+
+void cpu8080_attach_jit(cpu8080_t *cpu, cpu8080_jit_t *jit) {
+    cpu->tcache->jit = jit->code ? jit : NULL;
+}
+
+// Switch the pages holding [start, start + len) between writable and
+// executable, never both
+static bool protect(cpu8080_jit_t *jit, uint8_t *start, size_t len, bool writable) {
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t lo = (uintptr_t)start & ~(page - 1);
+    uintptr_t hi = ((uintptr_t)start + len + page - 1) & ~(page - 1);
+    uintptr_t end = (uintptr_t)(jit->code + jit->size);
+    if (hi > end) hi = end;
+    return mprotect((void *)lo, hi - lo, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+}
+
+static void flush(cpu8080_jit_t *jit, cpu8080_tcache_t *tc) {
+    for (int i = 0; i < CPU8080_TCACHE_BLOCKS; i++) {
+        tc->blocks[i].native = NULL;
+        tc->blocks[i].hits = 0;
+    }
+    jit->used = 0;
+    jit->flushes++;
+}
+
+cpu8080_native_t cpu8080_jit_compile(cpu8080_jit_t *jit, cpu8080_tcache_t *tc,
+                                     cpu8080_t *cpu, const cpu8080_block_t *blk) {
+    static const uint8_t prologue[] = {
+        0x53,                       // push rbx
+        0x41, 0x54,                 // push r12
+        0x48, 0x83, 0xEC, 0x08,     // sub rsp, 8 (keep calls 16-byte aligned)
+        0x48, 0x89, 0xFB,           // mov rbx, rdi
+        0x45, 0x31, 0xE4,           // xor r12d, r12d
+    };
+    static const uint8_t epilogue[] = {
+        0x44, 0x89, 0xE0,           // mov eax, r12d
+        0x48, 0x83, 0xC4, 0x08,     // add rsp, 8
+        0x41, 0x5C,                 // pop r12
+        0x5B,                       // pop rbx
+        0xC3,                       // ret
+    };
+    const cpu8080_uop_t *last = &blk->uops[blk->count - 1];
+
+    // I/O stays with the interpreter
+    if (last->op == 0xDB || last->op == 0xD3) return NULL;
+
+    if (jit->size - jit->used < JIT_MAX_BLOCK_BYTES) {
+        flush(jit, tc);
+    }
+
+    emitter_t e;
+    uint8_t *start = jit->code + jit->used;
+    if (!protect(jit, start, JIT_MAX_BLOCK_BYTES, true)) return NULL;
+    e.p = start;
+    e.num_fixups = 0;
+    emit_bytes(&e, prologue, sizeof(prologue));
+
+    uint16_t pc = blk->start;
+    uint32_t pending_cycles = 0;
+    bool pc_stored = true;
+
+    for (int i = 0; i < blk->count; i++) {
+        const cpu8080_uop_t *u = &blk->uops[i];
+        pc += u->len;
+
+        int cycles = emit_inline(&e, u);
+        if (cycles) {
+            pending_cycles += cycles;
+            pc_stored = u->op == 0xC3;
+            continue;
+        }
+
+        // Handlers expect PC past the instruction
+        emit_store16_imm(&e, offsetof(cpu8080_t, pc), pc);
+        emit_call_handler(&e, u);
+        pc_stored = true;
+
+        if (u->writes) {
+            emit_add_cycles(&e, pending_cycles);
+            pending_cycles = 0;
+            emit_gen_check(&e, &cpu->bus->code_gen[blk->page[0]], blk->gen[0], i + 1);
+            if (blk->page[1] != blk->page[0]) {
+                emit_gen_check(&e, &cpu->bus->code_gen[blk->page[1]], blk->gen[1], i + 1);
+            }
+        }
+    }
+    if (!pc_stored) {
+        emit_store16_imm(&e, offsetof(cpu8080_t, pc), pc);
+    }
+    emit_add_cycles(&e, pending_cycles);
+
+    uint8_t *exit = e.p;
+    emit_bytes(&e, epilogue, sizeof(epilogue));
+    // Early exits record how far they got, then share the epilogue:
+    // mov byte [rbx+block_done], imm8; jmp exit
+    for (int i = 0; i < e.num_fixups; i++) {
+        int32_t rel = (int32_t)(e.p - (e.exit_fixups[i] + 4));
+        memcpy(e.exit_fixups[i], &rel, 4);
+        emit_store8_imm(&e, offsetof(cpu8080_t, block_done), e.exit_done[i]);
+        emit8(&e, 0xE9);
+        emit32(&e, (uint32_t)(int32_t)(exit - (e.p + 4)));
+    }
+
+    if (!protect(jit, start, e.p - start, false)) {
+        // Still writable, so nothing may run from it. Give up on the JIT.
+        flush(jit, tc);
+        tc->jit = NULL;
+        return NULL;
+    }
+    jit->used += e.p - start;
+    jit->compiled++;
+    return (cpu8080_native_t)(void *)start;
+}
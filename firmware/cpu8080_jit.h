@@ -0,0 +1,47 @@
+#ifndef CPU8080_JIT_H
+#define CPU8080_JIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cpu8080.h"
+
+// x86-64 backend for the translation cache, for host builds (CPU8080_JIT=1).
+// Blocks entered CPU8080_JIT_THRESHOLD times are compiled into an mmap'd
+// arena: simple register moves and jumps are emitted inline and everything
+// else calls the same handlers the micro-ops use, so results and cycle
+// counts match cpu8080_step() exactly. Blocks ending in IN/OUT stay on
+// micro-ops, and a block that writes to its own pages drops back to them.
+//
+// The arena is never writable and executable at once: it is mapped
+// read-execute, and the pages a block goes into are made writable only
+// while it is emitted.
+//
+// Compiled code has the CPU's bus address baked in, so a JIT serves the one
+// CPU it was attached to.
+
+#define CPU8080_JIT_DEFAULT_ARENA (4u << 20)
+
+typedef struct cpu8080_jit {
+    uint8_t *code;      // executable arena
+    size_t size;
+    size_t used;
+    uint32_t compiled;  // blocks compiled since init
+    uint32_t flushes;   // times the arena filled up and was emptied
+} cpu8080_jit_t;
+
+// Map an arena of arena_size bytes. Returns false if the host refuses
+// executable memory; the CPU then keeps running micro-ops, as it does if
+// the arena's protection can't be switched later.
+bool cpu8080_jit_init(cpu8080_jit_t *jit, size_t arena_size);
+void cpu8080_jit_free(cpu8080_jit_t *jit);
+
+// Compile hot blocks of cpu's translation cache with jit
+void cpu8080_attach_jit(cpu8080_t *cpu, cpu8080_jit_t *jit);
+
+// Compile blk, emptying the arena (and every block compiled into it) first
+// if it is full. Returns NULL for blocks that must stay on micro-ops.
+cpu8080_native_t cpu8080_jit_compile(cpu8080_jit_t *jit, cpu8080_tcache_t *tc,
+                                     cpu8080_t *cpu, const cpu8080_block_t *blk);
+
+#endif
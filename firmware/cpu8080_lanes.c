@@ -0,0 +1,647 @@
+#include "cpu8080_lanes.h"
+
+#if CPU8080_LANES
+
+#include <string.h>
+
+#define LANES CPU8080_LANES
+#define CHUNK 8
+
+#if LANES % CHUNK
+#error "CPU8080_LANES must be a multiple of 8"
+#endif
+
+// One 16-bit element per lane for everything, 8-bit registers included:
+// plain SSE2 has all the 16-bit operations needed, while mixing element
+// widths makes the compiler convert between them an element at a time.
+// Masks are all ones or all zeros per lane.
+typedef uint16_t vec __attribute__((vector_size(LANES * 2)));
+
+// Comparisons go through 128-bit chunks, as the compiler only splits
+// arithmetic on vectors wider than the hardware's, not comparisons
+typedef uint16_t chunk __attribute__((vector_size(CHUNK * 2)));
+typedef int16_t schunk __attribute__((vector_size(CHUNK * 2)));
+
+// Register file index, as in the opcode fields. 6 (M) is unused.
+#define RB 0
+#define RC 1
+#define RD 2
+#define RE 3
+#define RH 4
+#define RL 5
+#define RA 7
+
+#define FLAGS_ZSPAC (FLAG_Z | FLAG_S | FLAG_P | FLAG_AC)
+#define FLAGS_ALL   (FLAGS_ZSPAC | FLAG_C)
+
+// Per-lane cycle and instruction counts build up in 16-bit elements and
+// are added to the 64-bit totals every this many steps, before they can
+// wrap (an instruction takes at most 18 cycles)
+#define FLUSH_STEPS 2048
+
+static inline vec eq(vec x, vec y) {
+    chunk cx[LANES / CHUNK], cy[LANES / CHUNK];
+    vec r;
+    memcpy(cx, &x, sizeof(cx));
+    memcpy(cy, &y, sizeof(cy));
+    for (int k = 0; k < LANES / CHUNK; k++) {
+        cx[k] = (chunk)(cx[k] == cy[k]);
+    }
+    memcpy(&r, cx, sizeof(r));
+    return r;
+}
+
+// Signed, so only for elements below 0x8000
+static inline vec gt(vec x, vec y) {
+    schunk cx[LANES / CHUNK], cy[LANES / CHUNK];
+    vec r;
+    memcpy(cx, &x, sizeof(cx));
+    memcpy(cy, &y, sizeof(cy));
+    for (int k = 0; k < LANES / CHUNK; k++) {
+        cx[k] = cx[k] > cy[k];
+    }
+    memcpy(&r, cx, sizeof(r));
+    return r;
+}
+
+// True if every lane of mask m is set
+static inline bool all(vec m) {
+    uint64_t w[LANES / 4], r = ~(uint64_t)0;
+    memcpy(w, &m, sizeof(w));
+    for (int k = 0; k < LANES / 4; k++) {
+        r &= w[k];
+    }
+    return r == ~(uint64_t)0;
+}
+
+static inline vec splat(uint16_t x) {
+    vec v = { 0 };
+    return v + x;
+}
+
+static inline vec sel(vec m, vec y, vec x) { return (y & m) | (x & ~m); }
+static inline vec hi(vec x) { return x >> 8; }
+static inline vec lo(vec x) { return x & 0xFF; }
+static inline vec pair(vec h, vec l) { return (h << 8) | l; }
+
+// Per-lane gather and masked scatter, each lane in its own 64K. Lanes go
+// through plain arrays: building a vector an element at a time is far
+// slower without SSE4.1 inserts.
+static inline vec load8(const uint8_t *ram, vec addr) {
+    uint16_t a[LANES], r[LANES];
+    vec v;
+    memcpy(a, &addr, sizeof(a));
+    for (int i = 0; i < LANES; i++) {
+        r[i] = ram[(uint32_t)i * CPU8080_LANE_STRIDE + a[i]];
+    }
+    memcpy(&v, r, sizeof(v));
+    return v;
+}
+
+static inline vec load16(const uint8_t *ram, vec addr) {
+    uint16_t a[LANES], r[LANES];
+    vec v;
+    memcpy(a, &addr, sizeof(a));
+    for (int i = 0; i < LANES; i++) {
+        const uint8_t *lane = ram + (uint32_t)i * CPU8080_LANE_STRIDE;
+        r[i] = lane[a[i]] | (lane[(uint16_t)(a[i] + 1)] << 8);
+    }
+    memcpy(&v, r, sizeof(v));
+    return v;
+}
+
+// Low byte of v to addr in the lanes of m
+static inline void store8(uint8_t *ram, vec m, vec addr, vec v) {
+    uint16_t a[LANES], mm[LANES], vv[LANES];
+    memcpy(a, &addr, sizeof(a));
+    memcpy(mm, &m, sizeof(mm));
+    memcpy(vv, &v, sizeof(vv));
+    for (int i = 0; i < LANES; i++) {
+        if (mm[i]) ram[(uint32_t)i * CPU8080_LANE_STRIDE + a[i]] = (uint8_t)vv[i];
+    }
+}
+
+// Low byte first, like memory_write_word()
+static inline void store16(uint8_t *ram, vec m, vec addr, vec v) {
+    uint16_t a[LANES], mm[LANES], vv[LANES];
+    memcpy(a, &addr, sizeof(a));
+    memcpy(mm, &m, sizeof(mm));
+    memcpy(vv, &v, sizeof(vv));
+    for (int i = 0; i < LANES; i++) {
+        if (mm[i]) {
+            uint8_t *lane = ram + (uint32_t)i * CPU8080_LANE_STRIDE;
+            lane[a[i]] = (uint8_t)vv[i];
+            lane[(uint16_t)(a[i] + 1)] = vv[i] >> 8;
+        }
+    }
+}
+
+// Z, S and P of an 8-bit result
+static inline vec zsp(vec res) {
+    vec p = res ^ (res >> 4);
+    p ^= p >> 2;
+    p ^= p >> 1;
+    return (eq(res, splat(0)) & FLAG_Z) | (res & FLAG_S) | ((~p & 1) << 2);
+}
+
+// New F for the 8-bit result in the low byte of res, AC from bit 4 of ac,
+// C from bit 0 of cy
+static inline vec flags(vec f, vec res, vec ac, vec cy) {
+    return (f & (uint8_t)~FLAGS_ALL) | zsp(lo(res)) | (ac & FLAG_AC) | (cy & FLAG_C);
+}
+
+// ADD ADC SUB SBB ANA XRA ORA CMP, as in cpu8080_step()
+static inline void alu(int fn, vec *a, vec *f, vec v, vec m) {
+    vec x = *a, cy = *f & FLAG_C, zero = x ^ x, res, nf;
+    switch (fn) {
+        case 0:
+        case 1:
+            res = x + v + (fn == 1 ? cy : zero);
+            nf = flags(*f, res, x ^ v ^ res, res >> 8);
+            break;
+        case 2:
+        case 3:
+        case 7:
+            res = x - v - (fn == 3 ? cy : zero);
+            nf = flags(*f, res, x ^ v ^ res, res >> 8);
+            res = fn == 7 ? x : lo(res);
+            break;
+        case 4:
+            res = x & v;
+            nf = flags(*f, res, zero + FLAG_AC, zero);
+            break;
+        case 5:
+            res = x ^ v;
+            nf = flags(*f, res, zero, zero);
+            break;
+        default:
+            res = x | v;
+            nf = flags(*f, res, zero, zero);
+            break;
+    }
+    *a = sel(m, lo(res), x);
+    *f = sel(m, nf, *f);
+}
+
+// Condition cc of Jcc/Ccc/Rcc per lane
+static inline vec condition(int cc, vec f) {
+    static const uint8_t bit[4] = { FLAG_Z, FLAG_C, FLAG_P, FLAG_S };
+    vec clear = eq(f & bit[cc >> 1], splat(0));
+    return (cc & 1) ? ~clear : clear;
+}
+
+// Instruction lengths. CB, D9, DD, ED and FD are one byte NOPs, as in
+// cpu8080_step().
+static const uint8_t op_len[256] = {
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1,
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1,
+    1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 1, 2, 1,
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,
+};
+
+void cpu8080_lanes_init(cpu8080_lanes_t *lanes, uint8_t *ram) {
+    memset(lanes, 0, sizeof(*lanes));
+    lanes->ram = ram;
+}
+
+void cpu8080_lane_get(const cpu8080_lanes_t *lanes, int lane, cpu8080_t *cpu) {
+    cpu->a = lanes->a[lane];
+    cpu->f = lanes->f[lane];
+    cpu->lazy_pending = false;
+    cpu->b = lanes->b[lane];
+    cpu->c = lanes->c[lane];
+    cpu->d = lanes->d[lane];
+    cpu->e = lanes->e[lane];
+    cpu->h = lanes->h[lane];
+    cpu->l = lanes->l[lane];
+    cpu->sp = lanes->sp[lane];
+    cpu->pc = lanes->pc[lane];
+    cpu->halted = lanes->halted[lane];
+    cpu->inte = lanes->inte[lane];
+}
+
+void cpu8080_lane_set(cpu8080_lanes_t *lanes, int lane, cpu8080_t *cpu) {
+    lanes->a[lane] = cpu->a;
+    lanes->f[lane] = cpu8080_get_f(cpu);
+    lanes->b[lane] = cpu->b;
+    lanes->c[lane] = cpu->c;
+    lanes->d[lane] = cpu->d;
+    lanes->e[lane] = cpu->e;
+    lanes->h[lane] = cpu->h;
+    lanes->l[lane] = cpu->l;
+    lanes->sp[lane] = cpu->sp;
+    lanes->pc[lane] = cpu->pc;
+    lanes->halted[lane] = cpu->halted;
+    lanes->inte[lane] = cpu->inte;
+}
+
+static inline vec widen(const uint8_t *v) {
+    uint16_t w[LANES];
+    vec r;
+    for (int i = 0; i < LANES; i++) {
+        w[i] = v[i];
+    }
+    memcpy(&r, w, sizeof(r));
+    return r;
+}
+
+static inline void narrow(uint8_t *v, vec x) {
+    uint16_t w[LANES];
+    memcpy(w, &x, sizeof(w));
+    for (int i = 0; i < LANES; i++) {
+        v[i] = (uint8_t)w[i];
+    }
+}
+
+static inline vec widen_bool(const bool *v) {
+    uint16_t w[LANES];
+    vec r;
+    for (int i = 0; i < LANES; i++) {
+        w[i] = v[i] ? 0xFFFF : 0;
+    }
+    memcpy(&r, w, sizeof(r));
+    return r;
+}
+
+static inline void narrow_bool(bool *v, vec x) {
+    uint16_t w[LANES];
+    memcpy(w, &x, sizeof(w));
+    for (int i = 0; i < LANES; i++) {
+        v[i] = w[i] != 0;
+    }
+}
+
+void cpu8080_lanes_run(cpu8080_lanes_t *lanes, uint32_t cycle_budget) {
+    uint8_t *ram = lanes->ram;
+    vec r[8], f, sp, pc, halted, inte, spent;
+    uint64_t used[LANES] = { 0 };   // cycles this call, as of the last flush
+    vec cycles, insns;              // since the last flush
+    uint32_t bound = 0;             // no running lane has used more cycles
+    int flush = FLUSH_STEPS;
+    uint64_t issues = 0;
+
+    r[RB] = widen(lanes->b);
+    r[RC] = widen(lanes->c);
+    r[RD] = widen(lanes->d);
+    r[RE] = widen(lanes->e);
+    r[RH] = widen(lanes->h);
+    r[RL] = widen(lanes->l);
+    r[RA] = widen(lanes->a);
+    r[6] = r[RA] ^ r[RA];
+    f = widen(lanes->f);
+    memcpy(&sp, lanes->sp, sizeof(sp));
+    memcpy(&pc, lanes->pc, sizeof(pc));
+    halted = widen_bool(lanes->halted);
+    inte = widen_bool(lanes->inte);
+    spent = cycles = insns = f ^ f;     // spent: lanes out of budget
+
+    for (;;) {
+        // Exact per-lane budget check, only once some lane may be near it
+        if (--flush == 0 || bound >= cycle_budget) {
+            uint16_t c[LANES], n[LANES], s[LANES];
+            memcpy(c, &cycles, sizeof(c));
+            memcpy(n, &insns, sizeof(n));
+            bound = 0;
+            for (int i = 0; i < LANES; i++) {
+                used[i] += c[i];
+                lanes->instructions[i] += n[i];
+                s[i] = used[i] >= cycle_budget ? 0xFFFF : 0;
+                if (!s[i] && used[i] > bound) bound = (uint32_t)used[i];
+            }
+            memcpy(&spent, s, sizeof(spent));
+            cycles = insns = f ^ f;
+            flush = FLUSH_STEPS;
+        }
+
+        // Lowest PC first, so lanes that left a loop wait for the rest.
+        // Usually every lane runs and they are all at the same PC.
+        vec active = ~(halted | spent);
+        uint16_t pcs[LANES];
+        memcpy(pcs, &pc, sizeof(pcs));
+        int lead = 0;
+        uint16_t lead_pc = pcs[0];
+        if (!all(active & eq(pc, splat(lead_pc)))) {
+            uint16_t act[LANES];
+            memcpy(act, &active, sizeof(act));
+            lead = -1;
+            for (int i = 0; i < LANES; i++) {
+                if (act[i] && (lead < 0 || pcs[i] < lead_pc)) {
+                    lead = i;
+                    lead_pc = pcs[i];
+                }
+            }
+            if (lead < 0) break;
+        }
+
+        vec ops = load8(ram, pc);
+        uint8_t op = ram[(uint32_t)lead * CPU8080_LANE_STRIDE + lead_pc];
+        vec m = active & eq(pc, splat(lead_pc)) & eq(ops, splat(op));
+
+        int len = op_len[op];
+        vec imm = ops ^ ops;
+        if (len == 2) {
+            imm = load8(ram, pc + 1);
+        } else if (len == 3) {
+            imm = load16(ram, pc + 1);
+        }
+        pc = sel(m, pc + (uint16_t)len, pc);
+
+        uint16_t cost = 4;      // cycles, unless cost_taken is set
+        uint16_t cost_taken = 0, cost_not = 0;
+        vec taken = m;
+        int d = (op >> 3) & 7, s = op & 7;
+
+        switch (op >> 6) {
+            case 0:
+                switch (s) {
+                    case 0:         // NOP
+                        break;
+                    case 1: {       // LXI rp / DAD rp
+                        int rp = d >> 1;
+                        if (!(d & 1)) {
+                            if (rp == 3) {
+                                sp = sel(m, imm, sp);
+                            } else {
+                                r[rp * 2] = sel(m, hi(imm), r[rp * 2]);
+                                r[rp * 2 + 1] = sel(m, lo(imm), r[rp * 2 + 1]);
+                            }
+                        } else {
+                            vec hl = pair(r[RH], r[RL]);
+                            vec v = rp == 3 ? sp : pair(r[rp * 2], r[rp * 2 + 1]);
+                            vec sum = hl + v;
+                            vec carry = ((hl & v) | ((hl | v) & ~sum)) >> 15;
+                            r[RH] = sel(m, hi(sum), r[RH]);
+                            r[RL] = sel(m, lo(sum), r[RL]);
+                            f = sel(m, (f & (uint8_t)~FLAG_C) | carry, f);
+                        }
+                        cost = 10;
+                        break;
+                    }
+                    case 2:         // STAX LDAX SHLD LHLD STA LDA
+                        switch (d) {
+                            case 0: store8(ram, m, pair(r[RB], r[RC]), r[RA]); cost = 7; break;
+                            case 1: r[RA] = sel(m, load8(ram, pair(r[RB], r[RC])), r[RA]); cost = 7; break;
+                            case 2: store8(ram, m, pair(r[RD], r[RE]), r[RA]); cost = 7; break;
+                            case 3: r[RA] = sel(m, load8(ram, pair(r[RD], r[RE])), r[RA]); cost = 7; break;
+                            case 4: store16(ram, m, imm, pair(r[RH], r[RL])); cost = 16; break;
+                            case 5: {
+                                vec v = load16(ram, imm);
+                                r[RH] = sel(m, hi(v), r[RH]);
+                                r[RL] = sel(m, lo(v), r[RL]);
+                                cost = 16;
+                                break;
+                            }
+                            case 6: store8(ram, m, imm, r[RA]); cost = 13; break;
+                            default: r[RA] = sel(m, load8(ram, imm), r[RA]); cost = 13; break;
+                        }
+                        break;
+                    case 3: {       // INX rp / DCX rp
+                        int rp = d >> 1;
+                        uint16_t step = (d & 1) ? 0xFFFF : 1;
+                        if (rp == 3) {
+                            sp = sel(m, sp + step, sp);
+                        } else {
+                            vec v = pair(r[rp * 2], r[rp * 2 + 1]) + step;
+                            r[rp * 2] = sel(m, hi(v), r[rp * 2]);
+                            r[rp * 2 + 1] = sel(m, lo(v), r[rp * 2 + 1]);
+                        }
+                        cost = 5;
+                        break;
+                    }
+                    case 4:         // INR
+                    case 5: {       // DCR
+                        vec hl = pair(r[RH], r[RL]);
+                        vec v = d == 6 ? load8(ram, hl) : r[d];
+                        vec res = lo(s == 4 ? v + 1 : v - 1);
+                        vec nf = (f & (uint8_t)~FLAGS_ZSPAC) | zsp(res) | ((v ^ res) & FLAG_AC);
+                        f = sel(m, nf, f);
+                        if (d == 6) {
+                            store8(ram, m, hl, res);
+                            cost = 10;
+                        } else {
+                            r[d] = sel(m, res, r[d]);
+                            cost = 5;
+                        }
+                        break;
+                    }
+                    case 6:         // MVI
+                        if (d == 6) {
+                            store8(ram, m, pair(r[RH], r[RL]), imm);
+                            cost = 10;
+                        } else {
+                            r[d] = sel(m, imm, r[d]);
+                            cost = 7;
+                        }
+                        break;
+                    default: {      // RLC RRC RAL RAR DAA CMA STC CMC
+                        vec a = r[RA], cy = f & FLAG_C, na = a, nf = f;
+                        switch (d) {
+                            case 0: na = lo((a << 1) | (a >> 7)); nf = (f & (uint8_t)~FLAG_C) | (a >> 7); break;
+                            case 1: na = (a >> 1) | lo(a << 7); nf = (f & (uint8_t)~FLAG_C) | (a & 1); break;
+                            case 2: na = lo((a << 1) | cy); nf = (f & (uint8_t)~FLAG_C) | (a >> 7); break;
+                            case 3: na = (a >> 1) | (cy << 7); nf = (f & (uint8_t)~FLAG_C) | (a & 1); break;
+                            case 4: {
+                                vec low = ~eq(f & FLAG_AC, splat(0)) | gt(a & 0x0F, splat(9));
+                                vec high = ~eq(cy, splat(0)) | gt(a, splat(0x99));
+                                vec add = (low & 0x06) | (high & 0x60);
+                                vec sum = a + add;
+                                na = lo(sum);
+                                nf = flags(f, sum, a ^ add ^ sum, sum >> 8) | (high & FLAG_C);
+                                break;
+                            }
+                            case 5: na = lo(~a); break;
+                            case 6: nf = f | FLAG_C; break;
+                            default: nf = f ^ FLAG_C; break;
+                        }
+                        r[RA] = sel(m, na, a);
+                        f = sel(m, nf, f);
+                        break;
+                    }
+                }
+                break;
+
+            case 1:                 // MOV / HLT
+                if (op == 0x76) {
+                    halted |= m;
+                    cost = 7;
+                } else if (s == 6) {
+                    r[d] = sel(m, load8(ram, pair(r[RH], r[RL])), r[d]);
+                    cost = 7;
+                } else if (d == 6) {
+                    store8(ram, m, pair(r[RH], r[RL]), r[s]);
+                    cost = 7;
+                } else {
+                    r[d] = sel(m, r[s], r[d]);
+                    cost = 5;
+                }
+                break;
+
+            case 2:                 // ALU r / M
+                if (s == 6) {
+                    alu(d, &r[RA], &f, load8(ram, pair(r[RH], r[RL])), m);
+                    cost = 7;
+                } else {
+                    alu(d, &r[RA], &f, r[s], m);
+                }
+                break;
+
+            default:
+                switch (s) {
+                    case 0:         // Rcc
+                        taken = m & condition(d, f);
+                        pc = sel(taken, load16(ram, sp), pc);
+                        sp = sel(taken, sp + 2, sp);
+                        cost_taken = 11;
+                        cost_not = 5;
+                        break;
+                    case 1:
+                        if (!(d & 1)) {         // POP rp / POP PSW
+                            vec v = load16(ram, sp);
+                            int rp = d >> 1;
+                            if (rp == 3) {
+                                f = sel(m, (lo(v) & 0xD7) | 0x02, f);
+                                r[RA] = sel(m, hi(v), r[RA]);
+                            } else {
+                                r[rp * 2] = sel(m, hi(v), r[rp * 2]);
+                                r[rp * 2 + 1] = sel(m, lo(v), r[rp * 2 + 1]);
+                            }
+                            sp = sel(m, sp + 2, sp);
+                            cost = 10;
+                        } else if (d == 1) {    // RET
+                            pc = sel(m, load16(ram, sp), pc);
+                            sp = sel(m, sp + 2, sp);
+                            cost = 10;
+                        } else if (d == 3) {    // D9: NOP
+                        } else if (d == 5) {    // PCHL
+                            pc = sel(m, pair(r[RH], r[RL]), pc);
+                            cost = 5;
+                        } else {                // SPHL
+                            sp = sel(m, pair(r[RH], r[RL]), sp);
+                            cost = 5;
+                        }
+                        break;
+                    case 2:         // Jcc
+                        pc = sel(m & condition(d, f), imm, pc);
+                        cost = 10;
+                        break;
+                    case 3:
+                        switch (d) {
+                            case 0:             // JMP
+                                pc = sel(m, imm, pc);
+                                cost = 10;
+                                break;
+                            case 1:             // CB: NOP
+                                break;
+                            case 2:             // OUT, no devices
+                                cost = 10;
+                                break;
+                            case 3:             // IN, an empty port reads 0xFF
+                                r[RA] = sel(m, splat(0xFF), r[RA]);
+                                cost = 10;
+                                break;
+                            case 4: {           // XTHL
+                                vec v = load16(ram, sp);
+                                store16(ram, m, sp, pair(r[RH], r[RL]));
+                                r[RH] = sel(m, hi(v), r[RH]);
+                                r[RL] = sel(m, lo(v), r[RL]);
+                                cost = 18;
+                                break;
+                            }
+                            case 5: {           // XCHG
+                                vec h = r[RH], l = r[RL];
+                                r[RH] = sel(m, r[RD], h);
+                                r[RL] = sel(m, r[RE], l);
+                                r[RD] = sel(m, h, r[RD]);
+                                r[RE] = sel(m, l, r[RE]);
+                                break;
+                            }
+                            case 6:             // DI
+                                inte &= ~m;
+                                break;
+                            default:            // EI
+                                inte |= m;
+                                break;
+                        }
+                        break;
+                    case 4:         // Ccc
+                        taken = m & condition(d, f);
+                        sp = sel(taken, sp - 2, sp);
+                        store16(ram, taken, sp, pc);
+                        pc = sel(taken, imm, pc);
+                        cost_taken = 17;
+                        cost_not = 11;
+                        break;
+                    case 5:
+                        if (d == 1) {           // CALL
+                            sp = sel(m, sp - 2, sp);
+                            store16(ram, m, sp, pc);
+                            pc = sel(m, imm, pc);
+                            cost = 17;
+                        } else if (!(d & 1)) {  // PUSH rp / PUSH PSW
+                            int rp = d >> 1;
+                            vec v = rp == 3 ? pair(r[RA], f | 0x02) : pair(r[rp * 2], r[rp * 2 + 1]);
+                            sp = sel(m, sp - 2, sp);
+                            store16(ram, m, sp, v);
+                            cost = 11;
+                        }
+                        break;                  // DD ED FD: NOP
+                    case 6:         // ALU immediate
+                        alu(d, &r[RA], &f, imm, m);
+                        cost = 7;
+                        break;
+                    default:        // RST
+                        sp = sel(m, sp - 2, sp);
+                        store16(ram, m, sp, pc);
+                        pc = sel(m, (pc ^ pc) + (uint16_t)(op & 0x38), pc);
+                        cost = 11;
+                        break;
+                }
+                break;
+        }
+
+        if (cost_taken) {
+            cycles += (taken & cost_taken) | (m & ~taken & cost_not);
+            bound += cost_taken;
+        } else {
+            cycles += m & cost;
+            bound += cost;
+        }
+        insns -= m;
+        issues++;
+    }
+
+    uint16_t c[LANES], n[LANES];
+    memcpy(c, &cycles, sizeof(c));
+    memcpy(n, &insns, sizeof(n));
+    for (int i = 0; i < LANES; i++) {
+        lanes->cycles[i] += used[i] + c[i];
+        lanes->instructions[i] += n[i];
+    }
+    narrow(lanes->b, r[RB]);
+    narrow(lanes->c, r[RC]);
+    narrow(lanes->d, r[RD]);
+    narrow(lanes->e, r[RE]);
+    narrow(lanes->h, r[RH]);
+    narrow(lanes->l, r[RL]);
+    narrow(lanes->a, r[RA]);
+    narrow(lanes->f, f);
+    memcpy(lanes->sp, &sp, sizeof(sp));
+    memcpy(lanes->pc, &pc, sizeof(pc));
+    narrow_bool(lanes->halted, halted);
+    narrow_bool(lanes->inte, inte);
+    lanes->issues += issues;
+}
+
+#endif
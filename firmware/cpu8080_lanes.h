@@ -0,0 +1,65 @@
+#ifndef CPU8080_LANES_H
+#define CPU8080_LANES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu8080.h"
+
+// Lockstep interpreter for host builds (CPU8080_LANES > 0, a multiple of
+// 8): CPU8080_LANES independent machines with their registers stored lane
+// by lane, stepped together with SIMD vectors (GCC/Clang vector extensions,
+// so SSE2 on any x86-64, or AVX2 with the matching -m flags).
+//
+// Each step picks the lowest PC among the running lanes and executes that
+// instruction on every lane that is at the same PC with the same opcode;
+// the others are masked off and wait, so lanes that branch apart run in
+// turns and merge again when their PCs meet. Immediates, memory and stack
+// accesses go to each lane's own RAM.
+//
+// A lane is a plain 64K of RAM with no ROM, devices or banks, like a bus
+// straight after memory_init(): IN reads 0xFF, OUT does nothing and no
+// interrupt is ever requested.
+// Registers, flags, memory and cycle counts match cpu8080_step() exactly.
+
+#ifndef CPU8080_LANES
+#define CPU8080_LANES 0
+#endif
+
+#if CPU8080_LANES
+
+// Lanes are a cache line more than 64K apart, so the same address in every
+// lane doesn't land in the same cache set
+#define CPU8080_LANE_STRIDE (MEMORY_SIZE + 64)
+
+typedef struct {
+    uint8_t a[CPU8080_LANES], f[CPU8080_LANES];
+    uint8_t b[CPU8080_LANES], c[CPU8080_LANES];
+    uint8_t d[CPU8080_LANES], e[CPU8080_LANES];
+    uint8_t h[CPU8080_LANES], l[CPU8080_LANES];
+    uint16_t sp[CPU8080_LANES];
+    uint16_t pc[CPU8080_LANES];
+    bool halted[CPU8080_LANES];
+    bool inte[CPU8080_LANES];
+    uint64_t cycles[CPU8080_LANES];         // executed since init
+    uint64_t instructions[CPU8080_LANES];
+    uint64_t issues;    // lockstep steps; instructions / issues is the lane occupancy
+    uint8_t *ram;       // CPU8080_LANES * CPU8080_LANE_STRIDE bytes
+} cpu8080_lanes_t;
+
+// Reset every lane as cpu8080_init() would. ram isn't cleared.
+void cpu8080_lanes_init(cpu8080_lanes_t *lanes, uint8_t *ram);
+
+static inline uint8_t *cpu8080_lane_ram(cpu8080_lanes_t *lanes, int lane) {
+    return lanes->ram + (uint32_t)lane * CPU8080_LANE_STRIDE;
+}
+
+// Run every lane until it has used at least cycle_budget cycles or halted
+void cpu8080_lanes_run(cpu8080_lanes_t *lanes, uint32_t cycle_budget);
+
+// Copy one lane's registers to or from a scalar CPU
+void cpu8080_lane_get(const cpu8080_lanes_t *lanes, int lane, cpu8080_t *cpu);
+void cpu8080_lane_set(cpu8080_lanes_t *lanes, int lane, cpu8080_t *cpu);
+
+#endif
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef CPU8080_OPS_H
+#define CPU8080_OPS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu8080.h"
+#include "memory.h"
+
+// Flag and ALU helpers shared by the interpreter and the C that aot8080
+// generates (see cpu8080_aot.h), so both compute flags the same way. Only
+// for the CPU core: the names are not prefixed.
+
+// Set Z/S/P from res and AC from bit 4 of ac. With lazy flags these are only
+// recorded here and folded into f by cpu8080_get_f(); C is always kept in f.
+static inline void set_flags_zsp_ac(cpu8080_t *cpu, uint8_t res, uint8_t ac) {
+#if CPU8080_LAZY_FLAGS
+    cpu->lazy_res = res;
+    cpu->lazy_ac = ac;
+    cpu->lazy_pending = true;
+#else
+    cpu->f = (cpu->f & ~(FLAG_Z | FLAG_S | FLAG_P | FLAG_AC)) |
+             cpu8080_zsp_table[res] | (ac & FLAG_AC);
+#endif
+}
+
+// Current Z/S/P bits, without materializing the rest of f
+static inline uint8_t flags_zsp(cpu8080_t *cpu) {
+#if CPU8080_LAZY_FLAGS
+    if (cpu->lazy_pending) return cpu8080_zsp_table[cpu->lazy_res];
+#endif
+    return cpu->f;
+}
+
+// For both add and subtract, bit 4 of a ^ b ^ res is the carry (or borrow)
+// out of the low nibble, and bit 8 of the 16-bit result is the carry/borrow.
+static inline void set_flags_add(cpu8080_t *cpu, uint8_t a, uint8_t b, uint8_t cy) {
+    uint16_t res = a + b + cy;
+    cpu->f = (cpu->f & ~FLAG_C) | ((res >> 8) & FLAG_C);
+    set_flags_zsp_ac(cpu, res, a ^ b ^ res);
+}
+
+static inline void set_flags_sub(cpu8080_t *cpu, uint8_t a, uint8_t b, uint8_t cy) {
+    uint16_t res = a - b - cy;
+    cpu->f = (cpu->f & ~FLAG_C) | ((res >> 8) & FLAG_C);
+    set_flags_zsp_ac(cpu, res, a ^ b ^ res);
+}
+
+static inline void alu_add(cpu8080_t *cpu, uint8_t v) { set_flags_add(cpu, cpu->a, v, 0); cpu->a += v; }
+static inline void alu_sub(cpu8080_t *cpu, uint8_t v) { set_flags_sub(cpu, cpu->a, v, 0); cpu->a -= v; }
+static inline void alu_cmp(cpu8080_t *cpu, uint8_t v) { set_flags_sub(cpu, cpu->a, v, 0); }
+
+static inline void alu_adc(cpu8080_t *cpu, uint8_t v) {
+    uint8_t cy = cpu->f & FLAG_C;
+    set_flags_add(cpu, cpu->a, v, cy);
+    cpu->a += v + cy;
+}
+
+static inline void alu_sbb(cpu8080_t *cpu, uint8_t v) {
+    uint8_t cy = cpu->f & FLAG_C;
+    set_flags_sub(cpu, cpu->a, v, cy);
+    cpu->a -= v + cy;
+}
+
+static inline void alu_ana(cpu8080_t *cpu, uint8_t v) {
+    cpu->a &= v;
+    cpu->f &= ~FLAG_C;
+    set_flags_zsp_ac(cpu, cpu->a, FLAG_AC);
+}
+
+static inline void alu_xra(cpu8080_t *cpu, uint8_t v) {
+    cpu->a ^= v;
+    cpu->f &= ~FLAG_C;
+    set_flags_zsp_ac(cpu, cpu->a, 0);
+}
+
+static inline void alu_ora(cpu8080_t *cpu, uint8_t v) {
+    cpu->a |= v;
+    cpu->f &= ~FLAG_C;
+    set_flags_zsp_ac(cpu, cpu->a, 0);
+}
+
+static inline uint8_t alu_inr(cpu8080_t *cpu, uint8_t v) {
+    uint8_t res = v + 1;
+    set_flags_zsp_ac(cpu, res, v ^ res);
+    return res;
+}
+
+static inline uint8_t alu_dcr(cpu8080_t *cpu, uint8_t v) {
+    uint8_t res = v - 1;
+    set_flags_zsp_ac(cpu, res, v ^ res);
+    return res;
+}
+
+static inline void alu_dad(cpu8080_t *cpu, uint16_t v) {
+    uint32_t r = cpu8080_get_hl(cpu) + v;
+    cpu8080_set_hl(cpu, r);
+    cpu->f = (cpu->f & ~FLAG_C) | ((r > 0xFFFF) ? FLAG_C : 0);
+}
+
+static inline void alu_daa(cpu8080_t *cpu) {
+    uint8_t f = cpu8080_get_f(cpu);
+    uint8_t cy = f & FLAG_C;
+    uint8_t add = 0;
+    if ((f & FLAG_AC) || (cpu->a & 0x0F) > 9) add |= 0x06;
+    if (cy || cpu->a > 0x99) { add |= 0x60; cy = FLAG_C; }
+    set_flags_add(cpu, cpu->a, add, 0);
+    cpu->a += add;
+    cpu->f |= cy;
+}
+
+static inline void pop_psw(cpu8080_t *cpu, uint16_t v) {
+    cpu->f = (v & 0xD7) | 0x02;
+    cpu->a = v >> 8;
+    cpu->lazy_pending = false;
+}
+
+static inline void push16(cpu8080_t *cpu, uint16_t val) {
+    memory_write(cpu->bus, --cpu->sp, val >> 8);
+    memory_write(cpu->bus, --cpu->sp, val & 0xFF);
+}
+
+static inline uint16_t pop16(cpu8080_t *cpu) {
+    uint8_t lo = memory_read(cpu->bus, cpu->sp++);
+    uint8_t hi = memory_read(cpu->bus, cpu->sp++);
+    return (hi << 8) | lo;
+}
+
+#if CPU8080_TCACHE
+// Translated block still matches memory: no write to its pages since
+static inline bool block_valid(const bus_t *bus, const cpu8080_block_t *blk) {
+    return blk->gen[0] == bus->code_gen[blk->page[0]] &&
+           blk->gen[1] == bus->code_gen[blk->page[1]];
+}
+#endif
+
+#endif
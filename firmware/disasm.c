@@ -266,8 +266,8 @@ static const disasm_entry_t disasm_table[256] = {
     [0xFF] = {"RST 7", 1},
 };
 
-int disasm_instruction(uint16_t addr, char *buffer, int buffer_size) {
-    uint8_t opcode = memory_read(addr);
+int disasm_instruction(bus_t *bus, uint8_t bank, uint16_t addr, char *buffer, int buffer_size) {
+    uint8_t opcode = memory_peek(bus, bank, addr);
     const disasm_entry_t *entry = &disasm_table[opcode];
 
     if (entry->mnemonic == NULL) {
@@ -280,10 +280,10 @@ int disasm_instruction(uint16_t addr, char *buffer, int buffer_size) {
             snprintf(buffer, buffer_size, "%s", entry->mnemonic);
             break;
         case 2:
-            snprintf(buffer, buffer_size, "%s%02X", entry->mnemonic, memory_read(addr + 1));
+            snprintf(buffer, buffer_size, "%s%02X", entry->mnemonic, memory_peek(bus, bank, addr + 1));
             break;
         case 3: {
-            uint16_t word = memory_read(addr + 1) | (memory_read(addr + 2) << 8);
+            uint16_t word = memory_peek(bus, bank, addr + 1) | (memory_peek(bus, bank, addr + 2) << 8);
             snprintf(buffer, buffer_size, "%s%04X", entry->mnemonic, word);
             break;
         }
@@ -292,8 +292,8 @@ int disasm_instruction(uint16_t addr, char *buffer, int buffer_size) {
     return entry->length;
 }
 
-int disasm_get_length(uint16_t addr) {
-    uint8_t opcode = memory_read(addr);
+int disasm_get_length(bus_t *bus, uint8_t bank, uint16_t addr) {
+    uint8_t opcode = memory_peek(bus, bank, addr);
     const disasm_entry_t *entry = &disasm_table[opcode];
     return entry->mnemonic ? entry->length : 1;
 }
@@ -2,8 +2,11 @@
 #define DISASM_H
 
 #include <stdint.h>
+#include "memory.h"
 
-int disasm_instruction(uint16_t addr, char *buffer, int buffer_size);
-int disasm_get_length(uint16_t addr);
+// Code is read with memory_peek() from bank, MEMORY_BANK_CURRENT for the
+// one that is mapped, so disassembling never touches devices
+int disasm_instruction(bus_t *bus, uint8_t bank, uint16_t addr, char *buffer, int buffer_size);
+int disasm_get_length(bus_t *bus, uint8_t bank, uint16_t addr);
 
 #endif
@@ -0,0 +1,91 @@
+#include "disk.h"
+#include <string.h>
+
+static const disk_image_t *selected_image(disk_t *disk) {
+    return disk->selected < DISK_DRIVES ? disk->drive[disk->selected] : NULL;
+}
+
+// Offset of the current sector in image, or -1 if it is outside it
+static int32_t sector_offset(disk_t *disk, const disk_image_t *image) {
+    if (disk->track >= DISK_TRACKS || disk->sector < 1 || disk->sector > DISK_SECTORS) return -1;
+    uint32_t offset = ((uint32_t)disk->track * DISK_SECTORS + disk->sector - 1) * DISK_SECTOR_SIZE;
+    if (offset + DISK_SECTOR_SIZE > image->size) return -1;
+    return offset;
+}
+
+static uint8_t command(disk_t *disk, uint8_t cmd) {
+    const disk_image_t *image = selected_image(disk);
+    if (!image) return DISK_ERR_NOT_READY;
+    if (cmd != DISK_CMD_READ && cmd != DISK_CMD_WRITE) return DISK_ERR_COMMAND;
+    int32_t offset = sector_offset(disk, image);
+    if (offset < 0) return DISK_ERR_SEEK;
+
+    if (cmd == DISK_CMD_READ) {
+        memory_dma_write(disk->bus, disk->dma, image->data + offset, DISK_SECTOR_SIZE);
+        return DISK_OK;
+    }
+    if (!image->write) return DISK_ERR_PROTECTED;
+    uint8_t buf[DISK_SECTOR_SIZE];
+    memory_dma_read(disk->bus, disk->dma, buf, sizeof(buf));
+    return image->write(image->ctx, offset, buf, sizeof(buf)) ? DISK_OK : DISK_ERR_WRITE;
+}
+
+static uint8_t disk_in(void *ctx, uint8_t port, uint64_t cycle) {
+    disk_t *disk = ctx;
+    (void)cycle;
+    switch ((uint8_t)(port - disk->port_base)) {
+        case 1: return disk->track;
+        case 2: return disk->sector;
+        case 3: return disk->dma & 0xFF;
+        case 4: return disk->dma >> 8;
+        default: return disk->status;
+    }
+}
+
+static void disk_out(void *ctx, uint8_t port, uint8_t data, uint64_t cycle) {
+    disk_t *disk = ctx;
+    (void)cycle;
+    // The registers and whatever a command moves aren't in the rewind history
+    memory_port_effect(disk->bus);
+    switch ((uint8_t)(port - disk->port_base)) {
+        case 0:
+            disk->selected = data;
+            disk->status = selected_image(disk) ? DISK_OK : DISK_ERR_NOT_READY;
+            break;
+        case 1: disk->track = data; break;
+        case 2: disk->sector = data; break;
+        case 3: disk->dma = (disk->dma & 0xFF00) | data; break;
+        case 4: disk->dma = (disk->dma & 0x00FF) | (data << 8); break;
+        default: disk->status = command(disk, data); break;
+    }
+}
+
+void disk_init(disk_t *disk, bus_t *bus, uint8_t base) {
+    disk->bus = bus;
+    for (int i = 0; i < DISK_DRIVES; i++) {
+        disk->drive[i] = NULL;
+    }
+    disk->port_base = base;
+    disk->selected = 0;
+    disk->track = 0;
+    disk->sector = 1;
+    disk->dma = 0x0080;
+    disk->status = DISK_ERR_NOT_READY;
+    disk->port.in = disk_in;
+    disk->port.out = disk_out;
+    disk->port.ctx = disk;
+    memory_map_port(bus, base, DISK_PORTS, &disk->port);
+}
+
+void disk_insert(disk_t *disk, uint8_t drive, const disk_image_t *image) {
+    if (drive >= DISK_DRIVES) return;
+    disk->drive[drive] = image;
+    if (drive == disk->selected) {
+        disk->status = image ? DISK_OK : DISK_ERR_NOT_READY;
+    }
+}
+
+bool disk_write_in_place(void *ctx, uint32_t offset, const uint8_t *src, uint32_t len) {
+    memcpy((uint8_t *)ctx + offset, src, len);
+    return true;
+}
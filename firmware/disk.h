@@ -0,0 +1,84 @@
+#ifndef DISK_H
+#define DISK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory.h"
+
+// Floppy controller for CP/M: up to DISK_DRIVES 8" IBM 3740 disks (77
+// tracks of 26 128-byte sectors, single sided, single density) behind a
+// SIMH-style port interface. Instead of a byte per IN like the Altair
+// 88-DCDD, one command moves a whole sector between the image and memory
+// at the DMA address (memory_dma_write()), so a sector costs a handful of
+// OUTs whatever the engine.
+//
+// Ports from base:
+//   +0  OUT select drive                IN status (DISK_OK or DISK_ERR_*)
+//   +1  OUT track, 0-76                 IN track
+//   +2  OUT sector, 1-26                IN sector
+//   +3  OUT DMA address low byte        IN DMA address low byte
+//   +4  OUT DMA address high byte       IN DMA address high byte
+//   +5  OUT command (DISK_CMD_*)        IN status
+// Selecting a drive sets the status to DISK_OK if it holds a disk. The
+// transfer is done by the time the OUT of the command finishes.
+//
+// Images are flat, sector s of track t at (t * 26 + s - 1) * 128, the
+// layout SIMH and the usual CP/M disk tools use. They are read in place,
+// so an image can be an mmap'd file, a flash partition or a plain buffer.
+// Every OUT is a device effect (memory_port_effect()): stepping back
+// (rewind.h) stops after it rather than leave a read's memory filled.
+
+#ifndef DISK_DRIVES
+#define DISK_DRIVES 4
+#endif
+
+#define DISK_TRACKS 77
+#define DISK_SECTORS 26             // per track, numbered from 1
+#define DISK_SECTOR_SIZE 128
+#define DISK_IMAGE_SIZE (DISK_TRACKS * DISK_SECTORS * DISK_SECTOR_SIZE)
+#define DISK_PORTS 6
+
+#define DISK_CMD_READ  0            // sector into memory at the DMA address
+#define DISK_CMD_WRITE 1            // sector from memory at the DMA address
+
+#define DISK_OK              0
+#define DISK_ERR_NOT_READY   1      // no disk in the drive, or no such drive
+#define DISK_ERR_SEEK        2      // track or sector out of range or past the image
+#define DISK_ERR_PROTECTED   3      // image can't be written
+#define DISK_ERR_WRITE       4      // the image's write failed
+#define DISK_ERR_COMMAND     5
+
+// A disk image. A smaller image reads as a disk with only its first
+// sectors; the rest give DISK_ERR_SEEK.
+typedef struct {
+    const uint8_t *data;
+    uint32_t size;
+    // Store len bytes at offset, false on failure. NULL write-protects.
+    bool (*write)(void *ctx, uint32_t offset, const uint8_t *src, uint32_t len);
+    void *ctx;
+} disk_image_t;
+
+typedef struct {
+    memory_port_t port;
+    bus_t *bus;
+    const disk_image_t *drive[DISK_DRIVES];
+    uint8_t port_base;
+    uint8_t selected;
+    uint8_t track;
+    uint8_t sector;
+    uint16_t dma;
+    uint8_t status;
+} disk_t;
+
+// Attach to ports [base, base + DISK_PORTS) with every drive empty
+void disk_init(disk_t *disk, bus_t *bus, uint8_t base);
+
+// Put image in drive, NULL empties it. The image must stay valid while
+// it is in.
+void disk_insert(disk_t *disk, uint8_t drive, const disk_image_t *image);
+
+// disk_image_t.write for images that are writable where they are read
+// (mmap'd files, buffers): ctx is the image's data
+bool disk_write_in_place(void *ctx, uint32_t offset, const uint8_t *src, uint32_t len);
+
+#endif // DISK_H
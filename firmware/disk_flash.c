@@ -0,0 +1,56 @@
+#include "disk_flash.h"
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+
+static disk_image_t images[DISK_FLASH_DRIVES];
+
+// The flash sector being rewritten and its new contents
+static uint32_t program_base;
+static uint8_t program_buf[FLASH_SECTOR_SIZE];
+
+// Runs with the other core locked out and interrupts off
+static void program_sector(void *param) {
+    (void)param;
+    flash_range_erase(program_base, FLASH_SECTOR_SIZE);
+    flash_range_program(program_base, program_buf, FLASH_SECTOR_SIZE);
+}
+
+// ctx is the slot's offset in flash. A disk sector never straddles two
+// flash sectors, slots being whole flash sectors.
+static bool flash_write(void *ctx, uint32_t offset, const uint8_t *src, uint32_t len) {
+    uint32_t at = (uint32_t)(uintptr_t)ctx + offset;
+    const uint8_t *current = (const uint8_t *)(XIP_BASE + at);
+
+    // CP/M rewrites directory sectors unchanged; skip the erase
+    if (memcmp(current, src, len) == 0) return true;
+
+    program_base = at & ~(FLASH_SECTOR_SIZE - 1);
+    memcpy(program_buf, (const uint8_t *)(XIP_BASE + program_base), FLASH_SECTOR_SIZE);
+    memcpy(program_buf + (at - program_base), src, len);
+    return flash_safe_execute(program_sector, NULL, DISK_FLASH_TIMEOUT_MS) == PICO_OK;
+}
+
+static bool slot_erased(const uint8_t *data) {
+    for (int i = 0; i < DISK_SECTOR_SIZE; i++) {
+        if (data[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+int disk_flash_attach(disk_t *disk) {
+    int inserted = 0;
+    for (int slot = 0; slot < DISK_FLASH_DRIVES && slot < DISK_DRIVES; slot++) {
+        uint32_t offset = DISK_FLASH_OFFSET + slot * DISK_FLASH_SLOT_SIZE;
+        disk_image_t *image = &images[slot];
+        image->data = (const uint8_t *)(XIP_BASE + offset);
+        if (slot_erased(image->data)) continue;
+        image->size = DISK_IMAGE_SIZE;
+        image->write = flash_write;
+        image->ctx = (void *)(uintptr_t)offset;
+        disk_insert(disk, slot, image);
+        inserted++;
+    }
+    return inserted;
+}
@@ -0,0 +1,37 @@
+#ifndef DISK_FLASH_H
+#define DISK_FLASH_H
+
+#include <stdint.h>
+#include "disk.h"
+
+// Disk images for the Pico: a partition at the top of flash holding
+// DISK_FLASH_DRIVES slots of DISK_FLASH_SLOT_SIZE bytes, drive A first.
+// Images are read in place through XIP. Writing a sector reprograms the
+// 4K flash sector holding it with flash_safe_execute(), so the other core
+// has to have called flash_safe_execute_core_init().
+//
+// Put an image in a slot with picotool, e.g. drive A of a 2MB Pico:
+//   picotool load -t bin cpm22.dsk -o 0x10182000
+// (XIP_BASE + DISK_FLASH_OFFSET + n * DISK_FLASH_SLOT_SIZE for drive n)
+
+#ifndef DISK_FLASH_DRIVES
+#define DISK_FLASH_DRIVES 2
+#endif
+
+// An image rounded up to whole flash sectors
+#define DISK_FLASH_SLOT_SIZE ((DISK_IMAGE_SIZE + 4095u) & ~4095u)
+
+#ifndef DISK_FLASH_OFFSET
+#define DISK_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - DISK_FLASH_DRIVES * DISK_FLASH_SLOT_SIZE)
+#endif
+
+// How long a write waits for the other core to get out of flash
+#ifndef DISK_FLASH_TIMEOUT_MS
+#define DISK_FLASH_TIMEOUT_MS 100
+#endif
+
+// Insert each slot that holds something into its drive; an erased slot
+// (all 0xFF) leaves the drive empty. Returns how many were inserted.
+int disk_flash_attach(disk_t *disk);
+
+#endif // DISK_FLASH_H
@@ -0,0 +1,69 @@
+#include "events.h"
+
+void event_queue_init(event_queue_t *q) {
+    q->count = 0;
+}
+
+static void sift_up(event_queue_t *q, uint32_t i) {
+    event_t e = q->heap[i];
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (q->heap[parent].cycle <= e.cycle) break;
+        q->heap[i] = q->heap[parent];
+        i = parent;
+    }
+    q->heap[i] = e;
+}
+
+static void sift_down(event_queue_t *q, uint32_t i) {
+    event_t e = q->heap[i];
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= q->count) break;
+        if (child + 1 < q->count && q->heap[child + 1].cycle < q->heap[child].cycle) child++;
+        if (e.cycle <= q->heap[child].cycle) break;
+        q->heap[i] = q->heap[child];
+        i = child;
+    }
+    q->heap[i] = e;
+}
+
+// Take the earliest event out, refilling the root from the end of the heap
+static void pop(event_queue_t *q) {
+    if (--q->count > 0) {
+        q->heap[0] = q->heap[q->count];
+        sift_down(q, 0);
+    }
+}
+
+bool event_schedule(event_queue_t *q, uint64_t cycle, event_fn_t fn, void *ctx) {
+    if (q->count == EVENT_QUEUE_SIZE) return false;
+    q->heap[q->count] = (event_t){ cycle, fn, ctx };
+    sift_up(q, q->count++);
+    return true;
+}
+
+int event_cancel(event_queue_t *q, event_fn_t fn, void *ctx) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < q->count; i++) {
+        if (q->heap[i].fn != fn || q->heap[i].ctx != ctx) {
+            q->heap[kept++] = q->heap[i];
+        }
+    }
+    int removed = q->count - kept;
+    if (removed) {
+        q->count = kept;
+        for (uint32_t i = kept / 2; i-- > 0;) {
+            sift_down(q, i);
+        }
+    }
+    return removed;
+}
+
+void event_run_due(event_queue_t *q, uint64_t now) {
+    while (q->count && q->heap[0].cycle <= now) {
+        event_t e = q->heap[0];
+        pop(q);
+        e.fn(e.ctx, e.cycle);
+    }
+}
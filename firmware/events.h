@@ -0,0 +1,50 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Device timing: callbacks due at a CPU cycle count, kept in a binary
+// min-heap so the CPU only ever compares against the earliest one. Devices
+// schedule through cpu8080_schedule(), which keeps the CPU's copy of that
+// cycle up to date.
+
+#ifndef EVENT_QUEUE_SIZE
+#define EVENT_QUEUE_SIZE 32
+#endif
+
+#define EVENT_NEVER UINT64_MAX
+
+// Called at the first instruction boundary at or after cycle, the time the
+// event was due, so periodic devices can schedule the next one drift-free
+typedef void (*event_fn_t)(void *ctx, uint64_t cycle);
+
+typedef struct {
+    uint64_t cycle;
+    event_fn_t fn;
+    void *ctx;
+} event_t;
+
+typedef struct {
+    event_t heap[EVENT_QUEUE_SIZE];
+    uint32_t count;
+} event_queue_t;
+
+void event_queue_init(event_queue_t *q);
+
+// Add an event. Returns false if the queue is full.
+bool event_schedule(event_queue_t *q, uint64_t cycle, event_fn_t fn, void *ctx);
+
+// Remove every event with this callback and context. Returns how many.
+int event_cancel(event_queue_t *q, event_fn_t fn, void *ctx);
+
+// Call and remove the events due by now, earliest first. Callbacks may
+// schedule more; any already due run in the same call.
+void event_run_due(event_queue_t *q, uint64_t now);
+
+// Cycle of the earliest event, EVENT_NEVER if there is none
+static inline uint64_t event_next(const event_queue_t *q) {
+    return q->count ? q->heap[0].cycle : EVENT_NEVER;
+}
+
+#endif // EVENTS_H
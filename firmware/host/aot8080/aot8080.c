@@ -0,0 +1,607 @@
+/**
+ * Ahead-of-time 8080 translator
+ *
+ * Build-time tool for CPU8080_AOT (see cpu8080_aot.h): turns 8080 images
+ * into a C file with one function per block and the tables
+ * cpu8080_aot_lookup() searches. Images are the programs in programs.h
+ * (-p) and any files given, raw binaries at their @ADDR (default 0000) or
+ * Intel HEX.
+ *
+ * Blocks are found by following the code from each image's load address,
+ * the RST vectors it covers and any -e entry points: jump and call
+ * targets, the instruction after a call, a conditional branch or an RST,
+ * and wherever a block was cut short or stopped before IN or OUT. They
+ * are cut exactly as translate() in cpu8080.c cuts them, so the cache
+ * finds them by start address. Data the walk runs into becomes a few
+ * unused blocks, which is harmless.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "cpu8080.h"
+#include "programs.h"
+
+#define MAX_IMAGES 64
+#define MAX_ENTRIES 256
+
+typedef struct {
+    char name[64];
+    uint16_t base;
+    uint32_t size;
+    uint8_t bytes[MEMORY_SIZE + 2];    // operands past the end read as 0
+    uint8_t loaded[MEMORY_SIZE];    // byte came from the image
+    uint8_t block[MEMORY_SIZE];     // a block starts here
+} image_t;
+
+static image_t *images[MAX_IMAGES];
+static int image_count;
+static uint16_t entries[MAX_ENTRIES];
+static int entry_count;
+
+static const char *const reg_name[8] = { "b", "c", "d", "e", "h", "l", "M", "a" };
+static const char *const pair_name[4] = { "bc", "de", "hl", "sp" };
+static const char *const alu_name[8] = {
+    "alu_add", "alu_adc", "alu_sub", "alu_sbb", "alu_ana", "alu_xra", "alu_ora", "alu_cmp"
+};
+static const char *const cond_expr[8] = {
+    "!(flags_zsp(cpu) & FLAG_Z)", "(flags_zsp(cpu) & FLAG_Z)",
+    "!(cpu->f & FLAG_C)", "(cpu->f & FLAG_C)",
+    "!(flags_zsp(cpu) & FLAG_P)", "(flags_zsp(cpu) & FLAG_P)",
+    "!(flags_zsp(cpu) & FLAG_S)", "(flags_zsp(cpu) & FLAG_S)",
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] [IMAGE[@ADDR]...]\n"
+            "\n"
+            "  -o FILE   write the C here (default: standard output)\n"
+            "  -p        translate the built-in programs in programs.h too\n"
+            "  -e ADDR   also follow the code from ADDR, in every image holding it\n"
+            "\n"
+            "IMAGE is a raw binary loaded at ADDR (hex, default 0000), or Intel HEX\n"
+            "if the name ends in .hex or .ihx.\n",
+            prog);
+}
+
+// Instruction length, as op_info in cpu8080.c
+static int op_len(uint8_t op) {
+    switch (op) {
+        case 0x01: case 0x11: case 0x21: case 0x31:
+        case 0x22: case 0x2A: case 0x32: case 0x3A:
+        case 0xC3: case 0xCD:
+            return 3;
+        case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x36: case 0x3E:
+        case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+        case 0xD3: case 0xDB:
+            return 2;
+    }
+    if ((op & 0xC7) == 0xC2 || (op & 0xC7) == 0xC4) return 3;     // Jcc, Ccc
+    return 1;
+}
+
+// IN, OUT and EI, which only ever start a block (OPI_SYNC in cpu8080.c)
+static bool op_starts_block(uint8_t op) {
+    return op == 0xD3 || op == 0xDB || op == 0xFB;
+}
+
+// Ends a translated block, as OPI_END in cpu8080.c
+static bool op_ends_block(uint8_t op) {
+    switch (op) {
+        case 0x76: case 0xC3: case 0xC9: case 0xCD: case 0xD3: case 0xDB:
+        case 0xE9: case 0xF3: case 0xFB:
+            return true;
+    }
+    return (op & 0xC7) == 0xC0 || (op & 0xC7) == 0xC2 ||
+           (op & 0xC7) == 0xC4 || (op & 0xC7) == 0xC7;
+}
+
+static bool may_write(uint8_t op) {
+    switch (op) {
+        case 0x02: case 0x12: case 0x22: case 0x32: case 0x34: case 0x35: case 0x36:
+        case 0xE3: case 0xCD:
+            return true;
+    }
+    return ((op & 0xF8) == 0x70 && op != 0x76) || (op & 0xCF) == 0xC5 ||
+           (op & 0xC7) == 0xC4 || (op & 0xC7) == 0xC7;
+}
+
+static image_t *new_image(const char *name) {
+    if (image_count == MAX_IMAGES) {
+        fprintf(stderr, "too many images\n");
+        exit(1);
+    }
+    image_t *img = calloc(1, sizeof(*img));
+    if (!img) {
+        perror("aot8080");
+        exit(1);
+    }
+
+    // C identifier from the file name, without directory or extension
+    const char *base = strrchr(name, '/');
+    base = base ? base + 1 : name;
+    size_t n = 0;
+    for (; base[n] && base[n] != '.' && n < sizeof(img->name) - 1; n++) {
+        char c = base[n];
+        bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+        img->name[n] = ok ? c : '_';
+    }
+    img->name[n] = '\0';
+    images[image_count++] = img;
+    return img;
+}
+
+static void add_program(const char *name, uint16_t addr, const uint8_t *prog, uint32_t size) {
+    image_t *img = new_image(name);
+    img->base = addr;
+    img->size = size;
+    memcpy(img->bytes + addr, prog, size);
+    memset(img->loaded + addr, 1, size);
+}
+
+// Load the file twice over different fill bytes: whatever differs was
+// never written by it, which tells the image's extent and any holes
+static bool add_file(const char *arg) {
+    static bus_t bus[2];
+    char path[4096];
+    uint16_t load_addr = 0;
+
+    snprintf(path, sizeof(path), "%s", arg);
+    char *at = strrchr(path, '@');
+    if (at) {
+        *at = '\0';
+        load_addr = strtoul(at + 1, NULL, 16);
+    }
+    for (int i = 0; i < 2; i++) {
+        int32_t start = -1;
+        memory_init(&bus[i]);
+        memset(bus[i].ram, i ? 0xFF : 0x00, MEMORY_SIZE);
+        if (!image_load(&bus[i], path, load_addr, &start)) return false;
+        if (start >= 0 && entry_count < MAX_ENTRIES) entries[entry_count++] = start;
+    }
+
+    image_t *img = new_image(path);
+    int32_t first = -1, last = -1;
+    for (uint32_t a = 0; a < MEMORY_SIZE; a++) {
+        if (bus[0].ram[a] != 0x00 || bus[1].ram[a] != 0xFF) {
+            img->loaded[a] = 1;
+            img->bytes[a] = bus[0].ram[a];
+            if (first < 0) first = a;
+            last = a;
+        }
+    }
+    if (first < 0) {
+        fprintf(stderr, "%s: empty image\n", path);
+        return false;
+    }
+    img->base = first;
+    img->size = last - first + 1;
+    return true;
+}
+
+static bool in_image(const image_t *img, uint32_t addr) {
+    return addr < MEMORY_SIZE && img->loaded[addr];
+}
+
+// Mark a block at pc and everything reachable from it. Blocks reaching
+// past the image aren't kept, their bytes could be anything at run time.
+static void discover(image_t *img, uint16_t pc) {
+    static uint16_t stack[MEMORY_SIZE];
+    static uint8_t seen[MEMORY_SIZE];
+    int sp = 0;
+
+    if (!in_image(img, pc)) return;
+    memset(seen, 0, sizeof(seen));
+    seen[pc] = 1;
+    stack[sp++] = pc;
+    while (sp > 0) {
+        uint32_t start = stack[--sp];
+
+        uint32_t at = start;
+        uint32_t succ[CPU8080_TCACHE_UOPS + 1];
+        int nsucc = 0, count = 0;
+        bool complete = true;
+        uint8_t op;
+        do {
+            op = img->bytes[at];
+            if (op_starts_block(op) && count > 0) break;
+            int len = op_len(op);
+            for (int i = 0; i < len; i++) {
+                complete = complete && in_image(img, at + i);
+            }
+            if (!complete) break;
+            uint16_t imm = img->bytes[at + 1] | (img->bytes[at + 2] << 8);
+            at += len;
+            count++;
+            if (op == 0xC3 || (op & 0xC7) == 0xC2 || op == 0xCD || (op & 0xC7) == 0xC4) {
+                succ[nsucc++] = imm;
+            } else if ((op & 0xC7) == 0xC7) {
+                succ[nsucc++] = op & 0x38;
+            }
+        } while (!op_ends_block(op) && count < CPU8080_TCACHE_UOPS);
+        if (!complete) continue;
+
+        img->block[start] = 1;
+        if (op != 0xC3 && op != 0xC9 && op != 0xE9) succ[nsucc++] = at;
+        for (int i = 0; i < nsucc; i++) {
+            if (in_image(img, succ[i]) && !seen[succ[i]]) {
+                seen[succ[i]] = 1;
+                stack[sp++] = succ[i];
+            }
+        }
+    }
+}
+
+// C for one instruction that doesn't end the block
+static void emit_op(FILE *out, uint8_t op, uint16_t imm, uint32_t *cycles) {
+    int dst = (op >> 3) & 7, src = op & 7, rp = (op >> 4) & 3;
+
+    if (op >= 0x40 && op < 0x80) {
+        if (dst == 6) {
+            fprintf(out, "    memory_write(bus, cpu8080_get_hl(cpu), cpu->%s);\n", reg_name[src]);
+            *cycles += 7;
+        } else if (src == 6) {
+            fprintf(out, "    cpu->%s = memory_read(bus, cpu8080_get_hl(cpu));\n", reg_name[dst]);
+            *cycles += 7;
+        } else {
+            if (dst != src) fprintf(out, "    cpu->%s = cpu->%s;\n", reg_name[dst], reg_name[src]);
+            *cycles += 5;
+        }
+        return;
+    }
+    if (op >= 0x80 && op < 0xC0) {
+        if (src == 6) {
+            fprintf(out, "    %s(cpu, memory_read(bus, cpu8080_get_hl(cpu)));\n", alu_name[dst]);
+            *cycles += 7;
+        } else {
+            fprintf(out, "    %s(cpu, cpu->%s);\n", alu_name[dst], reg_name[src]);
+            *cycles += 4;
+        }
+        return;
+    }
+    if ((op & 0xC7) == 0xC6) {
+        fprintf(out, "    %s(cpu, 0x%02X);\n", alu_name[dst], imm & 0xFF);
+        *cycles += 7;
+        return;
+    }
+    if (op < 0x40) {
+        switch (op & 0x0F) {
+            case 0x01:
+                if (rp == 3) {
+                    fprintf(out, "    cpu->sp = 0x%04X;\n", imm);
+                } else {
+                    fprintf(out, "    cpu8080_set_%s(cpu, 0x%04X);\n", pair_name[rp], imm);
+                }
+                *cycles += 10;
+                return;
+            case 0x03:
+            case 0x0B: {
+                const char *sign = (op & 0x08) ? "-" : "+";
+                if (rp == 3) {
+                    fprintf(out, "    cpu->sp %s= 1;\n", sign);
+                } else {
+                    fprintf(out, "    cpu8080_set_%s(cpu, cpu8080_get_%s(cpu) %s 1);\n",
+                            pair_name[rp], pair_name[rp], sign);
+                }
+                *cycles += 5;
+                return;
+            }
+            case 0x09:
+                if (rp == 3) {
+                    fprintf(out, "    alu_dad(cpu, cpu->sp);\n");
+                } else {
+                    fprintf(out, "    alu_dad(cpu, cpu8080_get_%s(cpu));\n", pair_name[rp]);
+                }
+                *cycles += 10;
+                return;
+        }
+        switch (op & 0x07) {
+            case 0x04:
+            case 0x05: {
+                const char *fn = (op & 1) ? "alu_dcr" : "alu_inr";
+                if (dst == 6) {
+                    fprintf(out, "    { uint16_t hl = cpu8080_get_hl(cpu); "
+                                 "memory_write(bus, hl, %s(cpu, memory_read(bus, hl))); }\n", fn);
+                    *cycles += 10;
+                } else {
+                    fprintf(out, "    cpu->%s = %s(cpu, cpu->%s);\n", reg_name[dst], fn, reg_name[dst]);
+                    *cycles += 5;
+                }
+                return;
+            }
+            case 0x06:
+                if (dst == 6) {
+                    fprintf(out, "    memory_write(bus, cpu8080_get_hl(cpu), 0x%02X);\n", imm & 0xFF);
+                    *cycles += 10;
+                } else {
+                    fprintf(out, "    cpu->%s = 0x%02X;\n", reg_name[dst], imm & 0xFF);
+                    *cycles += 7;
+                }
+                return;
+        }
+        switch (op) {
+            case 0x02: fprintf(out, "    memory_write(bus, cpu8080_get_bc(cpu), cpu->a);\n"); *cycles += 7; return;
+            case 0x12: fprintf(out, "    memory_write(bus, cpu8080_get_de(cpu), cpu->a);\n"); *cycles += 7; return;
+            case 0x0A: fprintf(out, "    cpu->a = memory_read(bus, cpu8080_get_bc(cpu));\n"); *cycles += 7; return;
+            case 0x1A: fprintf(out, "    cpu->a = memory_read(bus, cpu8080_get_de(cpu));\n"); *cycles += 7; return;
+            case 0x22:
+                fprintf(out, "    memory_write_word(bus, 0x%04X, cpu8080_get_hl(cpu));\n", imm);
+                *cycles += 16;
+                return;
+            case 0x2A:
+                fprintf(out, "    cpu8080_set_hl(cpu, memory_read_word(bus, 0x%04X));\n", imm);
+                *cycles += 16;
+                return;
+            case 0x32: fprintf(out, "    memory_write(bus, 0x%04X, cpu->a);\n", imm); *cycles += 13; return;
+            case 0x3A: fprintf(out, "    cpu->a = memory_read(bus, 0x%04X);\n", imm); *cycles += 13; return;
+            case 0x07:
+                fprintf(out, "    { uint8_t cy = cpu->a >> 7; cpu->a = (cpu->a << 1) | cy; "
+                             "cpu->f = (cpu->f & ~FLAG_C) | cy; }\n");
+                break;
+            case 0x0F:
+                fprintf(out, "    { uint8_t cy = cpu->a & 0x01; cpu->a = (cpu->a >> 1) | (cy << 7); "
+                             "cpu->f = (cpu->f & ~FLAG_C) | cy; }\n");
+                break;
+            case 0x17:
+                fprintf(out, "    { uint8_t cy = cpu->a >> 7; cpu->a = (cpu->a << 1) | (cpu->f & FLAG_C); "
+                             "cpu->f = (cpu->f & ~FLAG_C) | cy; }\n");
+                break;
+            case 0x1F:
+                fprintf(out, "    { uint8_t cy = cpu->a & 0x01; cpu->a = (cpu->a >> 1) | ((cpu->f & FLAG_C) << 7); "
+                             "cpu->f = (cpu->f & ~FLAG_C) | cy; }\n");
+                break;
+            case 0x27: fprintf(out, "    alu_daa(cpu);\n"); break;
+            case 0x2F: fprintf(out, "    cpu->a = ~cpu->a;\n"); break;
+            case 0x37: fprintf(out, "    cpu->f |= FLAG_C;\n"); break;
+            case 0x3F: fprintf(out, "    cpu->f ^= FLAG_C;\n"); break;
+            default: break;     // NOP and the undefined opcodes
+        }
+        *cycles += 4;
+        return;
+    }
+
+    switch (op) {
+        case 0xC5: case 0xD5: case 0xE5:
+            fprintf(out, "    push16(cpu, cpu8080_get_%s(cpu));\n", pair_name[rp]);
+            *cycles += 11;
+            return;
+        case 0xF5:
+            fprintf(out, "    push16(cpu, (cpu->a << 8) | (cpu8080_get_f(cpu) | 0x02));\n");
+            *cycles += 11;
+            return;
+        case 0xC1: case 0xD1: case 0xE1:
+            fprintf(out, "    cpu8080_set_%s(cpu, pop16(cpu));\n", pair_name[rp]);
+            *cycles += 10;
+            return;
+        case 0xF1:
+            fprintf(out, "    pop_psw(cpu, pop16(cpu));\n");
+            *cycles += 10;
+            return;
+        case 0xE3:
+            fprintf(out, "    { uint16_t tmp = memory_read_word(bus, cpu->sp); "
+                         "memory_write_word(bus, cpu->sp, cpu8080_get_hl(cpu)); cpu8080_set_hl(cpu, tmp); }\n");
+            *cycles += 18;
+            return;
+        case 0xEB:
+            fprintf(out, "    { uint16_t tmp = cpu8080_get_de(cpu); "
+                         "cpu8080_set_de(cpu, cpu8080_get_hl(cpu)); cpu8080_set_hl(cpu, tmp); }\n");
+            *cycles += 4;
+            return;
+        case 0xF9:
+            fprintf(out, "    cpu->sp = cpu8080_get_hl(cpu);\n");
+            *cycles += 5;
+            return;
+        default:
+            *cycles += 4;   // undefined, NOP
+            return;
+    }
+}
+
+// C for the instruction that ends the block, leaving PC on the successor
+static void emit_end(FILE *out, uint8_t op, uint16_t imm, uint16_t next, uint32_t cycles) {
+    int cc = (op >> 3) & 7;
+
+    if (op == 0xC3) {
+        fprintf(out, "    cpu->pc = 0x%04X;\n    return %u;\n", imm, cycles + 10);
+    } else if ((op & 0xC7) == 0xC2) {
+        fprintf(out, "    cpu->pc = %s ? 0x%04X : 0x%04X;\n    return %u;\n",
+                cond_expr[cc], imm, next, cycles + 10);
+    } else if (op == 0xCD) {
+        fprintf(out, "    push16(cpu, 0x%04X);\n    cpu->pc = 0x%04X;\n    return %u;\n",
+                next, imm, cycles + 17);
+    } else if ((op & 0xC7) == 0xC4) {
+        fprintf(out, "    if (%s) {\n"
+                     "        push16(cpu, 0x%04X);\n"
+                     "        cpu->pc = 0x%04X;\n"
+                     "        return %u;\n"
+                     "    }\n"
+                     "    cpu->pc = 0x%04X;\n    return %u;\n",
+                cond_expr[cc], next, imm, cycles + 17, next, cycles + 11);
+    } else if (op == 0xC9) {
+        fprintf(out, "    cpu->pc = pop16(cpu);\n    return %u;\n", cycles + 10);
+    } else if ((op & 0xC7) == 0xC0) {
+        fprintf(out, "    if (%s) {\n"
+                     "        cpu->pc = pop16(cpu);\n"
+                     "        return %u;\n"
+                     "    }\n"
+                     "    cpu->pc = 0x%04X;\n    return %u;\n",
+                cond_expr[cc], cycles + 11, next, cycles + 5);
+    } else if ((op & 0xC7) == 0xC7) {
+        fprintf(out, "    push16(cpu, 0x%04X);\n    cpu->pc = 0x%04X;\n    return %u;\n",
+                next, op & 0x38, cycles + 11);
+    } else if (op == 0xE9) {
+        fprintf(out, "    cpu->pc = cpu8080_get_hl(cpu);\n    return %u;\n", cycles + 5);
+    } else {
+        // HLT, IN, OUT, EI and DI go through the interpreter's handlers
+        fprintf(out, "    cpu->pc = 0x%04X;\n    return %u + cpu8080_execute_op(cpu, 0x%02X, 0x%04X);\n",
+                next, cycles, op, imm);
+    }
+}
+
+static void emit_block(FILE *out, const image_t *img, uint16_t start, uint16_t *end) {
+    uint32_t at = start;
+    uint32_t cycles = 0;
+    int count = 0;
+
+    fprintf(out, "static uint32_t %s_%04X(cpu8080_t *cpu, const cpu8080_block_t *blk) {\n"
+                 "    bus_t *bus = cpu->bus;\n"
+                 "    (void)bus;\n"
+                 "    (void)blk;\n",
+            img->name, start);
+    for (;;) {
+        uint8_t op = img->bytes[at];
+        uint16_t imm = img->bytes[at + 1] | (img->bytes[at + 2] << 8);
+        int len = op_len(op);
+        if (len == 2) imm &= 0xFF;
+        else if (len == 1) imm = 0;
+        uint16_t next = at + len;
+        if (op_starts_block(op) && count > 0) {
+            fprintf(out, "    cpu->pc = 0x%04X;\n    return %u;\n", (uint16_t)at, cycles);
+            break;
+        }
+        count++;
+
+        if (op_ends_block(op)) {
+            emit_end(out, op, imm, next, cycles);
+            at += len;
+            break;
+        }
+        emit_op(out, op, imm, &cycles);
+        at += len;
+        if (count == CPU8080_TCACHE_UOPS) {
+            fprintf(out, "    cpu->pc = 0x%04X;\n    return %u;\n", next, cycles);
+            break;
+        }
+        // Leave on the next instruction if the write hit the block's pages
+        if (may_write(op)) {
+            fprintf(out, "    if (!block_valid(bus, blk)) {\n"
+                         "        cpu->pc = 0x%04X;\n"
+                         "        cpu->block_done = %d;\n"
+                         "        return %u;\n"
+                         "    }\n",
+                    next, count, cycles);
+        }
+    }
+    fprintf(out, "}\n\n");
+    *end = at;
+}
+
+static void emit(FILE *out) {
+    fprintf(out, "// Generated by aot8080, do not edit\n\n"
+                 "#include \"cpu8080.h\"\n"
+                 "#include \"cpu8080_ops.h\"\n"
+                 "#include \"cpu8080_aot.h\"\n\n");
+
+    for (int i = 0; i < image_count; i++) {
+        image_t *img = images[i];
+        static uint16_t ends[MEMORY_SIZE];
+        uint32_t count = 0;
+
+        fprintf(out, "// %s: %u bytes at %04X\n\n", img->name, img->size, img->base);
+        for (uint32_t a = img->base; a < img->base + img->size; a++) {
+            if (img->block[a]) {
+                emit_block(out, img, a, &ends[a]);
+                count++;
+            }
+        }
+
+        fprintf(out, "static const uint8_t %s_bytes[%u] = {", img->name, img->size);
+        for (uint32_t n = 0; n < img->size; n++) {
+            fprintf(out, "%s0x%02X,", n % 12 ? " " : "\n    ", img->bytes[img->base + n]);
+        }
+        fprintf(out, "\n};\n\n");
+
+        fprintf(out, "static const cpu8080_aot_block_t %s_blocks[%u] = {\n", img->name, count ? count : 1);
+        for (uint32_t a = img->base; a < img->base + img->size; a++) {
+            if (img->block[a]) {
+                fprintf(out, "    { 0x%04X, 0x%04X, %s_%04X },\n", a, ends[a], img->name, a);
+            }
+        }
+        fprintf(out, "};\n\n");
+    }
+
+    fprintf(out, "const cpu8080_aot_image_t cpu8080_aot_images[%d] = {\n", image_count ? image_count : 1);
+    for (int i = 0; i < image_count; i++) {
+        const image_t *img = images[i];
+        uint32_t count = 0;
+        for (uint32_t a = img->base; a < img->base + img->size; a++) {
+            count += img->block[a];
+        }
+        fprintf(out, "    { \"%s\", 0x%04X, %u, %s_bytes, %s_blocks, %u },\n",
+                img->name, img->base, img->size, img->name, img->name, count);
+    }
+    fprintf(out, "};\n\nconst uint32_t cpu8080_aot_image_count = %d;\n", image_count);
+}
+
+int main(int argc, char **argv) {
+    const char *out_path = NULL;
+    bool programs = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:pe:h")) != -1) {
+        switch (opt) {
+            case 'o': out_path = optarg; break;
+            case 'p': programs = true; break;
+            case 'e':
+                if (entry_count < MAX_ENTRIES) entries[entry_count++] = strtoul(optarg, NULL, 16);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (programs) {
+        add_program("prog_counter", PROG_COUNTER_ADDR, prog_counter, PROG_COUNTER_SIZE);
+        add_program("prog_memfill", PROG_MEMFILL_ADDR, prog_memfill, PROG_MEMFILL_SIZE);
+        add_program("prog_fibonacci", PROG_FIBONACCI_ADDR, prog_fibonacci, PROG_FIBONACCI_SIZE);
+        add_program("prog_delay_count", PROG_DELAY_COUNT_ADDR, prog_delay_count, PROG_DELAY_COUNT_SIZE);
+        add_program("prog_stack_test", PROG_STACK_TEST_ADDR, prog_stack_test, PROG_STACK_TEST_SIZE);
+        add_program("prog_cpm_bios", PROG_CPM_BIOS_ADDR, prog_cpm_bios, PROG_CPM_BIOS_SIZE);
+        // The CCP and BDOS come from disk and call in through the jump table
+        for (uint16_t v = 0; v < 17 * 3 && entry_count < MAX_ENTRIES; v += 3) {
+            entries[entry_count++] = PROG_CPM_BIOS_ADDR + v;
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        if (!add_file(argv[i])) return 1;
+    }
+    // Files with the same name get numbered
+    for (int i = 1; i < image_count; i++) {
+        for (int j = 0; j < i; j++) {
+            if (strcmp(images[i]->name, images[j]->name) == 0) {
+                char name[sizeof(images[i]->name)];
+                snprintf(name, sizeof(name), "%.48s_%d", images[i]->name, i);
+                strcpy(images[i]->name, name);
+                break;
+            }
+        }
+    }
+
+    for (int i = 0; i < image_count; i++) {
+        image_t *img = images[i];
+        discover(img, img->base);
+        for (uint16_t v = 0; v < 0x40; v += 8) {
+            discover(img, v);
+        }
+        for (int e = 0; e < entry_count; e++) {
+            discover(img, entries[e]);
+        }
+    }
+
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    emit(out);
+    if (out != stdout && fclose(out) != 0) {
+        perror(out_path);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,457 @@
+/**
+ * Parallel batch runner
+ *
+ * Runs every image listed in a manifest, each on a freshly initialized
+ * machine, spread over a pool of threads, and streams one JSON line per
+ * image as it finishes (in completion order, "id" is the manifest order):
+ * exit reason, cycles, instructions, final registers and an FNV-1a hash of
+ * the 64K of RAM.
+ *
+ * Manifest lines are IMAGE [LOAD [START [CYCLES]]]. LOAD and START are hex
+ * ("-" for the default: 0, and the load address or HEX start record),
+ * CYCLES is the limit for that image (default -n). Relative image paths are
+ * taken from the manifest's directory, '#' starts a comment.
+ *
+ * With -S every image is also run in stretches of CYCLES from a snapshot
+ * (snapshot.h): each stretch is run, the snapshot restored and the stretch
+ * run again, and the image fails ("exit":"snapshot_mismatch", exit status
+ * 1) unless both runs end in the same registers, counts and RAM.
+ *
+ * Each thread keeps one machine (bus, CPU, translation cache, JIT arena)
+ * that it resets for every image, so tasks share nothing but the output.
+ * Tasks are handed out as one contiguous range per thread; a thread that
+ * runs out steals the upper half of another thread's range.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "cpu8080.h"
+#include "memory.h"
+#include "snapshot.h"
+#include "image.h"
+#if CPU8080_JIT
+#include "cpu8080_jit.h"
+#endif
+
+#define DEFAULT_CYCLES 100000000ull
+#define RUN_CHUNK_CYCLES (1u << 24)
+#define LINE_MAX_LEN 4096
+// Every frame once for the store's base and once more for the frames a
+// stretch writes, plus their use counts
+#define SNAPSHOT_POOL_SIZE (2u * MEMORY_FRAMES * (MEMORY_PAGE_SIZE + sizeof(uint16_t)) + 1)
+
+typedef struct {
+    char *image;        // as given in the manifest, for the output
+    char *path;         // to open
+    uint16_t load;
+    int32_t start;      // -1 for the image's own
+    uint64_t cycles;    // 0 for no limit
+} task_t;
+
+typedef struct {
+    bus_t bus;
+    cpu8080_t cpu;
+#if CPU8080_TCACHE
+    cpu8080_tcache_t tcache;
+#endif
+#if CPU8080_JIT
+    cpu8080_jit_t jit;
+#endif
+    snapshot_store_t store;
+    snapshot_t snap;
+    uint8_t pool[SNAPSHOT_POOL_SIZE];
+} machine_t;
+
+// Own cache line each, so taking a task doesn't bounce other threads' lines
+typedef struct {
+    _Alignas(64) _Atomic uint64_t range;    // next task in the low half, end in the high
+    pthread_t thread;
+    uint64_t cycles;    // run by this thread
+} worker_t;
+
+static task_t *tasks;
+static uint32_t task_count;
+static worker_t *workers;
+static int worker_count;
+static int engine = 2;          // 0 interpreter, 1 translation cache, 2 with the JIT
+static uint32_t snapshot_cycles;    // -S, 0 for no snapshot checks
+static FILE *out;
+static pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int load_errors;
+static atomic_int mismatches;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] MANIFEST\n"
+            "\n"
+            "  -t N       threads (default: one per online CPU)\n"
+            "  -n CYCLES  cycle limit for images that don't give one (default %llu, 0 for none)\n"
+            "  -o FILE    write results to FILE instead of stdout\n"
+            "  -i         plain interpreter, no translation cache\n"
+            "  -j         translation cache without the JIT\n"
+            "  -S CYCLES  check snapshot restores every CYCLES cycles\n",
+            prog, DEFAULT_CYCLES);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// --- Manifest ---
+
+static char *join_path(const char *dir, size_t dir_len, const char *name) {
+    size_t n = strlen(name);
+    char *p = malloc(dir_len + n + 1);
+    if (!p) return NULL;
+    memcpy(p, dir, dir_len);
+    memcpy(p + dir_len, name, n + 1);
+    return p;
+}
+
+static bool parse_manifest(const char *path, uint64_t default_cycles) {
+    uint32_t size;
+    char *text = (char *)image_read_file(path, &size);
+    if (!text) {
+        perror(path);
+        return false;
+    }
+    char *t = realloc(text, size + 1);
+    if (!t) {
+        free(text);
+        return false;
+    }
+    text = t;
+    text[size] = '\0';
+
+    const char *slash = strrchr(path, '/');
+    size_t dir_len = slash ? (size_t)(slash - path + 1) : 0;
+    uint32_t cap = 0;
+    int line_no = 0;
+
+    for (char *line = text, *next; line; line = next) {
+        next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        line_no++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char *field[4] = { NULL };
+        int n = 0;
+        char *fsave = NULL;
+        for (char *f = strtok_r(line, " \t\r", &fsave); f; f = strtok_r(NULL, " \t\r", &fsave)) {
+            if (n == 4) {
+                fprintf(stderr, "%s:%d: too many fields\n", path, line_no);
+                free(text);
+                return false;
+            }
+            field[n++] = f;
+        }
+        if (n == 0) continue;
+
+        if (task_count == cap) {
+            cap = cap ? cap * 2 : 256;
+            task_t *p = realloc(tasks, cap * sizeof(task_t));
+            if (!p) {
+                free(text);
+                return false;
+            }
+            tasks = p;
+        }
+        task_t *task = &tasks[task_count++];
+        task->image = strdup(field[0]);
+        task->path = field[0][0] == '/' ? strdup(field[0]) : join_path(path, dir_len, field[0]);
+        task->load = n > 1 && strcmp(field[1], "-") != 0 ? strtoul(field[1], NULL, 16) & 0xFFFF : 0;
+        task->start = n > 2 && strcmp(field[2], "-") != 0 ? (int32_t)(strtoul(field[2], NULL, 16) & 0xFFFF) : -1;
+        task->cycles = n > 3 ? strtoull(field[3], NULL, 0) : default_cycles;
+        if (!task->image || !task->path) {
+            free(text);
+            return false;
+        }
+    }
+    free(text);
+    return true;
+}
+
+// --- Output ---
+
+// Append s as a JSON string
+static int json_string(char *buf, int size, const char *s) {
+    int n = 0;
+    buf[n++] = '"';
+    for (; *s && n < size - 8; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            buf[n++] = '\\';
+            buf[n++] = c;
+        } else if (c < 0x20) {
+            n += snprintf(buf + n, size - n, "\\u%04x", c);
+        } else {
+            buf[n++] = c;
+        }
+    }
+    buf[n++] = '"';
+    buf[n] = '\0';
+    return n;
+}
+
+static uint64_t fnv1a(const uint8_t *data, uint32_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (uint32_t i = 0; i < len; i++) {
+        h = (h ^ data[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+static void emit(const char *line) {
+    pthread_mutex_lock(&out_lock);
+    fputs(line, out);
+    fflush(out);
+    pthread_mutex_unlock(&out_lock);
+}
+
+// --- Running ---
+
+// What a run is compared on after a snapshot restore, all 64-bit so it
+// compares with memcmp()
+typedef struct {
+    uint64_t ran;
+    uint64_t regs;      // A F B C D E H L, A lowest
+    uint64_t sp_pc;     // SP, PC, then halted and inte
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t mem;
+} outcome_t;
+
+static outcome_t run_outcome(machine_t *m, uint32_t budget) {
+    cpu8080_t *cpu = &m->cpu;
+    outcome_t o;
+    o.ran = cpu8080_run(cpu, budget);
+    uint8_t regs[8] = { cpu->a, cpu8080_get_f(cpu), cpu->b, cpu->c, cpu->d, cpu->e, cpu->h, cpu->l };
+    o.regs = 0;
+    for (int i = 7; i >= 0; i--) {
+        o.regs = (o.regs << 8) | regs[i];
+    }
+    o.sp_pc = cpu->sp | ((uint64_t)cpu->pc << 16) | ((uint64_t)cpu->halted << 32) | ((uint64_t)cpu->inte << 33);
+    o.cycles = cpu->cycles;
+    o.instructions = cpu->instructions;
+    o.mem = fnv1a(m->bus.ram, MEMORY_SIZE);
+    return o;
+}
+
+// Run budget cycles from a snapshot twice. Returns the cycles run, or 0 if
+// the runs differ or the snapshot couldn't be taken.
+static uint32_t run_twice(machine_t *m, uint32_t budget) {
+    if (!snapshot_take(&m->store, &m->snap, &m->cpu)) return 0;
+    outcome_t first = run_outcome(m, budget);
+    snapshot_restore(&m->store, &m->snap, &m->cpu);
+    outcome_t again = run_outcome(m, budget);
+    return memcmp(&first, &again, sizeof(first)) == 0 ? first.ran : 0;
+}
+
+static void run_task(machine_t *m, uint32_t id, worker_t *self) {
+    const task_t *task = &tasks[id];
+    char line[LINE_MAX_LEN + 512];
+    int n = snprintf(line, sizeof(line), "{\"id\":%u,\"image\":", id);
+    n += json_string(line + n, LINE_MAX_LEN, task->image);
+
+    cpu8080_t *cpu = &m->cpu;
+    memory_init(&m->bus);
+    cpu8080_init(cpu, &m->bus);
+    cpu->tcache = NULL;
+#if CPU8080_TCACHE
+    if (engine > 0) {
+        cpu8080_attach_tcache(cpu, &m->tcache);
+    }
+#endif
+#if CPU8080_JIT
+    if (engine > 1 && m->jit.code) {
+        cpu8080_attach_jit(cpu, &m->jit);
+    }
+#endif
+
+    int32_t start = -1;
+    if (!image_load(&m->bus, task->path, task->load, &start)) {
+        atomic_fetch_add(&load_errors, 1);
+        snprintf(line + n, sizeof(line) - n, ",\"exit\":\"load_error\"}\n");
+        emit(line);
+        return;
+    }
+    if (task->start >= 0) start = task->start;
+    cpu->pc = start < 0 ? 0 : start;
+
+    if (snapshot_cycles) {
+        snapshot_store_init(&m->store, &m->bus, m->pool, sizeof(m->pool));
+        snapshot_init(&m->snap);
+    }
+
+    uint64_t cycles = 0;
+    bool mismatch = false;
+    while (!cpu->halted && (task->cycles == 0 || cycles < task->cycles)) {
+        uint32_t budget = snapshot_cycles ? snapshot_cycles : RUN_CHUNK_CYCLES;
+        if (task->cycles > 0 && task->cycles - cycles < budget) budget = task->cycles - cycles;
+        if (!snapshot_cycles) {
+            cycles += cpu8080_run(cpu, budget);
+            continue;
+        }
+        uint32_t ran = run_twice(m, budget);
+        if (ran == 0) {
+            mismatch = true;
+            atomic_fetch_add(&mismatches, 1);
+            break;
+        }
+        cycles += ran;
+    }
+    self->cycles += cycles;
+
+    snprintf(line + n, sizeof(line) - n,
+             ",\"exit\":\"%s\",\"cycles\":%llu,\"instructions\":%llu,"
+             "\"a\":%u,\"f\":%u,\"b\":%u,\"c\":%u,\"d\":%u,\"e\":%u,\"h\":%u,\"l\":%u,"
+             "\"sp\":%u,\"pc\":%u,\"mem_fnv1a\":\"%016llx\"}\n",
+             mismatch ? "snapshot_mismatch" : cpu->halted ? "halt" : "cycle_limit",
+             (unsigned long long)cycles,
+             (unsigned long long)cpu->instructions, cpu->a, cpu8080_get_f(cpu), cpu->b, cpu->c,
+             cpu->d, cpu->e, cpu->h, cpu->l, cpu->sp, cpu->pc,
+             (unsigned long long)fnv1a(m->bus.ram, MEMORY_SIZE));
+    emit(line);
+}
+
+static inline uint64_t pack(uint32_t next, uint32_t end) {
+    return ((uint64_t)end << 32) | next;
+}
+
+// Take the next task from the front of w's own range
+static bool take(worker_t *w, uint32_t *id) {
+    uint64_t r = atomic_load(&w->range);
+    for (;;) {
+        uint32_t next = (uint32_t)r, end = r >> 32;
+        if (next >= end) return false;
+        if (atomic_compare_exchange_weak(&w->range, &r, pack(next + 1, end))) {
+            *id = next;
+            return true;
+        }
+    }
+}
+
+// Move the upper half of some other thread's range into self's, which is
+// empty. Only fails once every range is empty; tasks being moved by another
+// thief are run by that thief.
+static bool steal(worker_t *self) {
+    int me = self - workers;
+    for (int k = 1; k < worker_count; k++) {
+        worker_t *victim = &workers[(me + k) % worker_count];
+        uint64_t r = atomic_load(&victim->range);
+        for (;;) {
+            uint32_t next = (uint32_t)r, end = r >> 32;
+            if (next >= end) break;
+            uint32_t mid = end - (end - next + 1) / 2;
+            if (atomic_compare_exchange_weak(&victim->range, &r, pack(next, mid))) {
+                atomic_store(&self->range, pack(mid, end));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void *worker_main(void *arg) {
+    worker_t *self = arg;
+    // Allocated here so the pages are local to the thread that uses them
+    machine_t *m = malloc(sizeof(machine_t));
+    if (!m) {
+        perror("machine");
+        return NULL;
+    }
+#if CPU8080_JIT
+    m->jit.code = NULL;
+    if (engine > 1) {
+        cpu8080_jit_init(&m->jit, CPU8080_JIT_DEFAULT_ARENA);
+    }
+#endif
+
+    uint32_t id;
+    do {
+        while (take(self, &id)) {
+            run_task(m, id, self);
+        }
+    } while (steal(self));
+
+#if CPU8080_JIT
+    cpu8080_jit_free(&m->jit);
+#endif
+    free(m);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    uint64_t cycles = DEFAULT_CYCLES;
+    const char *out_path = NULL;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:n:o:ijS:h")) != -1) {
+        switch (opt) {
+            case 't': threads = atol(optarg); break;
+            case 'n': cycles = strtoull(optarg, NULL, 0); break;
+            case 'o': out_path = optarg; break;
+            case 'i': engine = 0; break;
+            case 'j': engine = 1; break;
+            case 'S': snapshot_cycles = strtoul(optarg, NULL, 0); break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind != argc - 1 || threads < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!parse_manifest(argv[optind], cycles)) return 1;
+    out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+
+    worker_count = threads > (long)task_count ? (task_count ? (int)task_count : 1) : (int)threads;
+    workers = aligned_alloc(64, sizeof(worker_t) * worker_count);
+    if (!workers) {
+        perror("workers");
+        return 1;
+    }
+    for (int i = 0; i < worker_count; i++) {
+        uint32_t lo = (uint64_t)task_count * i / worker_count;
+        uint32_t hi = (uint64_t)task_count * (i + 1) / worker_count;
+        atomic_init(&workers[i].range, pack(lo, hi));
+        workers[i].cycles = 0;
+    }
+
+    double t0 = now_seconds();
+    for (int i = 0; i < worker_count; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    uint64_t total = 0;
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+        total += workers[i].cycles;
+    }
+    double elapsed = now_seconds() - t0;
+
+    if (out != stdout) fclose(out);
+    fprintf(stderr, "%u images on %d threads: %llu cycles in %.2f s, %.1f emulated MHz in total\n",
+            task_count, worker_count, (unsigned long long)total, elapsed,
+            elapsed > 0 ? total / elapsed / 1e6 : 0.0);
+    return atomic_load(&load_errors) || atomic_load(&mismatches) ? 1 : 0;
+}
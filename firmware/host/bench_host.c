@@ -0,0 +1,183 @@
+/**
+ * Host benchmark runner
+ *
+ * Runs the bench.h workloads with every engine of this build and prints
+ * the results as JSON on stdout, with a readable table on stderr. Results
+ * can be checked against a baseline file, and results captured from the
+ * node or RP2040 runners can be checked the same way without running
+ * anything here. Exits with 1 if a result is slower than the baseline by
+ * more than the threshold.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define DEFAULT_CYCLES 20000000ull
+#define DEFAULT_REPEAT 3
+#define DEFAULT_THRESHOLD 10.0  // percent
+#define MAX_RESULTS 64
+
+typedef struct {
+    char workload[32];
+    char engine[16];
+    double mhz;
+} entry_t;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "\n"
+            "  -c CYCLES  cycle budget for workloads that don't halt (default %llu)\n"
+            "  -r N       runs per result, the fastest is kept (default %d)\n"
+            "  -w NAME    only this workload\n"
+            "  -e NAME    only this engine (interp, tcache, jit, aot, lanes)\n"
+            "  -b FILE    compare against baseline results in FILE\n"
+            "  -t PCT     allowed slowdown against the baseline (default %.0f%%)\n"
+            "  -C FILE    compare results in FILE (from any runner) instead of running\n",
+            prog, DEFAULT_CYCLES, DEFAULT_REPEAT, DEFAULT_THRESHOLD);
+}
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Read the result lines of a JSON file written by any runner
+static int load_results(const char *path, entry_t *out, int max) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    int n = 0;
+    while (n < max && getline(&line, &cap, f) != -1) {
+        entry_t *e = &out[n];
+        if (bench_parse_line(line, e->workload, sizeof(e->workload),
+                             e->engine, sizeof(e->engine), &e->mhz)) {
+            n++;
+        }
+    }
+    free(line);
+    fclose(f);
+    return n;
+}
+
+// Returns the number of results slower than the baseline allows
+static int compare(const entry_t *cur, int n, const entry_t *base, int base_n, double threshold) {
+    int regressions = 0;
+    fprintf(stderr, "\n%-12s %-7s %12s %12s %8s\n", "workload", "engine", "baseline", "now", "change");
+    for (int i = 0; i < n; i++) {
+        const entry_t *b = NULL;
+        for (int j = 0; j < base_n; j++) {
+            if (strcmp(base[j].workload, cur[i].workload) == 0 &&
+                strcmp(base[j].engine, cur[i].engine) == 0) {
+                b = &base[j];
+                break;
+            }
+        }
+        if (!b || b->mhz <= 0) {
+            fprintf(stderr, "%-12s %-7s %12s %10.2f MHz\n", cur[i].workload, cur[i].engine,
+                    "-", cur[i].mhz);
+            continue;
+        }
+        double change = (cur[i].mhz / b->mhz - 1) * 100;
+        bool slow = change < -threshold;
+        fprintf(stderr, "%-12s %-7s %8.2f MHz %8.2f MHz %+7.1f%%%s\n", cur[i].workload,
+                cur[i].engine, b->mhz, cur[i].mhz, change, slow ? "  REGRESSION" : "");
+        regressions += slow;
+    }
+    return regressions;
+}
+
+int main(int argc, char **argv) {
+    uint64_t cycles = DEFAULT_CYCLES;
+    int repeat = DEFAULT_REPEAT;
+    double threshold = DEFAULT_THRESHOLD;
+    const char *only_workload = NULL;
+    const char *only_engine = NULL;
+    const char *baseline = NULL;
+    const char *results = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:r:w:e:b:t:C:h")) != -1) {
+        switch (opt) {
+            case 'c': cycles = strtoull(optarg, NULL, 0); break;
+            case 'r': repeat = atoi(optarg); break;
+            case 'w': only_workload = optarg; break;
+            case 'e': only_engine = optarg; break;
+            case 'b': baseline = optarg; break;
+            case 't': threshold = atof(optarg); break;
+            case 'C': results = optarg; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind != argc || cycles == 0 || repeat < 1 || (results && !baseline)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    entry_t cur[MAX_RESULTS];
+    int n = 0;
+
+    if (results) {
+        n = load_results(results, cur, MAX_RESULTS);
+        if (n < 0) return 1;
+    } else {
+        bool first = true;
+        fprintf(stderr, "%-12s %-7s %12s %12s %10s %10s\n", "workload", "engine", "cycles",
+                "insns", "ns/insn", "MHz");
+        bench_json_begin("host", cycles, repeat);
+        for (int i = 0; i < bench_workload_count; i++) {
+            const bench_workload_t *w = &bench_workloads[i];
+            if (only_workload && strcmp(only_workload, w->name) != 0) continue;
+            for (int e = 0; e < BENCH_ENGINES; e++) {
+                if (only_engine && strcmp(only_engine, bench_engine_name(e)) != 0) continue;
+                if (!bench_engine_available(e)) continue;
+
+                bench_result_t r;
+                bench_run(w, e, cycles, repeat, clock_ns, &r);
+                bench_json_result(w, e, &r, first);
+                fflush(stdout);
+                first = false;
+
+                double mhz = r.ns ? r.cycles * 1e3 / r.ns : 0;
+                fprintf(stderr, "%-12s %-7s %12llu %12llu %10.3f %10.2f%s\n", w->name,
+                        bench_engine_name(e), (unsigned long long)r.cycles,
+                        (unsigned long long)r.instructions,
+                        r.instructions ? (double)r.ns / r.instructions : 0.0, mhz,
+                        w->halts && !r.halted ? "  (budget hit before HLT)" : "");
+                if (n < MAX_RESULTS) {
+                    snprintf(cur[n].workload, sizeof(cur[n].workload), "%s", w->name);
+                    snprintf(cur[n].engine, sizeof(cur[n].engine), "%s", bench_engine_name(e));
+                    cur[n].mhz = mhz;
+                    n++;
+                }
+            }
+        }
+        bench_json_end();
+    }
+
+    if (!baseline) return 0;
+
+    entry_t base[MAX_RESULTS];
+    int base_n = load_results(baseline, base, MAX_RESULTS);
+    if (base_n < 0) return 1;
+    int regressions = compare(cur, n, base, base_n, threshold);
+    if (regressions) {
+        fprintf(stderr, "%d result(s) more than %.0f%% slower than %s\n", regressions,
+                threshold, baseline);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,256 @@
+/**
+ * CPU conformance runner
+ *
+ * Runs CP/M 8080 exercisers (TST8080, 8080PRE, 8080EXM, ...) loaded at
+ * 0100 under a minimal BDOS: console output functions 2 and 9, and a
+ * warm boot (JMP 0000) that ends the program. Console output is echoed
+ * and checked afterwards, per test group where the program reports
+ * groups ("... PASS!" / "... ERROR"), otherwise for the program as a
+ * whole. Exits with 1 if anything failed.
+ *
+ * The BDOS entry and the warm boot vector hold HLT, so the program runs
+ * on the same engines as the emulator (interpreter, translation cache and
+ * JIT) rather than with a breakpoint that would keep it on the
+ * interpreter.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "microcomputer.h"
+
+#define TPA_START 0x0100
+#define BDOS_ENTRY 0x0005
+#define BDOS_TOP 0xFE00         // reported at 0006 as the top of the TPA
+#define RUN_CHUNK_CYCLES (1u << 24)
+#define OUTPUT_MAX (1u << 20)
+
+static emulator_t emu;
+
+typedef struct {
+    char *text;
+    uint32_t len;
+    bool echo;
+} console_t;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] PROGRAM.COM...\n"
+            "\n"
+            "  -i         plain interpreter, no translation cache\n"
+            "  -j         translation cache without the JIT\n"
+            "  -n CYCLES  give up on a program after CYCLES cycles (default: no limit)\n"
+            "  -q         don't echo console output\n",
+            prog);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void console_put(console_t *con, char c) {
+    if (con->echo) {
+        putchar(c);
+    }
+    if (con->len < OUTPUT_MAX - 1) {
+        con->text[con->len++] = c;
+        con->text[con->len] = '\0';
+    }
+}
+
+// BDOS call with the function in C. Only console output is provided.
+static void bdos(cpu8080_t *cpu, console_t *con) {
+    switch (cpu->c) {
+        case 2:
+            console_put(con, cpu->e);
+            break;
+        case 9:
+            for (uint16_t addr = cpu8080_get_de(cpu), n = 0; n < 0xFFFF; addr++, n++) {
+                char c = memory_read(cpu->bus, addr);
+                if (c == '$') break;
+                console_put(con, c);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static bool load_com(const char *path, bus_t *bus) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    uint8_t buf[BDOS_TOP - TPA_START];
+    size_t n = fread(buf, 1, sizeof(buf), f);
+    bool too_big = fgetc(f) != EOF;
+    fclose(f);
+    if (too_big) {
+        fprintf(stderr, "%s: too big for the TPA\n", path);
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        memory_write(bus, TPA_START + i, buf[i]);
+    }
+    return true;
+}
+
+static bool contains(const char *text, const char *word) {
+    size_t n = strlen(word);
+    for (; *text; text++) {
+        if (strncasecmp(text, word, n) == 0) return true;
+    }
+    return false;
+}
+
+// Print a line per test group and return the number that failed
+static int report_groups(const char *name, const char *text, bool finished) {
+    int groups = 0, failed = 0;
+    const char *line = text;
+
+    while (*line) {
+        const char *end = strpbrk(line, "\r\n");
+        size_t len = end ? (size_t)(end - line) : strlen(line);
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%.*s", (int)(len < sizeof(buf) ? len : sizeof(buf) - 1), line);
+
+        // A group result is its name, a row of dots, then PASS! or ERROR
+        char *dots = strstr(buf, "..");
+        bool pass = dots && strstr(dots, "PASS!") != NULL;
+        bool error = dots && strstr(dots, "ERROR") != NULL;
+        if (pass || error) {
+            *dots = '\0';
+            printf("  %-4s %s\n", pass && !error ? "PASS" : "FAIL", buf);
+            groups++;
+            failed += !(pass && !error);
+        }
+        line += len;
+        while (*line == '\r' || *line == '\n') line++;
+    }
+
+    // No groups reported: judge the program by its closing message
+    if (groups == 0) {
+        bool pass = finished && !contains(text, "FAIL") && !contains(text, "ERROR") &&
+                    (contains(text, "OPERATIONAL") || contains(text, "COMPLETE"));
+        printf("  %-4s %s\n", pass ? "PASS" : "FAIL", name);
+        return !pass;
+    }
+    if (!finished) {
+        printf("  FAIL %s did not finish\n", name);
+        failed++;
+    }
+    return failed;
+}
+
+// Run one program on a fresh machine. Returns the number of failures.
+static int run_program(const char *path, int engine, uint64_t limit, bool echo,
+                       uint64_t *total_cycles, uint64_t *total_insns) {
+    static char text[OUTPUT_MAX];
+    console_t con = { text, 0, echo };
+    text[0] = '\0';
+
+    emulator_init(&emu);
+    cpu8080_t *cpu = &emu.cpu;
+    if (engine == 0) {
+        cpu->tcache = NULL;
+    }
+#if CPU8080_JIT
+    if (engine == 1) {
+        emu.tcache.jit = NULL;
+    }
+#endif
+
+    bus_t *bus = &emu.bus;
+    if (!load_com(path, bus)) {
+#if CPU8080_JIT
+        cpu8080_jit_free(&emu.jit);
+#endif
+        return 1;
+    }
+    memory_write(bus, 0x0000, 0x76);                    // warm boot: HLT
+    memory_write(bus, BDOS_ENTRY, 0x76);                // BDOS: HLT
+    memory_write(bus, BDOS_ENTRY + 1, BDOS_TOP & 0xFF);
+    memory_write(bus, BDOS_ENTRY + 2, BDOS_TOP >> 8);
+    cpu->pc = TPA_START;
+    cpu->sp = BDOS_TOP;
+
+    uint64_t cycles = 0;
+    bool finished = false;
+    double t0 = now_seconds();
+    while (limit == 0 || cycles < limit) {
+        uint32_t budget = RUN_CHUNK_CYCLES;
+        if (limit > 0 && limit - cycles < budget) budget = limit - cycles;
+        cycles += cpu8080_run(cpu, budget);
+        if (!cpu->halted) continue;
+
+        if (cpu->pc == BDOS_ENTRY + 1) {
+            // Serve the call and return to the caller
+            bdos(cpu, &con);
+            cpu->halted = false;
+            cpu->pc = memory_read(bus, cpu->sp) | (memory_read(bus, cpu->sp + 1) << 8);
+            cpu->sp += 2;
+        } else {
+            finished = cpu->pc == 0x0001;
+            break;
+        }
+    }
+    double elapsed = now_seconds() - t0;
+    fflush(stdout);
+
+    printf("\n%s: %s after %llu cycles, %llu instructions in %.2f s (%.2f emulated MHz)\n",
+           path, finished ? "finished" : cpu->halted ? "halted unexpectedly" : "stopped",
+           (unsigned long long)cycles, (unsigned long long)cpu->instructions, elapsed,
+           elapsed > 0 ? cycles / elapsed / 1e6 : 0.0);
+    int failed = report_groups(path, text, finished);
+
+#if CPU8080_JIT
+    cpu8080_jit_free(&emu.jit);
+#endif
+    *total_cycles += cycles;
+    *total_insns += cpu->instructions;
+    return failed;
+}
+
+int main(int argc, char **argv) {
+    int engine = 2;     // 0 interpreter, 1 translation cache, 2 with the JIT
+    uint64_t limit = 0;
+    bool echo = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "ijn:qh")) != -1) {
+        switch (opt) {
+            case 'i': engine = 0; break;
+            case 'j': engine = 1; break;
+            case 'n': limit = strtoull(optarg, NULL, 0); break;
+            case 'q': echo = false; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind == argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int failed = 0;
+    uint64_t cycles = 0, insns = 0;
+    double t0 = now_seconds();
+    for (int i = optind; i < argc; i++) {
+        failed += run_program(argv[i], engine, limit, echo, &cycles, &insns);
+    }
+    double elapsed = now_seconds() - t0;
+
+    printf("\n%s: %llu cycles, %llu instructions, %.2f s wall time\n",
+           failed ? "FAILED" : "PASSED", (unsigned long long)cycles,
+           (unsigned long long)insns, elapsed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,393 @@
+/**
+ * Differential engine test
+ *
+ * Runs the same code with every engine of this build and checks each ends
+ * exactly where cpu8080_step(), one instruction at a time, ends after as
+ * many cycles: registers, flags, cycles, instruction count and the whole
+ * 64K of RAM. The code is the bench.h workloads, the images named on the
+ * command line, and memory filled with random bytes (no HLT) from a few
+ * seeds, which keeps writing over its own code.
+ *
+ * Engines are cpu8080_run() on the interpreter, on the translation cache,
+ * with the JIT, with the code translated ahead of time (the workloads are
+ * built in), and the lockstep lanes, one case per lane. Every case is also
+ * stepped with rewind recording and stepped all the way back, which must
+ * give the starting registers and RAM again.
+ *
+ * Prints a line per difference and exits with 1 if there was any.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpu8080.h"
+#include "memory.h"
+#include "rewind.h"
+#include "bench.h"
+#include "image.h"
+#if CPU8080_JIT
+#include "cpu8080_jit.h"
+#endif
+#include "cpu8080_lanes.h"
+
+#define DEFAULT_CYCLES 1000000u
+#define DEFAULT_SEEDS 16
+#define REWIND_STEPS 20000
+#define REWIND_ENTRY_MAX 27
+#define NAME_MAX_LEN 64
+
+typedef struct {
+    char name[NAME_MAX_LEN];
+    uint8_t *ram;       // memory before the first instruction
+    uint16_t pc;
+} case_t;
+
+// Where a run ended
+typedef struct {
+    uint8_t regs[8];    // A F B C D E H L
+    uint16_t sp, pc;
+    bool halted;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint8_t ram[MEMORY_SIZE];
+} state_t;
+
+typedef enum {
+    ENGINE_RUN,         // cpu8080_run(), no translation cache
+    ENGINE_TCACHE,
+    ENGINE_JIT,
+    ENGINE_AOT,
+    ENGINE_LANES,
+    ENGINE_COUNT
+} engine_t;
+
+static const char *const engine_names[ENGINE_COUNT] = { "run", "tcache", "jit", "aot", "lanes" };
+
+static bus_t bus;
+static cpu8080_t cpu;
+#if CPU8080_TCACHE
+static cpu8080_tcache_t tcache;
+#endif
+#if CPU8080_JIT
+static cpu8080_jit_t jit;
+#endif
+#if CPU8080_LANES
+static cpu8080_lanes_t lanes;
+static uint8_t lanes_ram[CPU8080_LANES * CPU8080_LANE_STRIDE];
+#endif
+static uint8_t rewind_buf[REWIND_STEPS * REWIND_ENTRY_MAX];
+static state_t start, want, got;
+
+static case_t *cases;
+static int case_count;
+static int failures;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] [IMAGE[@ADDR]...]\n"
+            "\n"
+            "  -n CYCLES  cycles per case and engine (default %u)\n"
+            "  -s N       random memory cases (default %d)\n"
+            "\n"
+            "IMAGE loads at ADDR (hex, default 0) and starts there or at its HEX\n"
+            "start record.\n",
+            prog, DEFAULT_CYCLES, DEFAULT_SEEDS);
+}
+
+// --- Cases ---
+
+static case_t *add_case(const char *name) {
+    case_t *p = realloc(cases, (case_count + 1) * sizeof(case_t));
+    if (!p) return NULL;
+    cases = p;
+    case_t *c = &cases[case_count];
+    snprintf(c->name, sizeof(c->name), "%.*s", NAME_MAX_LEN - 1, name);
+    c->ram = malloc(MEMORY_SIZE);
+    if (!c->ram) return NULL;
+    case_count++;
+    return c;
+}
+
+static bool add_workload(const bench_workload_t *w) {
+    case_t *c = add_case(w->name);
+    if (!c) return false;
+    memory_init(&bus);
+    c->pc = w->load(&bus);
+    memcpy(c->ram, bus.ram, MEMORY_SIZE);
+    return true;
+}
+
+static bool add_image(const char *arg) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s", arg);
+    uint16_t addr = 0;
+    char *at = strrchr(path, '@');
+    if (at) {
+        *at = '\0';
+        addr = strtoul(at + 1, NULL, 16) & 0xFFFF;
+    }
+
+    int32_t start = -1;
+    memory_init(&bus);
+    if (!image_load(&bus, path, addr, &start)) {
+        perror(path);
+        return false;
+    }
+    const char *slash = strrchr(path, '/');
+    case_t *c = add_case(slash ? slash + 1 : path);
+    if (!c) return false;
+    c->pc = start < 0 ? addr : start;
+    memcpy(c->ram, bus.ram, MEMORY_SIZE);
+    return true;
+}
+
+// xorshift64, so cases are the same on every host
+static uint64_t next_random(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static bool add_random(int seed) {
+    char name[NAME_MAX_LEN];
+    snprintf(name, sizeof(name), "random_%d", seed);
+    case_t *c = add_case(name);
+    if (!c) return false;
+    uint64_t s = 0x9E3779B97F4A7C15ull * (seed + 1);
+    for (uint32_t a = 0; a < MEMORY_SIZE; a++) {
+        uint8_t b = next_random(&s) >> 32;
+        c->ram[a] = b == 0x76 ? 0x00 : b;
+    }
+    c->pc = 0;
+    return true;
+}
+
+// --- Running ---
+
+static void start_case(const case_t *c) {
+    memory_init(&bus);
+    memcpy(bus.ram, c->ram, MEMORY_SIZE);
+    cpu8080_init(&cpu, &bus);
+    cpu.pc = c->pc;
+}
+
+static void capture(cpu8080_t *from, const uint8_t *ram, state_t *s) {
+    const uint8_t regs[8] = {
+        from->a, cpu8080_get_f(from), from->b, from->c,
+        from->d, from->e, from->h, from->l
+    };
+    memcpy(s->regs, regs, sizeof(regs));
+    s->sp = from->sp;
+    s->pc = from->pc;
+    s->halted = from->halted;
+    s->cycles = from->cycles;
+    s->instructions = from->instructions;
+    memcpy(s->ram, ram, MEMORY_SIZE);
+}
+
+// The reference: step c until it has used at least cycles cycles
+static void step_to(const case_t *c, uint64_t cycles, state_t *s) {
+    start_case(c);
+    cpu.tcache = NULL;
+    while (!cpu.halted && cpu.cycles < cycles) {
+        cpu8080_step(&cpu);
+    }
+    capture(&cpu, bus.ram, s);
+}
+
+static void report(const case_t *c, const char *engine, const char *what,
+                   uint64_t expected, uint64_t actual) {
+    printf("%s %s: %s is %llx, should be %llx\n", c->name, engine, what,
+           (unsigned long long)actual, (unsigned long long)expected);
+    failures++;
+}
+
+// Report every way s differs from want
+static void compare(const case_t *c, const char *engine, const state_t *s) {
+    static const char *const reg_names[8] = { "A", "F", "B", "C", "D", "E", "H", "L" };
+
+    if (want.cycles != s->cycles) report(c, engine, "cycles", want.cycles, s->cycles);
+    if (want.instructions != s->instructions) {
+        report(c, engine, "instructions", want.instructions, s->instructions);
+    }
+    for (int i = 0; i < 8; i++) {
+        if (want.regs[i] != s->regs[i]) report(c, engine, reg_names[i], want.regs[i], s->regs[i]);
+    }
+    if (want.sp != s->sp) report(c, engine, "SP", want.sp, s->sp);
+    if (want.pc != s->pc) report(c, engine, "PC", want.pc, s->pc);
+    if (want.halted != s->halted) report(c, engine, "halted", want.halted, s->halted);
+    for (uint32_t a = 0; a < MEMORY_SIZE; a++) {
+        if (want.ram[a] != s->ram[a]) {
+            char what[16];
+            snprintf(what, sizeof(what), "[%04X]", a);
+            report(c, engine, what, want.ram[a], s->ram[a]);
+            break;
+        }
+    }
+}
+
+// Check s against stepping c as far
+static void check(const case_t *c, const char *engine, const state_t *s) {
+    step_to(c, s->cycles, &want);
+    compare(c, engine, s);
+}
+
+static bool engine_available(engine_t engine) {
+    switch (engine) {
+        case ENGINE_RUN:
+            return true;
+        case ENGINE_TCACHE:
+            return CPU8080_TCACHE;
+        case ENGINE_JIT:
+#if CPU8080_JIT
+            return jit.code != NULL;
+#else
+            return false;
+#endif
+        case ENGINE_AOT:
+            return CPU8080_AOT;
+        case ENGINE_LANES:
+            return CPU8080_LANES > 0;
+        default:
+            return false;
+    }
+}
+
+static void run_cpu(const case_t *c, engine_t engine, uint32_t cycles) {
+    start_case(c);
+    cpu.tcache = NULL;
+#if CPU8080_TCACHE
+    if (engine != ENGINE_RUN) {
+        cpu8080_attach_tcache(&cpu, &tcache);
+    }
+#endif
+#if CPU8080_AOT
+    tcache.aot = engine == ENGINE_AOT;
+#endif
+#if CPU8080_JIT
+    if (engine == ENGINE_JIT) {
+        cpu8080_attach_jit(&cpu, &jit);
+    }
+#endif
+    cpu8080_run(&cpu, cycles);
+    capture(&cpu, bus.ram, &got);
+    check(c, engine_names[engine], &got);
+}
+
+#if CPU8080_LANES
+// Cases first to first + CPU8080_LANES in lanes of their own, the lanes
+// past the last case running it again
+static void run_lanes(int first, uint32_t cycles) {
+    cpu8080_lanes_init(&lanes, lanes_ram);
+    for (int lane = 0; lane < CPU8080_LANES; lane++) {
+        const case_t *c = &cases[first + lane < case_count ? first + lane : case_count - 1];
+        start_case(c);
+        memcpy(cpu8080_lane_ram(&lanes, lane), bus.ram, MEMORY_SIZE);
+        cpu8080_lane_set(&lanes, lane, &cpu);
+    }
+    cpu8080_lanes_run(&lanes, cycles);
+    for (int lane = 0; lane < CPU8080_LANES && first + lane < case_count; lane++) {
+        cpu8080_t l;
+        cpu8080_lane_get(&lanes, lane, &l);
+        l.cycles = lanes.cycles[lane];
+        l.instructions = lanes.instructions[lane];
+        capture(&l, cpu8080_lane_ram(&lanes, lane), &got);
+        check(&cases[first + lane], engine_names[ENGINE_LANES], &got);
+    }
+}
+#endif
+
+// Step forward recording, step back over all of it and compare with the start
+static void run_rewind(const case_t *c) {
+    rewind_t rw;
+    rewind_init(&rw, rewind_buf, sizeof(rewind_buf));
+    start_case(c);
+    cpu.tcache = NULL;
+    capture(&cpu, bus.ram, &start);
+
+    int steps = 0;
+    while (!cpu.halted && steps < REWIND_STEPS) {
+        rewind_record(&rw, &cpu);
+        cpu8080_step(&cpu);
+        steps++;
+    }
+    int back = 0;
+    while (rewind_step_back(&rw, &cpu)) {
+        back++;
+    }
+    if (back != steps) {
+        report(c, "rewind", "steps back", steps, back);
+        return;
+    }
+
+    capture(&cpu, bus.ram, &got);
+    got.instructions = start.instructions;  // not kept by the history
+    want = start;
+    compare(c, "rewind", &got);
+}
+
+int main(int argc, char **argv) {
+    uint32_t cycles = DEFAULT_CYCLES;
+    int seeds = DEFAULT_SEEDS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:h")) != -1) {
+        switch (opt) {
+            case 'n': cycles = strtoul(optarg, NULL, 0); break;
+            case 's': seeds = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    for (int i = 0; i < bench_workload_count; i++) {
+        if (!add_workload(&bench_workloads[i])) return 1;
+    }
+    for (int i = optind; i < argc; i++) {
+        if (!add_image(argv[i])) return 1;
+    }
+    for (int i = 0; i < seeds; i++) {
+        if (!add_random(i)) return 1;
+    }
+#if CPU8080_JIT
+    cpu8080_jit_init(&jit, CPU8080_JIT_DEFAULT_ARENA);
+#endif
+
+    for (int e = 0; e < ENGINE_COUNT; e++) {
+        if (!engine_available(e)) {
+            printf("%s: not in this build\n", engine_names[e]);
+            continue;
+        }
+        int before = failures;
+#if CPU8080_LANES
+        if (e == ENGINE_LANES) {
+            for (int first = 0; first < case_count; first += CPU8080_LANES) {
+                run_lanes(first, cycles);
+            }
+        } else
+#endif
+        {
+            for (int i = 0; i < case_count; i++) {
+                run_cpu(&cases[i], e, cycles);
+            }
+        }
+        printf("%s: %d cases, %s\n", engine_names[e], case_count,
+               failures == before ? "same as stepping" : "DIFFERENT");
+    }
+
+    int before = failures;
+    for (int i = 0; i < case_count; i++) {
+        run_rewind(&cases[i]);
+    }
+    printf("rewind: %d cases, %s\n", case_count, failures == before ? "round trips" : "DIFFERENT");
+
+#if CPU8080_JIT
+    cpu8080_jit_free(&jit);
+#endif
+    return failures ? 1 : 0;
+}
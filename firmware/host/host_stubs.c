@@ -0,0 +1,24 @@
+// Host versions of the Pico SDK calls the emulator uses. The LCD and LEDs
+// are the buffer-based ones from the web build.
+#define _POSIX_C_SOURCE 199309L
+#include "pico/stdlib.h"
+#include <time.h>
+
+uint64_t get_absolute_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t to_ms_since_boot(uint64_t t) {
+    return t / 1000;
+}
+
+uint64_t to_us_since_boot(uint64_t t) {
+    return t;
+}
+
+void sleep_ms(uint32_t ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
@@ -0,0 +1,185 @@
+#define _POSIX_C_SOURCE 200809L
+#include "image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+uint8_t *image_read_file(const char *path, uint32_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    uint8_t *data = NULL;
+    uint32_t len = 0, cap = 0;
+    size_t n;
+    do {
+        if (len == cap) {
+            cap = cap ? cap * 2 : 65536;
+            uint8_t *p = realloc(data, cap);
+            if (!p) {
+                free(data);
+                fclose(f);
+                return NULL;
+            }
+            data = p;
+        }
+        n = fread(data + len, 1, cap - len, f);
+        len += n;
+    } while (n > 0);
+    fclose(f);
+    *size = len;
+    return data;
+}
+
+static int hex_byte(const char *s) {
+    int v = 0;
+    for (int i = 0; i < 2; i++) {
+        char c = s[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= c - '0';
+        else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+        else return -1;
+    }
+    return v;
+}
+
+// Load Intel HEX records into memory. Sets *start from a start address
+// record, if there is one. Returns false on a malformed file.
+static bool load_hex(const char *path, const char *text, uint32_t size, bus_t *bus, int32_t *start) {
+    uint32_t pos = 0;
+    int line = 0;
+
+    while (pos < size) {
+        line++;
+        uint32_t end = pos;
+        while (end < size && text[end] != '\n') end++;
+        uint32_t len = end - pos;
+        while (len > 0 && (text[pos + len - 1] == '\r' || text[pos + len - 1] == ' ')) len--;
+
+        if (len > 0) {
+            const char *rec = text + pos;
+            uint8_t b[256 + 5];
+            int count;
+            if (rec[0] != ':' || len < 11 || (len - 1) % 2 != 0 ||
+                (count = hex_byte(rec + 1)) < 0 || len != 11 + 2u * count) {
+                fprintf(stderr, "%s:%d: not an Intel HEX record\n", path, line);
+                return false;
+            }
+            uint8_t sum = 0;
+            for (int i = 0; i < count + 5; i++) {
+                int v = hex_byte(rec + 1 + 2 * i);
+                if (v < 0) {
+                    fprintf(stderr, "%s:%d: bad hex digit\n", path, line);
+                    return false;
+                }
+                b[i] = v;
+                sum += v;
+            }
+            if (sum != 0) {
+                fprintf(stderr, "%s:%d: checksum mismatch\n", path, line);
+                return false;
+            }
+
+            uint16_t addr = (b[1] << 8) | b[2];
+            switch (b[3]) {
+                case 0x00:      // data
+                    if (addr + count > MEMORY_SIZE) {
+                        fprintf(stderr, "%s:%d: data past 64K\n", path, line);
+                        return false;
+                    }
+                    for (int i = 0; i < count; i++) {
+                        memory_write(bus, addr + i, b[4 + i]);
+                    }
+                    break;
+                case 0x01:      // end of file
+                    return true;
+                case 0x02:      // extended segment / linear address, must stay in 64K
+                case 0x04:
+                    if (count != 2 || b[4] || b[5]) {
+                        fprintf(stderr, "%s:%d: address past 64K\n", path, line);
+                        return false;
+                    }
+                    break;
+                case 0x03:      // start segment address, CS:IP
+                case 0x05:      // start linear address
+                    if (count != 4) {
+                        fprintf(stderr, "%s:%d: bad start address record\n", path, line);
+                        return false;
+                    }
+                    *start = (b[6] << 8) | b[7];
+                    break;
+                default:
+                    fprintf(stderr, "%s:%d: unknown record type %02X\n", path, line, b[3]);
+                    return false;
+            }
+        }
+        pos = end + 1;
+    }
+    return true;
+}
+
+static bool has_suffix(const char *s, const char *suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcasecmp(s + n - m, suffix) == 0;
+}
+
+
+bool image_load(bus_t *bus, const char *path, uint16_t load_addr, int32_t *start) {
+    uint32_t size;
+    uint8_t *image = image_read_file(path, &size);
+    if (!image) {
+        perror(path);
+        return false;
+    }
+
+    bool ok = true;
+    if (has_suffix(path, ".hex") || has_suffix(path, ".ihx")) {
+        ok = load_hex(path, (const char *)image, size, bus, start);
+    } else if (load_addr + size > MEMORY_SIZE) {
+        fprintf(stderr, "%s: %u bytes don't fit at %04X\n", path, size, load_addr);
+        ok = false;
+    } else {
+        for (uint32_t i = 0; i < size; i++) {
+            memory_write(bus, load_addr + i, image[i]);
+        }
+        if (*start < 0) *start = load_addr;
+    }
+    free(image);
+    return ok;
+}
+
+bool image_map_disk(disk_image_t *disk, const char *path) {
+    bool writable = true;
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        writable = false;
+        fd = open(path, O_RDONLY);
+    }
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    if (st.st_size == 0 || st.st_size > DISK_IMAGE_SIZE) {
+        fprintf(stderr, "%s: %lld bytes isn't an 8\" disk image (up to %u)\n", path,
+                (long long)st.st_size, DISK_IMAGE_SIZE);
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+    disk->data = data;
+    disk->size = st.st_size;
+    disk->write = writable ? disk_write_in_place : NULL;
+    disk->ctx = data;
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "disk.h"
+#include "memory.h"
+
+// Program images for the host runners: Intel HEX if the name ends in .hex
+// or .ihx, raw binary otherwise. Errors are reported on stderr.
+
+// Whole file in a malloc'd buffer, or NULL with errno set
+uint8_t *image_read_file(const char *path, uint32_t *size);
+
+// Load path into bus, a binary at load_addr. *start is set from a HEX
+// start address record, or to load_addr for a binary if it is still -1.
+bool image_load(bus_t *bus, const char *path, uint16_t load_addr, int32_t *start);
+
+// Map a disk image file (disk.h) shared, so sector writes go straight to
+// the file. Files that can't be opened for writing are write-protected.
+bool image_map_disk(disk_image_t *disk, const char *path);
+
+#endif
@@ -0,0 +1,191 @@
+/**
+ * Headless host runner
+ *
+ * Loads a binary or Intel HEX image, runs it at full speed until HLT or a
+ * cycle limit, and prints the final registers, cycles and throughput.
+ * The 88-2SIO console is stdout and stdin (newlines sent as CR). With disk
+ * images and no IMAGE it boots CP/M from drive A.
+ * Can also replay a session recorded by the web or Pico build, with the
+ * console output it produces on stdout.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+
+#include "microcomputer.h"
+#include "session.h"
+#include "image.h"
+#include "programs.h"
+
+// Cycles per cpu8080_run() call, between checks of the limit and console
+// transfers. Output fills the console ring in well under this.
+#define RUN_CHUNK_CYCLES (1u << 16)
+
+static emulator_t emu;
+static disk_image_t disks[DISK_DRIVES];
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] IMAGE\n"
+            "       %s [options] -d DISK [-d DISK...]\n"
+            "       %s [options] -r SESSION\n"
+            "\n"
+            "  -a ADDR    load address of a binary image (hex, default 0)\n"
+            "  -s ADDR    start address (hex, default the load address or HEX start record)\n"
+            "  -n CYCLES  stop after CYCLES cycles (default: run until HLT)\n"
+            "  -i         plain interpreter, no translation cache\n"
+            "  -d FILE    8\" disk image for the next drive, A: first (written in place)\n"
+            "  -r FILE    replay a recorded panel session instead of running an image\n"
+            "\n"
+            "IMAGE is Intel HEX if it ends in .hex or .ihx, raw binary otherwise.\n"
+            "Without one, disks boot CP/M 2.2 from the CCP and BDOS on drive A.\n",
+            prog, prog, prog);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Move console output to stdout and, once the 8080 has read what it had,
+// whatever stdin has ready. Returns false once stdin is at its end.
+static bool console_transfer(sio_t *sio, bool input) {
+    uint8_t buf[256];
+    uint32_t n;
+    while ((n = sio_host_read(sio, buf, sizeof(buf))) > 0) {
+        fwrite(buf, 1, n, stdout);
+    }
+    fflush(stdout);
+
+    struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    if (!input || !spsc_empty(&sio->rx) || poll(&pfd, 1, 0) <= 0) return input;
+    ssize_t len = read(STDIN_FILENO, buf, sizeof(buf));
+    if (len <= 0) return false;
+    for (ssize_t i = 0; i < len; i++) {
+        if (buf[i] == '\n') buf[i] = '\r';
+    }
+    sio_host_write(sio, buf, len);
+    return true;
+}
+
+static void print_state(cpu8080_t *cpu) {
+    uint8_t f = cpu8080_get_f(cpu);
+    printf("A=%02X F=%02X B=%02X C=%02X D=%02X E=%02X H=%02X L=%02X SP=%04X PC=%04X %s\n",
+           cpu->a, f, cpu->b, cpu->c, cpu->d, cpu->e, cpu->h, cpu->l, cpu->sp, cpu->pc,
+           cpu->halted ? "HLT" : "");
+}
+
+static int replay(const char *path) {
+    uint32_t size;
+    uint8_t *data = image_read_file(path, &size);
+    session_player_t play;
+    if (!data) {
+        perror(path);
+        return 1;
+    }
+    if (!session_play_start(&play, data, size)) {
+        fprintf(stderr, "%s: not a session recording\n", path);
+        free(data);
+        return 1;
+    }
+
+    uint64_t events = 0;
+    uint64_t span_us = 0;
+    double t0 = now_seconds();
+    while (!session_play_done(&play)) {
+        span_us = session_next_offset_us(&play);
+        emulator_replay_step(&emu, &play);
+        console_transfer(&emu.console, false);
+        events++;
+    }
+    double elapsed = now_seconds() - t0;
+
+    print_state(&emu.cpu);
+    printf("%llu events, %.3f s of panel time replayed in %.3f s\n",
+           (unsigned long long)events, span_us / 1e6, elapsed);
+    free(data);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    uint32_t load_addr = 0;
+    int32_t start = -1;
+    uint64_t limit = 0;
+    bool interpret = false;
+    const char *session = NULL;
+    const char *disk_paths[DISK_DRIVES];
+    int drives = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:s:n:id:r:h")) != -1) {
+        switch (opt) {
+            case 'a': load_addr = strtoul(optarg, NULL, 16) & 0xFFFF; break;
+            case 's': start = strtoul(optarg, NULL, 16) & 0xFFFF; break;
+            case 'n': limit = strtoull(optarg, NULL, 0); break;
+            case 'i': interpret = true; break;
+            case 'd':
+                if (drives == DISK_DRIVES) {
+                    fprintf(stderr, "at most %d disks\n", DISK_DRIVES);
+                    return 1;
+                }
+                disk_paths[drives++] = optarg;
+                break;
+            case 'r': session = optarg; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    bool boot_cpm = !session && drives > 0 && optind == argc;
+    if (session || boot_cpm ? optind != argc : optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    emulator_init(&emu);
+    if (interpret) {
+        emu.cpu.tcache = NULL;
+    }
+    if (session) {
+        return replay(session);
+    }
+
+    for (int i = 0; i < drives; i++) {
+        if (!image_map_disk(&disks[i], disk_paths[i])) {
+            return 1;
+        }
+        disk_insert(&emu.disk, i, &disks[i]);
+    }
+    if (boot_cpm) {
+        load_cpm(&emu.bus);
+    } else if (!image_load(&emu.bus, argv[optind], load_addr, &start)) {
+        return 1;
+    }
+
+    cpu8080_t *cpu = &emu.cpu;
+    cpu->pc = start < 0 ? 0 : start;
+
+    uint64_t cycles = 0;
+    bool input = true;
+    double t0 = now_seconds();
+    while (!cpu8080_stopped(cpu) && (limit == 0 || cycles < limit)) {
+        uint32_t budget = RUN_CHUNK_CYCLES;
+        if (limit > 0 && limit - cycles < budget) budget = limit - cycles;
+        cycles += cpu8080_run(cpu, budget);
+        input = console_transfer(&emu.console, input);
+    }
+    double elapsed = now_seconds() - t0;
+
+    print_state(cpu);
+    printf("%s after %llu cycles, %llu instructions in %.3f s: %.2f MIPS, %.2f emulated MHz\n",
+           cpu->halted ? "halted" : "stopped", (unsigned long long)cycles,
+           (unsigned long long)cpu->instructions, elapsed,
+           elapsed > 0 ? cpu->instructions / elapsed / 1e6 : 0.0,
+           elapsed > 0 ? cycles / elapsed / 1e6 : 0.0);
+    return 0;
+}
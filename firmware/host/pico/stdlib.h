@@ -0,0 +1,13 @@
+// Stub header for pico/stdlib.h - host build
+#ifndef PICO_STDLIB_H
+#define PICO_STDLIB_H
+
+#include <stdint.h>
+
+// Defined in host_stubs.c, microseconds on the host's monotonic clock
+uint32_t to_ms_since_boot(uint64_t t);
+uint64_t to_us_since_boot(uint64_t t);
+uint64_t get_absolute_time(void);
+void sleep_ms(uint32_t ms);
+
+#endif
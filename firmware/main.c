@@ -10,19 +10,48 @@
  *
  * Test mode runs only on startup if key switch is OFF.
  * Key switch toggles LCD between disassembly and register view.
+ *
+ * Core 0 owns the front panel (switches, buttons, LEDs, LCD) and core 1
+ * runs the CPU. They only talk through two lock-free queues: input events
+ * go to core 1 and panel snapshots come back, so slow I2C/LCD traffic
+ * never stalls the emulated CPU. Core 0 also carries the 88-2SIO console
+ * over USB CDC through the device's own lock-free rings. CP/M's disks are
+ * images in a flash partition (disk_flash.h).
  */
 
 #include <stdio.h>
 #include <string.h>
 #include "pico/stdlib.h"
+#include "pico/multicore.h"
 #include "hardware/gpio.h"
 #include "tusb.h"
+#include "pico/stdio_usb.h"
+#include "pico/flash.h"
 
 #include "pins.h"
 #include "lcd.h"
 #include "shift_register.h"
 #include "pcf8574.h"
+#include "disk_flash.h"
 #include "microcomputer.h"
+#include "panel.h"
+#include "session.h"
+#include "spsc.h"
+
+// Stream every panel scan over USB CDC as a session (see session.h) that
+// the web or host build can replay. The emulator waits for the host to
+// open the port, so the stream starts from a freshly initialized machine.
+#ifndef SESSION_RECORD_USB
+#define SESSION_RECORD_USB 0
+#endif
+
+// The 88-2SIO console over USB CDC, unless the port carries a session
+#ifndef CONSOLE_USB
+#define CONSOLE_USB (!SESSION_RECORD_USB)
+#endif
+#if CONSOLE_USB && SESSION_RECORD_USB
+#error "USB CDC carries either the console or a session recording"
+#endif
 
 // Initialize all direct input pins
 void init_direct_inputs(void) {
@@ -80,6 +109,103 @@ void run_test(void) {
 
 static emulator_t emu;
 
+// Core 0 -> core 1 input events and core 1 -> core 0 panel snapshots
+#define INPUT_QUEUE_LEN 16
+#define SNAPSHOT_QUEUE_LEN 4
+static panel_input_t input_queue_buf[INPUT_QUEUE_LEN];
+static panel_snapshot_t snapshot_queue_buf[SNAPSHOT_QUEUE_LEN];
+static spsc_t input_queue;
+static spsc_t snapshot_queue;
+
+// Minimum time between snapshots, the LCD can't show more than this anyway
+#define SNAPSHOT_INTERVAL_US 20000
+
+// Real-time pacing: the CPU runs in bursts from a repeating timer IRQ
+#define PACER_TICK_US 1000
+static repeating_timer_t pacer_timer;
+
+#if SESSION_RECORD_USB
+static session_recorder_t recorder;
+
+// Raw bytes, no CRLF translation
+static void usb_write(void *ctx, const uint8_t *data, uint32_t len) {
+    (void)ctx;
+    for (uint32_t i = 0; i < len; i++) {
+        putchar_raw(data[i]);
+    }
+}
+#endif
+
+#if CONSOLE_USB
+// Everything the 8080 sent since the last call goes out in one USB write,
+// raw, and what the host typed comes in with one read once the 8080 has
+// taken the previous batch
+static void console_transfer(sio_t *sio) {
+    static uint8_t buf[SIO_RING_SIZE];
+    uint32_t n = sio_host_read(sio, buf, sizeof(buf));
+    if (n > 0) {
+        stdio_usb.out_chars((const char *)buf, n);
+    }
+    if (spsc_empty(&sio->rx)) {
+        int len = stdio_usb.in_chars((char *)buf, 256);
+        if (len > 0) {
+            sio_host_write(sio, buf, len);
+        }
+    }
+}
+#endif
+
+static bool pacer_tick(repeating_timer_t *t) {
+    emulator_pace((emulator_t *)t->user_data, time_us_64());
+    return true;
+}
+
+// Core 1: CPU only, never touches panel hardware
+static void core1_main(void) {
+    // Timer callbacks run on the core that created the alarm pool
+    alarm_pool_t *pool = alarm_pool_create_with_unused_hardware_alarm(4);
+    alarm_pool_add_repeating_timer_us(pool, -PACER_TICK_US, pacer_tick, &emu, &pacer_timer);
+    emu.paced_by_timer = true;
+
+    uint32_t published_seq = 0;
+    uint64_t last_publish = 0;
+    panel_input_t input;
+
+    while (1) {
+        while (spsc_pop(&input_queue, &input)) {
+            emulator_apply_input(&emu, &input);
+        }
+
+        emulator_execute(&emu);
+
+        uint64_t now_us = time_us_64();
+        if (emu.view_seq != published_seq && now_us - last_publish >= SNAPSHOT_INTERVAL_US &&
+            !spsc_full(&snapshot_queue)) {
+            panel_snapshot_t snap;
+            emulator_snapshot(&emu, &snap);
+            spsc_push(&snapshot_queue, &snap);
+            published_seq = snap.seq;
+            last_publish = now_us;
+        }
+
+        // Stopped, halted or paced by the timer IRQ: nothing to do until an
+        // event. Core 0 signals after queueing input and IRQs wake us too, and
+        // a snapshot held back by SNAPSHOT_INTERVAL_US bounds the sleep.
+        bool idle = emu.run_mode == MODE_STOP || emu.run_mode == MODE_RUN_REALTIME ||
+                    cpu8080_stopped(&emu.cpu) || emu.breakpoint_hit;
+        if (idle) {
+            if (emu.view_seq != published_seq) {
+                best_effort_wfe_or_timeout(make_timeout_time_us(SNAPSHOT_INTERVAL_US));
+            } else {
+                __wfe();
+            }
+        } else if (emu.run_mode != MODE_RUN_MAX) {
+            // MODE_RUN_MAX keeps the core busy
+            sleep_us(500);
+        }
+    }
+}
+
 int main() {
     stdio_init_all();
 
@@ -105,14 +231,66 @@ int main() {
         run_test();
     }
 
-    // Initialize emulator
+#if SESSION_RECORD_USB
+    lcd_clear();
+    lcd_set_cursor(0, 0);
+    lcd_print("Waiting for USB");
+    while (!stdio_usb_connected()) {
+        sleep_ms(10);
+    }
+    session_record_start(&recorder, usb_write, NULL);
+#endif
+
+    // Initialize emulator and hand the CPU to core 1
     emulator_init(&emu);
+    disk_flash_attach(&emu.disk);
+    spsc_init(&input_queue, input_queue_buf, sizeof(panel_input_t), INPUT_QUEUE_LEN);
+    spsc_init(&snapshot_queue, snapshot_queue_buf, sizeof(panel_snapshot_t), SNAPSHOT_QUEUE_LEN);
+
+    panel_t panel;
+    panel_init(&panel);
+
+    // Show the initial state before core 1 starts changing it
+    panel_snapshot_t snap;
+    emulator_snapshot(&emu, &snap);
+
+    // Disk writes on core 1 reprogram flash, pausing this core meanwhile
+    flash_safe_execute_core_init();
+    multicore_launch_core1(core1_main);
+
+    panel_input_t pending = {0};
+    bool have_pending = false;
 
     while (1) {
         buttons = read_direct_inputs();
         uint16_t switches = ~pcf8574_read_all();
+        uint32_t now = to_ms_since_boot(get_absolute_time());
+#if SESSION_RECORD_USB
+        session_record(&recorder, (uint64_t)now * 1000, switches, buttons);
+#endif
 
-        emulator_update(&emu, switches, buttons);
+        // Merge presses into the pending event if core 1 hasn't caught up
+        panel_input_t input;
+        if (panel_scan(&panel, switches, buttons, now, &input)) {
+            pending.switches = input.switches;
+            pending.buttons = input.buttons;
+            pending.pressed |= input.pressed;
+            have_pending = true;
+        }
+        if (have_pending && spsc_push(&input_queue, &pending)) {
+            pending.pressed = 0;
+            have_pending = false;
+            __sev();    // wake core 1 if it is sleeping
+        }
+
+#if CONSOLE_USB
+        console_transfer(&emu.console);
+#endif
+
+        // Only the newest snapshot matters
+        while (spsc_pop(&snapshot_queue, &snap)) {
+        }
+        panel_render(&panel, &snap, now);
 
         sleep_ms(10);
     }
@@ -1,25 +1,288 @@
 #include "memory.h"
 #include <string.h>
 
-static uint8_t ram[MEMORY_SIZE];
+#define PAGE(addr) ((addr) / MEMORY_PAGE_SIZE)
+#define OFFSET(addr) ((addr) % MEMORY_PAGE_SIZE)
 
-void memory_init(void) {
-    memset(ram, 0, MEMORY_SIZE);
+static inline void invalidate_page(bus_t *bus, uint8_t page) {
+    if (bus->code_page[page]) {
+        bus->code_page[page] = 0;
+        bus->code_gen[page]++;
+    }
 }
 
-uint8_t memory_read(uint16_t addr) {
-    return ram[addr];
+// Stale translated code anywhere in [addr, addr + len)
+void memory_invalidate(bus_t *bus, uint16_t addr, uint32_t len) {
+    uint32_t last = PAGE(addr + len - 1);
+    for (uint32_t page = PAGE(addr); page <= last; page++) {
+        invalidate_page(bus, page);
+    }
 }
 
-void memory_write(uint16_t addr, uint8_t data) {
-    ram[addr] = data;
+// Bookkeeping for a bulk write to [addr, addr + len)
+static void touch_range(bus_t *bus, uint16_t addr, uint32_t len) {
+    uint32_t last = PAGE(addr + len - 1);
+    for (uint32_t page = PAGE(addr); page <= last; page++) {
+        invalidate_page(bus, page);
+        bus->dirty[bus->frame[page]] = 1;
+    }
 }
 
-uint16_t memory_read_word(uint16_t addr) {
-    return ram[addr] | (ram[(uint16_t)(addr + 1)] << 8);
+// RAM frame holding host byte p, if it is ram or the bank pool
+static uint16_t frame_of(bus_t *bus, const uint8_t *p) {
+    memory_banks_t *bk = &bus->banks;
+    if (p >= bus->ram && p < bus->ram + MEMORY_SIZE) {
+        return (p - bus->ram) / MEMORY_PAGE_SIZE;
+    }
+    if (bk->count > 1 && p >= bk->pool &&
+        p < bk->pool + (uint32_t)(bk->count - 1) * bk->window_pages * MEMORY_PAGE_SIZE) {
+        return MEMORY_PAGES + (p - bk->pool) / MEMORY_PAGE_SIZE;
+    }
+    return MEMORY_NO_FRAME;
 }
 
-void memory_write_word(uint16_t addr, uint16_t data) {
-    ram[addr] = data & 0xFF;
-    ram[(uint16_t)(addr + 1)] = (data >> 8) & 0xFF;
+// Remapped pages change under their translated code without being written
+static void map_pages(bus_t *bus, uint8_t page, uint16_t count, uint8_t *read, uint8_t *write,
+                      const memory_device_t *dev) {
+    if (page + count > MEMORY_PAGES) count = MEMORY_PAGES - page;
+    if (count == 0) return;
+    memory_invalidate(bus, page * MEMORY_PAGE_SIZE, count * MEMORY_PAGE_SIZE);
+    for (uint16_t i = 0; i < count; i++) {
+        bus->read_page[page + i] = read ? read + i * MEMORY_PAGE_SIZE : NULL;
+        bus->write_page[page + i] = write ? write + i * MEMORY_PAGE_SIZE : NULL;
+        bus->device[page + i] = dev;
+        bus->frame[page + i] = write ? frame_of(bus, write + i * MEMORY_PAGE_SIZE) : MEMORY_NO_FRAME;
+    }
+}
+
+void memory_init(bus_t *bus) {
+    memset(bus->ram, 0, MEMORY_SIZE);
+    memset(&bus->banks, 0, sizeof(bus->banks));
+    bus->banks.count = 1;
+    memset(bus->port, 0, sizeof(bus->port));
+    memset(bus->dirty, 1, sizeof(bus->dirty));
+    bus->port_effects = 0;
+    map_pages(bus, 0, MEMORY_PAGES, bus->ram, bus->ram, NULL);
+}
+
+void memory_map_ram(bus_t *bus, uint8_t page, uint16_t count, uint8_t *host) {
+    if (!host) host = bus->ram + page * MEMORY_PAGE_SIZE;
+    map_pages(bus, page, count, host, host, NULL);
+}
+
+void memory_map_rom(bus_t *bus, uint8_t page, uint16_t count, const uint8_t *host) {
+    if (!host) host = bus->ram + page * MEMORY_PAGE_SIZE;
+    // Never written through, the write pointer stays NULL
+    map_pages(bus, page, count, (uint8_t *)host, NULL, NULL);
+}
+
+void memory_map_device(bus_t *bus, uint8_t page, uint16_t count, const memory_device_t *dev) {
+    map_pages(bus, page, count, NULL, NULL, dev);
+}
+
+void memory_unmap(bus_t *bus, uint8_t page, uint16_t count) {
+    map_pages(bus, page, count, NULL, NULL, NULL);
+}
+
+void memory_map_port(bus_t *bus, uint8_t port, uint16_t count, const memory_port_t *dev) {
+    for (uint16_t i = 0; i < count && port + i < 256; i++) {
+        bus->port[port + i] = dev;
+    }
+}
+
+static uint8_t *bank_base(bus_t *bus, uint8_t bank) {
+    memory_banks_t *bk = &bus->banks;
+    if (bank == 0) return bus->ram + bk->window_page * MEMORY_PAGE_SIZE;
+    return bk->pool + (uint32_t)(bank - 1) * bk->window_pages * MEMORY_PAGE_SIZE;
+}
+
+static void bank_latch_out(void *ctx, uint8_t port, uint8_t data, uint64_t cycle) {
+    (void)port;
+    (void)cycle;
+    memory_select_bank(ctx, data);
+}
+
+uint8_t memory_banks_init(bus_t *bus, uint8_t *pool, uint32_t pool_size, uint8_t port,
+                          uint8_t window_page, uint16_t window_pages) {
+    memory_banks_t *bk = &bus->banks;
+    uint32_t window_size = window_pages * MEMORY_PAGE_SIZE;
+    uint32_t extra = window_size ? pool_size / window_size : 0;
+
+    if (window_page + window_pages > MEMORY_PAGES) extra = 0;
+    if (extra > 254) extra = 254;
+    if (extra > 0 && extra * window_pages > MEMORY_FRAMES - MEMORY_PAGES) {
+        extra = (MEMORY_FRAMES - MEMORY_PAGES) / window_pages;
+    }
+    bk->pool = pool;
+    bk->count = 1 + extra;
+    bk->port = port;
+    bk->window_page = window_page;
+    bk->window_pages = window_pages;
+    if (extra > 0) {
+        memset(pool, 0, extra * window_size);
+        memset(bus->dirty + MEMORY_PAGES, 1, extra * window_pages);
+    }
+    bk->current = 0;
+    map_pages(bus, window_page, window_pages, bank_base(bus, 0), bank_base(bus, 0), NULL);
+    if (bk->count > 1) {
+        bk->latch.in = NULL;
+        bk->latch.out = bank_latch_out;
+        bk->latch.ctx = bus;
+        memory_map_port(bus, port, 1, &bk->latch);
+    }
+    return bk->count;
+}
+
+void memory_select_bank(bus_t *bus, uint8_t bank) {
+    memory_banks_t *bk = &bus->banks;
+    if (bank >= bk->count || bank == bk->current) return;
+    uint8_t *base = bank_base(bus, bank);
+    map_pages(bus, bk->window_page, bk->window_pages, base, base, NULL);
+    bk->current = bank;
+}
+
+bool memory_in_bank_window(bus_t *bus, uint16_t addr) {
+    memory_banks_t *bk = &bus->banks;
+    return bk->count > 1 && PAGE(addr) >= bk->window_page &&
+           PAGE(addr) < bk->window_page + bk->window_pages;
+}
+
+uint8_t memory_peek(bus_t *bus, uint8_t bank, uint16_t addr) {
+    if (bank != MEMORY_BANK_CURRENT && bank < bus->banks.count && memory_in_bank_window(bus, addr)) {
+        return bank_base(bus, bank)[addr - bus->banks.window_page * MEMORY_PAGE_SIZE];
+    }
+    uint8_t *p = bus->read_page[PAGE(addr)];
+    return p ? p[OFFSET(addr)] : 0xFF;
+}
+
+uint16_t memory_frame_count(bus_t *bus) {
+    return MEMORY_PAGES + (bus->banks.count - 1) * bus->banks.window_pages;
+}
+
+uint8_t *memory_frame(bus_t *bus, uint16_t frame) {
+    if (frame < MEMORY_PAGES) return bus->ram + frame * MEMORY_PAGE_SIZE;
+    return bus->banks.pool + (uint32_t)(frame - MEMORY_PAGES) * MEMORY_PAGE_SIZE;
+}
+
+void memory_frames_changed(bus_t *bus, const uint8_t *changed) {
+    for (int page = 0; page < MEMORY_PAGES; page++) {
+        if (bus->frame[page] != MEMORY_NO_FRAME && changed[bus->frame[page]]) {
+            invalidate_page(bus, page);
+        }
+    }
+}
+
+uint8_t memory_device_read(bus_t *bus, uint16_t addr) {
+    const memory_device_t *dev = bus->device[PAGE(addr)];
+    return dev && dev->read ? dev->read(dev->ctx, addr) : 0xFF;
+}
+
+void memory_device_write(bus_t *bus, uint16_t addr, uint8_t data) {
+    const memory_device_t *dev = bus->device[PAGE(addr)];
+    if (dev && dev->write) {
+        dev->write(dev->ctx, addr, data);
+    }
+}
+
+uint16_t memory_read_word(bus_t *bus, uint16_t addr) {
+    return memory_read(bus, addr) | (memory_read(bus, addr + 1) << 8);
+}
+
+void memory_write_word(bus_t *bus, uint16_t addr, uint16_t data) {
+    memory_write(bus, addr, data & 0xFF);
+    memory_write(bus, addr + 1, (data >> 8) & 0xFF);
+}
+
+// Plain RAM: readable and writable through the same host bytes, and the
+// range doesn't wrap
+bool memory_is_ram(bus_t *bus, uint16_t addr, uint32_t len) {
+    if (len == 0) return true;
+    if (addr + len > MEMORY_SIZE) return false;
+    for (uint32_t page = PAGE(addr); page <= PAGE(addr + len - 1); page++) {
+        if (!bus->write_page[page] || bus->read_page[page] != bus->write_page[page]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Write value, value + step, value + 2 * step, ... from addr
+void memory_fill(bus_t *bus, uint16_t addr, uint8_t value, uint8_t step, uint32_t len) {
+    touch_range(bus, addr, len);
+    while (len > 0) {
+        uint32_t n = MEMORY_PAGE_SIZE - OFFSET(addr);
+        if (n > len) n = len;
+        uint8_t *p = bus->write_page[PAGE(addr)] + OFFSET(addr);
+        if (step == 0) {
+            memset(p, value, n);
+        } else {
+            for (uint32_t i = 0; i < n; i++) {
+                p[i] = value + i * step;
+            }
+            value += n * step;
+        }
+        addr += n;
+        len -= n;
+    }
+}
+
+// Copy in ascending address order like the CPU does, so a destination just
+// above the source repeats the pattern instead of behaving like memmove()
+void memory_copy(bus_t *bus, uint16_t dst, uint16_t src, uint32_t len) {
+    touch_range(bus, dst, len);
+    while (len > 0) {
+        uint32_t n = MEMORY_PAGE_SIZE - (OFFSET(dst) > OFFSET(src) ? OFFSET(dst) : OFFSET(src));
+        if (n > len) n = len;
+        uint8_t *d = bus->write_page[PAGE(dst)] + OFFSET(dst);
+        const uint8_t *s = bus->read_page[PAGE(src)] + OFFSET(src);
+        if (d > s && d < s + n) {
+            for (uint32_t i = 0; i < n; i++) {
+                d[i] = s[i];
+            }
+        } else {
+            memmove(d, s, n);
+        }
+        dst += n;
+        src += n;
+        len -= n;
+    }
+}
+
+// Page at a time: a memcpy() where the page has host bytes, the device's
+// byte accessors where it doesn't. Addresses wrap at 64K like the CPU's.
+void memory_dma_write(bus_t *bus, uint16_t addr, const uint8_t *src, uint32_t len) {
+    while (len > 0) {
+        uint32_t n = MEMORY_PAGE_SIZE - OFFSET(addr);
+        if (n > len) n = len;
+        uint8_t *p = bus->write_page[PAGE(addr)];
+        if (p) {
+            touch_range(bus, addr, n);
+            memcpy(p + OFFSET(addr), src, n);
+        } else {
+            for (uint32_t i = 0; i < n; i++) {
+                memory_write(bus, addr + i, src[i]);
+            }
+        }
+        addr += n;
+        src += n;
+        len -= n;
+    }
+}
+
+void memory_dma_read(bus_t *bus, uint16_t addr, uint8_t *dst, uint32_t len) {
+    while (len > 0) {
+        uint32_t n = MEMORY_PAGE_SIZE - OFFSET(addr);
+        if (n > len) n = len;
+        const uint8_t *p = bus->read_page[PAGE(addr)];
+        if (p) {
+            memcpy(dst, p + OFFSET(addr), n);
+        } else {
+            for (uint32_t i = 0; i < n; i++) {
+                dst[i] = memory_device_read(bus, addr + i);
+            }
+        }
+        addr += n;
+        dst += n;
+        len -= n;
+    }
 }
@@ -2,13 +2,175 @@
 #define MEMORY_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define MEMORY_SIZE 65536
+#define MEMORY_PAGE_SIZE 256
+#define MEMORY_PAGES (MEMORY_SIZE / MEMORY_PAGE_SIZE)
 
-void memory_init(void);
-uint8_t memory_read(uint16_t addr);
-void memory_write(uint16_t addr, uint8_t data);
-uint16_t memory_read_word(uint16_t addr);
-void memory_write_word(uint16_t addr, uint16_t data);
+// RAM is tracked in page-sized frames: frames 0-255 are ram, the rest are
+// the bank pool. Writes mark their frame dirty for snapshots (snapshot.h).
+#ifndef MEMORY_FRAMES
+#define MEMORY_FRAMES (MEMORY_PAGES * 2)
+#endif
+#define MEMORY_NO_FRAME MEMORY_FRAMES   // ROM and devices, never snapshotted
+
+struct bus;
+
+// Device behind pages that aren't plain memory (memory-mapped I/O). addr
+// is the full CPU address. A NULL read returns 0xFF, a NULL write is ignored.
+typedef struct {
+    uint8_t (*read)(void *ctx, uint16_t addr);
+    void (*write)(void *ctx, uint16_t addr, uint8_t data);
+    void *ctx;
+} memory_device_t;
+
+// Device on I/O ports, for IN and OUT. cycle is the CPU's cycle count at
+// the start of the instruction (cpu8080_t.cycles), so devices can model
+// timing. A NULL in reads 0xFF, a NULL out is ignored.
+typedef struct {
+    uint8_t (*in)(void *ctx, uint8_t port, uint64_t cycle);
+    void (*out)(void *ctx, uint8_t port, uint8_t data, uint64_t cycle);
+    void *ctx;
+} memory_port_t;
+
+// Bank switching: writing n to the bank port maps bank n into the window
+// [window_page, window_page + window_pages) by swapping page pointers. Bank
+// 0 is the window's part of ram, the rest come from the pool given to
+// memory_banks_init(). Pages outside the window are common to all banks.
+#define MEMORY_BANK_CURRENT 0xFF    // whichever bank is mapped
+
+typedef struct {
+    uint8_t *pool;          // banks 1..count-1, one window each
+    uint8_t count;          // banks including bank 0, 1 when not banked
+    uint8_t current;
+    uint8_t port;
+    uint8_t window_page;
+    uint16_t window_pages;
+    memory_port_t latch;    // the bank select port's device
+} memory_banks_t;
+
+// Address space of one machine. Every CPU, disassembler and emulator call
+// goes through a bus pointer, so independent machines can run side by side.
+//
+// The space is mapped in 256-byte pages. RAM has both host pointers set, ROM
+// only the read one, and anything else (MMIO, unmapped holes) goes to the
+// page's device, so plain RAM costs one table lookup and no calls. The
+// pages point into ram, so a bus can't be copied by plain assignment.
+typedef struct bus {
+    uint8_t ram[MEMORY_SIZE];
+    uint8_t *read_page[MEMORY_PAGES];   // host bytes for the page, or NULL
+    uint8_t *write_page[MEMORY_PAGES];  // host bytes for the page, or NULL
+    const memory_device_t *device[MEMORY_PAGES];    // used where a pointer is NULL
+    uint16_t frame[MEMORY_PAGES];       // RAM frame behind the page, or MEMORY_NO_FRAME
+    uint8_t dirty[MEMORY_FRAMES + 1];   // frame written since dirty was last cleared
+    memory_banks_t banks;
+    const memory_port_t *port[256];     // I/O port devices, NULL where there is none
+    uint8_t code_page[MEMORY_PAGES];    // page holds translated code
+    uint32_t code_gen[MEMORY_PAGES];    // bumped when such a page is written
+    uint32_t port_effects;              // see memory_port_effect()
+} bus_t;
+
+// Clears RAM and maps all of it, without banks
+void memory_init(bus_t *bus);
+uint16_t memory_read_word(bus_t *bus, uint16_t addr);
+void memory_write_word(bus_t *bus, uint16_t addr, uint16_t data);
+
+// Slow paths of memory_read()/memory_write() for pages without a pointer
+uint8_t memory_device_read(bus_t *bus, uint16_t addr);
+void memory_device_write(bus_t *bus, uint16_t addr, uint8_t data);
+
+// Drop translated code on [addr, addr + len). memory_write only does this
+// for stores that land in RAM, so a device whose pages hold code calls it
+// when a write changes what they read back.
+void memory_invalidate(bus_t *bus, uint16_t addr, uint32_t len);
+
+// Inline so the CPU's RAM accesses are one lookup with no call at all
+static inline uint8_t memory_read(bus_t *bus, uint16_t addr) {
+    uint8_t *p = bus->read_page[addr / MEMORY_PAGE_SIZE];
+    return p ? p[addr % MEMORY_PAGE_SIZE] : memory_device_read(bus, addr);
+}
+
+static inline void memory_write(bus_t *bus, uint16_t addr, uint8_t data) {
+    uint8_t page = addr / MEMORY_PAGE_SIZE;
+    uint8_t *p = bus->write_page[page];
+
+    if (p) {
+        p[addr % MEMORY_PAGE_SIZE] = data;
+        bus->dirty[bus->frame[page]] = 1;
+
+        // Stale any translated code in the page being written
+        if (bus->code_page[page]) {
+            bus->code_page[page] = 0;
+            bus->code_gen[page]++;
+        }
+    } else {
+        memory_device_write(bus, addr, data);
+    }
+}
+
+// Change the map for pages [page, page + count). host must hold
+// count * MEMORY_PAGE_SIZE bytes, NULL means the matching part of bus->ram.
+// Translated code on the pages is dropped.
+void memory_map_ram(bus_t *bus, uint8_t page, uint16_t count, uint8_t *host);
+void memory_map_rom(bus_t *bus, uint8_t page, uint16_t count, const uint8_t *host);
+void memory_map_device(bus_t *bus, uint8_t page, uint16_t count, const memory_device_t *dev);
+void memory_unmap(bus_t *bus, uint8_t page, uint16_t count);
+
+// Take as many banks as fit in pool (pool_size bytes) and MEMORY_FRAMES,
+// clear them and map bank 0. Returns the number of banks including bank 0.
+uint8_t memory_banks_init(bus_t *bus, uint8_t *pool, uint32_t pool_size, uint8_t port,
+                          uint8_t window_page, uint16_t window_pages);
+// Selecting a bank past the pool is ignored
+void memory_select_bank(bus_t *bus, uint8_t bank);
+bool memory_in_bank_window(bus_t *bus, uint16_t addr);
+
+// Read a byte of bank (or MEMORY_BANK_CURRENT) without side effects, for
+// debuggers and displays. Device pages read as 0xFF.
+uint8_t memory_peek(bus_t *bus, uint8_t bank, uint16_t addr);
+
+// Frames in use and their host bytes
+uint16_t memory_frame_count(bus_t *bus);
+uint8_t *memory_frame(bus_t *bus, uint16_t frame);
+
+// Frames flagged in changed (one byte each) were rewritten without going
+// through the bus: stale translated code on the pages that show them
+void memory_frames_changed(bus_t *bus, const uint8_t *changed);
+
+// Attach dev to I/O ports [port, port + count), NULL detaches them.
+// memory_init() leaves every port empty, memory_banks_init() attaches the
+// bank select latch.
+void memory_map_port(bus_t *bus, uint8_t port, uint16_t count, const memory_port_t *dev);
+
+// IN and OUT. Inline so an empty port costs one table lookup.
+static inline uint8_t memory_port_read(bus_t *bus, uint8_t port, uint64_t cycle) {
+    const memory_port_t *dev = bus->port[port];
+    return dev && dev->in ? dev->in(dev->ctx, port, cycle) : 0xFF;
+}
+
+static inline void memory_port_write(bus_t *bus, uint8_t port, uint8_t data, uint64_t cycle) {
+    const memory_port_t *dev = bus->port[port];
+    if (dev && dev->out) {
+        dev->out(dev->ctx, port, data, cycle);
+    }
+}
+
+// Devices call this from IN, OUT or an event when they changed state that
+// stepping back can't restore (a byte taken or sent, a register set, an
+// interrupt raised), so the rewind history drops what came before
+static inline void memory_port_effect(bus_t *bus) {
+    bus->port_effects++;
+}
+
+// Bulk access for the CPU's fill and copy loops, same result as the loop
+// of memory_write() calls. Only for ranges memory_is_ram() accepts.
+bool memory_is_ram(bus_t *bus, uint16_t addr, uint32_t len);
+void memory_fill(bus_t *bus, uint16_t addr, uint8_t value, uint8_t step, uint32_t len);
+void memory_copy(bus_t *bus, uint16_t dst, uint16_t src, uint32_t len);
+
+// Block transfers for devices (disk DMA), same result as memory_write() or
+// memory_read() byte by byte but a page at a time. Any mapping is allowed.
+void memory_dma_write(bus_t *bus, uint16_t addr, const uint8_t *src, uint32_t len);
+void memory_dma_read(bus_t *bus, uint16_t addr, uint8_t *dst, uint32_t len);
 
 #endif
@@ -1,144 +1,150 @@
 #include "microcomputer.h"
 #include "memory.h"
 #include "disasm.h"
-#include "lcd.h"
-#include "shift_register.h"
 #include "programs.h"
 #include "pico/stdlib.h"
 #include <stddef.h>
-
-static void button_update(button_state_t *state, uint16_t current) {
-    state->previous = state->current;
-    state->current = current;
-}
-
-static bool button_pressed(button_state_t *state, uint16_t mask, int bit_index, uint32_t now) {
-    bool is_pressed = (state->current & mask) != 0;
-    bool was_pressed = (state->previous & mask) != 0;
-
-    if (is_pressed && !was_pressed) {
-        if (now - state->last_press_time[bit_index] >= DEBOUNCE_MS) {
-            state->last_press_time[bit_index] = now;
-            return true;
-        }
-    }
-    return false;
-}
+#include <stdatomic.h>
 
 void emulator_init(emulator_t *emu) {
-    cpu8080_init(&emu->cpu);
-    memory_init();
+    memory_init(&emu->bus);
+    memory_banks_init(&emu->bus, emu->bank_pool, sizeof(emu->bank_pool), BANK_PORT,
+                      BANK_WINDOW_PAGE, BANK_WINDOW_PAGES);
+    cpu8080_init(&emu->cpu, &emu->bus);
+    event_queue_init(&emu->events);
+    cpu8080_attach_events(&emu->cpu, &emu->events);
+    sio_init(&emu->console, &emu->bus, CONSOLE_PORT, &emu->cpu, CONSOLE_IRQ_LEVEL);
+    disk_init(&emu->disk, &emu->bus, DISK_PORT);
+#if CPU8080_TCACHE
+    cpu8080_attach_tcache(&emu->cpu, &emu->tcache);
+#endif
+#if CPU8080_JIT
+    if (cpu8080_jit_init(&emu->jit, CPU8080_JIT_DEFAULT_ARENA)) {
+        cpu8080_attach_jit(&emu->cpu, &emu->jit);
+    }
+#endif
     emu->run_mode = MODE_STOP;
     emu->auto_increment = false;
-    emu->buttons.current = 0;
-    emu->buttons.previous = 0;
-    for (int i = 0; i < 9; i++) {
-        emu->buttons.last_press_time[i] = 0;
-    }
     emu->last_step_time = 0;
     emu->step_interval_ms = 300;
-    emu->display_dirty = true;
-    emu->cursor_pos = 0;
-    emu->last_cursor_time = 0;
-    emu->show_registers = false;
-}
-
-static void update_leds(emulator_t *emu) {
-    uint8_t data = memory_read(emu->cpu.pc);
-    uint16_t pattern = ((emu->cpu.pc >> 8) << 8) | data;
-    sr_output(pattern);
-}
-
-static void update_lcd_registers(emulator_t *emu) {
-    // Show CPU registers (20x2 display)
-    // Line 1: A:xx BC:xxxx DE:xxxx (19 chars)
-    // Line 2: HL:xxxx SP:xxxx F:xx (19 chars)
-    lcd_set_cursor(0, 0);
-    lcd_print("A:");
-    lcd_print_hex8(emu->cpu.a);
-    lcd_print(" BC:");
-    lcd_print_hex16((emu->cpu.b << 8) | emu->cpu.c);
-    lcd_print(" DE:");
-    lcd_print_hex16((emu->cpu.d << 8) | emu->cpu.e);
-
-    lcd_set_cursor(0, 1);
-    lcd_print("HL:");
-    lcd_print_hex16((emu->cpu.h << 8) | emu->cpu.l);
-    lcd_print(" SP:");
-    lcd_print_hex16(emu->cpu.sp);
-    lcd_print(" F:");
-    lcd_print_hex8(emu->cpu.f);
-
-    lcd_display(true, false, false);  // Display on, cursor off
-}
-
-static void update_lcd_disasm(emulator_t *emu, uint32_t now) {
-    uint16_t addr = emu->cpu.pc;
-    int instr_len = disasm_get_length(addr);
-
-    if (emu->display_dirty) {
-        emu->display_dirty = false;
-        emu->cursor_pos = 0;
-        emu->last_cursor_time = now;
-
-        char disasm_buf[12];
-
-        lcd_clear();
-        lcd_set_cursor(0, 0);
-        lcd_print_hex16(addr);
-        lcd_print(": ");
-        disasm_instruction(addr, disasm_buf, sizeof(disasm_buf));
-        lcd_print(disasm_buf);
-
-        lcd_set_cursor(0, 1);
-        for (int i = 0; i < 7; i++) {
-            if (i > 0) lcd_putchar('.');
-            lcd_print_hex8(memory_read(addr + i));
-        }
-    }
+    emu->breakpoint_hit = false;
+    pacer_init(&emu->pacer, PACER_DEFAULT_HZ, to_us_since_boot(get_absolute_time()));
+    emu->paced_by_timer = false;
+    emu->busy = false;
+    emu->view_seq = 1;
+    emu->loaded_name = NULL;
+    emu->load_seq = 0;
+    panel_init(&emu->panel);
+    rewind_init(&emu->rewind, emu->rewind_buf, sizeof(emu->rewind_buf));
+    emu->store_addr_serial = 0;
+    emu->recorder = NULL;
+    emu->clock_held = false;
+    emu->clock_us = 0;
+}
 
-    // Animate cursor every 100ms
-    if (now - emu->last_cursor_time >= 100) {
-        emu->last_cursor_time = now;
-        emu->cursor_pos++;
-        // For 1-byte instruction: cycle through positions 0,1 (2 chars)
-        // For 2-byte instruction: cycle through positions 0,1,3,4 (4 chars)
-        // For 3-byte instruction: cycle through positions 0,1,3,4,6,7 (6 chars)
-        if (emu->cursor_pos >= instr_len * 2) {
-            emu->cursor_pos = 0;
-        }
-    }
+// Keep emulator_pace() out while the caller modifies or copies state
+static inline void begin_busy(emulator_t *emu) {
+    emu->busy = true;
+    atomic_signal_fence(memory_order_seq_cst);
+}
 
-    // Calculate cursor column: each byte is 2 chars + 1 dot separator
-    // Byte 0: cols 0,1 | Byte 1: cols 3,4 | Byte 2: cols 6,7
-    uint8_t byte_idx = emu->cursor_pos / 2;
-    uint8_t char_in_byte = emu->cursor_pos % 2;
-    uint8_t col = byte_idx * 3 + char_in_byte;
+static inline void end_busy(emulator_t *emu) {
+    atomic_signal_fence(memory_order_seq_cst);
+    emu->busy = false;
+}
 
-    lcd_set_cursor(col, 1);
-    lcd_display(true, true, false);  // Display on, cursor on
+// The system clock, or the time of the update call in progress so a
+// replayed call sees exactly the time it was recorded with
+static uint64_t clock_now_us(emulator_t *emu) {
+    return emu->clock_held ? emu->clock_us : to_us_since_boot(get_absolute_time());
 }
 
-static void update_lcd(emulator_t *emu, uint32_t now) {
-    // Check if display mode changed
-    bool key_off = !(emu->buttons.current & INPUT_KEY_SWITCH);
-    if (key_off != emu->show_registers) {
-        emu->show_registers = key_off;
-        lcd_clear();
-        emu->display_dirty = true;
+// One instruction, recorded for stepping back
+static int step_recorded(emulator_t *emu) {
+    if (cpu8080_stopped(&emu->cpu)) return 0;
+    rewind_record(&emu->rewind, &emu->cpu);
+    return cpu8080_step(&emu->cpu);
+}
+
+// cpu8080_run() with nothing recorded. History from before it no longer
+// matches memory and is dropped.
+static uint32_t run_unrecorded(emulator_t *emu, uint32_t budget) {
+    uint32_t cycles = cpu8080_run(&emu->cpu, budget);
+    rewind_clear(&emu->rewind);
+    emu->store_addr_serial = 0;
+    return cycles;
+}
+
+// A MAX frame: cpu8080_run() with the last REWIND_TAIL_CYCLES
+// single-stepped so they can be stepped back through
+static uint32_t run_cycles(emulator_t *emu, uint32_t budget) {
+    cpu8080_t *cpu = &emu->cpu;
+    uint32_t cycles = 0;
+
+    if (budget > REWIND_TAIL_CYCLES) {
+        cycles = run_unrecorded(emu, budget - REWIND_TAIL_CYCLES);
+        if (cpu8080_stopped(cpu) || cpu8080_at_breakpoint(cpu)) return cycles;
+    }
+    while (cycles < budget && !cpu8080_stopped(cpu)) {
+        cycles += step_recorded(emu);
+        if (cpu8080_at_breakpoint(cpu)) break;
     }
+    return cycles;
+}
 
-    if (emu->show_registers) {
-        update_lcd_registers(emu);
-    } else {
-        update_lcd_disasm(emu, now);
+// Paced bursts are a millisecond or so each, with no telling which is the
+// last, so they all run at full speed and REALTIME keeps no history
+static void run_paced(emulator_t *emu, uint64_t now_us) {
+    uint32_t budget = pacer_budget(&emu->pacer, now_us);
+    if (budget > 0) {
+        pacer_account(&emu->pacer, run_unrecorded(emu, budget));
+        emu->breakpoint_hit = cpu8080_at_breakpoint(&emu->cpu);
+        emu->view_seq++;
     }
 }
 
-void emulator_update(emulator_t *emu, uint16_t switches, uint16_t buttons) {
-    uint32_t now = to_ms_since_boot(get_absolute_time());
+void emulator_pace(emulator_t *emu, uint64_t now_us) {
+    if (emu->busy) return;
+    if (emu->run_mode != MODE_RUN_REALTIME || cpu8080_stopped(&emu->cpu) || emu->breakpoint_hit) return;
+    run_paced(emu, now_us);
+}
 
-    button_update(&emu->buttons, buttons);
+static const char *load_selected_program(bus_t *bus, uint8_t prog_select) {
+    // Load test program based on switch value (low byte)
+    // 0x01 = Counter, 0x02 = Memfill, 0x03 = Fibonacci
+    // 0x04 = Delay count, 0x05 = Stack test, 0x06 = CP/M
+    switch (prog_select) {
+        case 0x01:
+            load_program(bus, PROG_COUNTER_ADDR, prog_counter, PROG_COUNTER_SIZE);
+            return "Counter";
+        case 0x02:
+            load_program(bus, PROG_MEMFILL_ADDR, prog_memfill, PROG_MEMFILL_SIZE);
+            return "Memfill";
+        case 0x03:
+            load_program(bus, PROG_FIBONACCI_ADDR, prog_fibonacci, PROG_FIBONACCI_SIZE);
+            return "Fibonacci";
+        case 0x04:
+            load_program(bus, PROG_DELAY_COUNT_ADDR, prog_delay_count, PROG_DELAY_COUNT_SIZE);
+            return "Delay Count";
+        case 0x05:
+            load_program(bus, PROG_STACK_TEST_ADDR, prog_stack_test, PROG_STACK_TEST_SIZE);
+            return "Stack Test";
+        case 0x06:
+            load_cpm(bus);
+            return "CP/M";
+        default:
+            // No program loaded, just reset
+            return NULL;
+    }
+}
+
+void emulator_apply_input(emulator_t *emu, const panel_input_t *input) {
+    uint64_t now_us = clock_now_us(emu);
+    uint16_t switches = input->switches;
+    uint16_t buttons = input->buttons;
+    run_mode_t prev_mode = emu->run_mode;
+
+    begin_busy(emu);
 
     emu->auto_increment = (buttons & INPUT_AUTO_INC) == 0;
 
@@ -148,91 +154,189 @@ void emulator_update(emulator_t *emu, uint16_t switches, uint16_t buttons) {
     } else if (run_bits == 0x01) {
         emu->run_mode = MODE_RUN_SLOW;
         emu->step_interval_ms = 300;
+    } else if (switches & SWITCH_RUN_MAX) {
+        emu->run_mode = MODE_RUN_MAX;
+    } else if (switches & SWITCH_RUN_REALTIME) {
+        emu->run_mode = MODE_RUN_REALTIME;
     } else {
         emu->run_mode = MODE_RUN_FAST;
         emu->step_interval_ms = 10;
     }
 
-    if (button_pressed(&emu->buttons, INPUT_RESET, 3, now)) {
+    // Stay stopped at a breakpoint until the run switch goes back to STOP
+    if (emu->run_mode == MODE_STOP) {
+        emu->breakpoint_hit = false;
+    }
+
+    // Don't try to catch up on time spent in other modes
+    if (emu->run_mode == MODE_RUN_REALTIME && prev_mode != MODE_RUN_REALTIME) {
+        pacer_restart(&emu->pacer, now_us);
+    }
+
+    if (input->pressed & INPUT_RESET) {
         cpu8080_reset(&emu->cpu);
-        // Load test program based on switch value (low byte)
-        // 0x01 = Counter, 0x02 = Memfill, 0x03 = Fibonacci
-        // 0x04 = Delay count, 0x05 = Stack test
-        const char *prog_name = NULL;
-        uint8_t prog_select = switches & 0xFF;
-        switch (prog_select) {
-            case 0x01:
-                load_program(PROG_COUNTER_ADDR, prog_counter, PROG_COUNTER_SIZE);
-                prog_name = "Counter";
-                break;
-            case 0x02:
-                load_program(PROG_MEMFILL_ADDR, prog_memfill, PROG_MEMFILL_SIZE);
-                prog_name = "Memfill";
-                break;
-            case 0x03:
-                load_program(PROG_FIBONACCI_ADDR, prog_fibonacci, PROG_FIBONACCI_SIZE);
-                prog_name = "Fibonacci";
-                break;
-            case 0x04:
-                load_program(PROG_DELAY_COUNT_ADDR, prog_delay_count, PROG_DELAY_COUNT_SIZE);
-                prog_name = "Delay Count";
-                break;
-            case 0x05:
-                load_program(PROG_STACK_TEST_ADDR, prog_stack_test, PROG_STACK_TEST_SIZE);
-                prog_name = "Stack Test";
-                break;
-            default:
-                // No program loaded, just reset
-                break;
-        }
+        memory_select_bank(&emu->bus, 0);
+        rewind_clear(&emu->rewind);
+        emu->store_addr_serial = 0;
+        const char *prog_name = load_selected_program(&emu->bus, switches & 0xFF);
         if (prog_name) {
-            lcd_clear();
-            lcd_set_cursor(0, 0);
-            lcd_print("Loaded: ");
-            lcd_print(prog_name);
-            sleep_ms(500);
+            emu->loaded_name = prog_name;
+            emu->load_seq++;
         }
-        emu->display_dirty = true;
+        emu->view_seq++;
     }
 
-    if (emu->run_mode == MODE_STOP) {
-        if (button_pressed(&emu->buttons, INPUT_SINGLE_STEP, 2, now)) {
-            if (!emu->cpu.halted) {
-                cpu8080_step(&emu->cpu);
-                emu->display_dirty = true;
+    // SINGLE STEP with STORE ADDR held steps back. Holding STORE ADDR
+    // loaded PC from the switches first, so that is undone as well.
+    bool step_back = (input->pressed & INPUT_SINGLE_STEP) && (buttons & INPUT_STORE_ADDR);
+
+    if (emu->run_mode == MODE_STOP && (input->pressed & INPUT_SINGLE_STEP)) {
+        if (step_back) {
+            if (emu->store_addr_serial != 0 && emu->store_addr_serial == emu->rewind.serial) {
+                rewind_step_back(&emu->rewind, &emu->cpu);
             }
+            emu->store_addr_serial = 0;
+            rewind_step_back(&emu->rewind, &emu->cpu);
+            emu->view_seq++;
+        } else if (!cpu8080_stopped(&emu->cpu)) {
+            step_recorded(emu);
+            emu->view_seq++;
         }
     }
 
-    if (button_pressed(&emu->buttons, INPUT_STORE_ADDR, 4, now)) {
+    if ((input->pressed & INPUT_STORE_ADDR) && !step_back) {
+        rewind_record_writes(&emu->rewind, &emu->cpu, NULL, 0);
+        emu->store_addr_serial = emu->rewind.serial;
         emu->cpu.pc = switches;
-        emu->display_dirty = true;
+        emu->view_seq++;
     }
 
-    if (button_pressed(&emu->buttons, INPUT_STORE_BYTE, 5, now)) {
-        memory_write(emu->cpu.pc, switches & 0xFF);
+    if (input->pressed & INPUT_STORE_BYTE) {
+        uint16_t addr[1] = { emu->cpu.pc };
+        rewind_record_writes(&emu->rewind, &emu->cpu, addr, 1);
+        memory_write(&emu->bus, emu->cpu.pc, switches & 0xFF);
         if (emu->auto_increment) {
             emu->cpu.pc++;
         }
-        emu->display_dirty = true;
+        emu->view_seq++;
     }
 
-    if (button_pressed(&emu->buttons, INPUT_STORE_WORD, 6, now)) {
-        memory_write_word(emu->cpu.pc, switches);
+    if (input->pressed & INPUT_STORE_WORD) {
+        uint16_t addr[2] = { emu->cpu.pc, emu->cpu.pc + 1 };
+        rewind_record_writes(&emu->rewind, &emu->cpu, addr, 2);
+        memory_write_word(&emu->bus, emu->cpu.pc, switches);
         if (emu->auto_increment) {
             emu->cpu.pc += 2;
         }
-        emu->display_dirty = true;
+        emu->view_seq++;
     }
 
-    if (emu->run_mode != MODE_STOP && !emu->cpu.halted) {
-        if (now - emu->last_step_time >= emu->step_interval_ms) {
-            cpu8080_step(&emu->cpu);
-            emu->display_dirty = true;
-            emu->last_step_time = now;
+    end_busy(emu);
+}
+
+void emulator_execute(emulator_t *emu) {
+    if (emu->run_mode == MODE_STOP || cpu8080_stopped(&emu->cpu) || emu->breakpoint_hit) return;
+
+    uint64_t now_us = clock_now_us(emu);
+    uint32_t now = now_us / 1000;
+
+    begin_busy(emu);
+
+    if (emu->run_mode == MODE_RUN_REALTIME) {
+        if (!emu->paced_by_timer) {
+            run_paced(emu, now_us);
         }
+    } else if (emu->run_mode == MODE_RUN_MAX) {
+        run_cycles(emu, RUN_MAX_CYCLES);
+        emu->view_seq++;
+        emu->breakpoint_hit = cpu8080_at_breakpoint(&emu->cpu);
+    } else if (now - emu->last_step_time >= emu->step_interval_ms) {
+        step_recorded(emu);
+        emu->view_seq++;
+        emu->last_step_time = now;
+        emu->breakpoint_hit = cpu8080_at_breakpoint(&emu->cpu);
+    }
+
+    end_busy(emu);
+}
+
+bool emulator_step_back(emulator_t *emu) {
+    begin_busy(emu);
+    bool ok = rewind_step_back(&emu->rewind, &emu->cpu);
+    if (ok) {
+        emu->store_addr_serial = 0;
+        emu->breakpoint_hit = false;
+        emu->view_seq++;
+    }
+    end_busy(emu);
+    return ok;
+}
+
+void emulator_snapshot(emulator_t *emu, panel_snapshot_t *snap) {
+    begin_busy(emu);
+
+    snap->seq = emu->view_seq;
+    snap->cpu = emu->cpu;
+    snap->cpu.f = cpu8080_get_f(&emu->cpu);
+
+    uint16_t addr = emu->cpu.pc;
+    for (int i = 0; i < 7; i++) {
+        snap->bytes[i] = memory_peek(&emu->bus, MEMORY_BANK_CURRENT, addr + i);
     }
+    disasm_instruction(&emu->bus, MEMORY_BANK_CURRENT, addr, snap->disasm, sizeof(snap->disasm));
+    snap->instr_len = disasm_get_length(&emu->bus, MEMORY_BANK_CURRENT, addr);
+    snap->pc_banked = memory_in_bank_window(&emu->bus, addr);
+    snap->bank = emu->bus.banks.current;
+
+    snap->loaded_name = emu->loaded_name;
+    snap->load_seq = emu->load_seq;
+    snap->missed_deadlines = emu->pacer.missed;
+    snap->dropped_cycles = emu->pacer.dropped;
+
+    end_busy(emu);
+}
 
-    update_leds(emu);
-    update_lcd(emu, now);
+static void update_at(emulator_t *emu, uint64_t now_us, uint16_t switches, uint16_t buttons) {
+    uint32_t now = now_us / 1000;
+    panel_input_t input;
+    panel_snapshot_t snap;
+
+    emu->clock_us = now_us;
+    emu->clock_held = true;
+    panel_scan(&emu->panel, switches, buttons, now, &input);
+    emulator_apply_input(emu, &input);
+    emulator_execute(emu);
+    emulator_snapshot(emu, &snap);
+    panel_render(&emu->panel, &snap, now);
+    emu->clock_held = false;
+}
+
+void emulator_update(emulator_t *emu, uint16_t switches, uint16_t buttons) {
+    uint64_t now_us = to_us_since_boot(get_absolute_time());
+    if (emu->recorder) {
+        session_record(emu->recorder, now_us, switches, buttons);
+        now_us = emu->recorder->last.time_us;
+    }
+    update_at(emu, now_us, switches, buttons);
+}
+
+uint32_t emulator_console_write(emulator_t *emu, const uint8_t *data, uint32_t len) {
+    if (emu->recorder && len > session_console_room(emu->recorder)) {
+        len = session_console_room(emu->recorder);
+    }
+    len = sio_host_write(&emu->console, data, len);
+    if (emu->recorder) {
+        session_record_console(emu->recorder, data, len);
+    }
+    return len;
+}
+
+bool emulator_replay_step(emulator_t *emu, session_player_t *play) {
+    session_event_t ev;
+    if (!session_next(play, &ev)) return false;
+    if (ev.console_len > 0) {
+        sio_host_write(&emu->console, ev.console, ev.console_len);
+    }
+    update_at(emu, ev.time_us, ev.switches, ev.buttons);
+    return true;
 }
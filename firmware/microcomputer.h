@@ -4,45 +4,122 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "cpu8080.h"
+#include "disk.h"
+#include "events.h"
+#include "memory.h"
+#include "pacer.h"
+#include "panel.h"
+#include "rewind.h"
+#include "session.h"
+#include "sio.h"
+#if CPU8080_JIT
+#include "cpu8080_jit.h"
+#endif
 
 typedef enum {
     MODE_STOP,
     MODE_RUN_SLOW,
-    MODE_RUN_FAST
+    MODE_RUN_FAST,
+    MODE_RUN_MAX,
+    MODE_RUN_REALTIME
 } run_mode_t;
 
-#define INPUT_STOP_RUN_BIT1   0x001
-#define INPUT_STOP_RUN_BIT2   0x002
-#define INPUT_SINGLE_STEP     0x004
-#define INPUT_RESET           0x008
-#define INPUT_STORE_ADDR      0x010
-#define INPUT_STORE_BYTE      0x020
-#define INPUT_STORE_WORD      0x040
-#define INPUT_AUTO_INC        0x080
-#define INPUT_KEY_SWITCH      0x100
+// With the run switch in FAST, address switch 15 up selects MODE_RUN_MAX
+// and switch 14 up selects MODE_RUN_REALTIME (paced at pacer.clock_hz)
+#define SWITCH_RUN_MAX        0x8000
+#define SWITCH_RUN_REALTIME   0x4000
 
-#define DEBOUNCE_MS 50
+// Cycles executed per emulator_update() call in MODE_RUN_MAX
+#ifndef RUN_MAX_CYCLES
+#define RUN_MAX_CYCLES 1000000
+#endif
 
-typedef struct {
-    uint16_t current;
-    uint16_t previous;
-    uint32_t last_press_time[9];
-} button_state_t;
+// Bank-switched memory: OUT BANK_PORT selects which of BANK_COUNT banks
+// fills the lower 48K, the top 16K is common. Bank 0 is the plain 64K.
+#ifndef BANK_COUNT
+#define BANK_COUNT 2
+#endif
+#define BANK_PORT 0x40
+#define BANK_WINDOW_PAGE 0x00
+#define BANK_WINDOW_PAGES 0xC0
+
+// Console: the first port of an 88-2SIO at its usual address, interrupting
+// with RST 7 as it does on a bus without a vectored interrupt board
+#define CONSOLE_PORT 0x10
+#define CONSOLE_IRQ_LEVEL 7
+
+// Floppy controller for CP/M (program 0x06). The front end inserts the
+// disk images.
+#define DISK_PORT 0x20
+
+// Bytes of undo history for stepping back (SINGLE STEP with STORE ADDR
+// held), about 1500 instructions per 32K. MODE_RUN_MAX frames only record
+// their last REWIND_TAIL_CYCLES cycles and MODE_RUN_REALTIME records none.
+#ifndef REWIND_BUDGET
+#define REWIND_BUDGET 32768
+#endif
+#define REWIND_TAIL_CYCLES 20000
 
 typedef struct {
+    bus_t bus;
+    uint8_t bank_pool[(BANK_COUNT - 1) * BANK_WINDOW_PAGES * MEMORY_PAGE_SIZE];
     cpu8080_t cpu;
+    event_queue_t events;       // device timing on the CPU's cycle count
+    sio_t console;              // the front end moves its bytes (sio_host_*)
+    disk_t disk;
+#if CPU8080_TCACHE
+    cpu8080_tcache_t tcache;
+#endif
+#if CPU8080_JIT
+    cpu8080_jit_t jit;
+#endif
     run_mode_t run_mode;
     bool auto_increment;
-    button_state_t buttons;
     uint32_t last_step_time;
     uint32_t step_interval_ms;
-    bool display_dirty;
-    uint8_t cursor_pos;
-    uint32_t last_cursor_time;
-    bool show_registers;
+    bool breakpoint_hit;
+    pacer_t pacer;
+    bool paced_by_timer;        // emulator_pace() is called from a timer IRQ
+    volatile bool busy;         // input/execute/snapshot is modifying state
+    volatile uint32_t view_seq; // bumped whenever the panel view changes
+    const char *loaded_name;
+    uint32_t load_seq;
+    panel_t panel;              // used by emulator_update() only
+    rewind_t rewind;
+    uint8_t rewind_buf[REWIND_BUDGET];
+    uint32_t store_addr_serial; // rewind entry of the last STORE ADDR, 0 if none
+    session_recorder_t *recorder;   // logs emulator_update() calls, or NULL
+    bool clock_held;            // time is clock_us (one update call), not the system clock
+    uint64_t clock_us;
 } emulator_t;
 
 void emulator_init(emulator_t *emu);
+
+// Single-threaded front panel loop: scan, apply, execute and render
 void emulator_update(emulator_t *emu, uint16_t switches, uint16_t buttons);
 
+// Feed the next event of a recorded session through emulator_update(),
+// at its recorded time. Start from a freshly initialized emulator; the
+// events can be fed as fast as wanted. Returns false at the end.
+bool emulator_replay_step(emulator_t *emu, session_player_t *play);
+
+// Queue console input for the 8080, logged for the next emulator_update()
+// while recording. Returns how many bytes fit.
+uint32_t emulator_console_write(emulator_t *emu, const uint8_t *data, uint32_t len);
+
+// Machine side of emulator_update(), for running the CPU apart from the
+// panel (e.g. on the other core). None of these touch panel hardware.
+void emulator_apply_input(emulator_t *emu, const panel_input_t *input);
+void emulator_execute(emulator_t *emu);
+void emulator_snapshot(emulator_t *emu, panel_snapshot_t *snap);
+
+// Undo the last instruction or panel edit. Returns false if there's no
+// history left.
+bool emulator_step_back(emulator_t *emu);
+
+// Run the cycles owed in MODE_RUN_REALTIME. Safe to call from a timer IRQ
+// that preempts the functions above: the burst is skipped while the
+// emulator is busy and caught up on the next call.
+void emulator_pace(emulator_t *emu, uint64_t now_us);
+
 #endif
@@ -0,0 +1,44 @@
+#include "pacer.h"
+
+void pacer_init(pacer_t *p, uint32_t clock_hz, uint64_t now_us) {
+    p->clock_hz = clock_hz;
+    p->max_lag_us = PACER_DEFAULT_MAX_LAG_US;
+    p->missed = 0;
+    p->dropped = 0;
+    pacer_restart(p, now_us);
+}
+
+void pacer_set_clock(pacer_t *p, uint32_t clock_hz, uint64_t now_us) {
+    p->clock_hz = clock_hz;
+    pacer_restart(p, now_us);
+}
+
+void pacer_restart(pacer_t *p, uint64_t now_us) {
+    p->base_us = now_us;
+    p->cycles = 0;
+}
+
+uint32_t pacer_budget(pacer_t *p, uint64_t now_us) {
+    // Move the base forward in whole seconds to keep the products small
+    while (now_us - p->base_us >= 1000000 && p->cycles >= p->clock_hz) {
+        p->base_us += 1000000;
+        p->cycles -= p->clock_hz;
+    }
+
+    uint64_t target = (now_us - p->base_us) * p->clock_hz / 1000000;
+    if (target <= p->cycles) return 0;
+
+    uint64_t owed = target - p->cycles;
+    uint64_t max_owed = (uint64_t)p->max_lag_us * p->clock_hz / 1000000;
+    if (owed > max_owed) {
+        p->missed++;
+        p->dropped += owed - max_owed;
+        p->cycles = target - max_owed;
+        owed = max_owed;
+    }
+    return (uint32_t)owed;
+}
+
+void pacer_account(pacer_t *p, uint32_t cycles) {
+    p->cycles += cycles;
+}
@@ -0,0 +1,40 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Clock of a real 8080 system
+#define PACER_DEFAULT_HZ        2000000
+
+// How far behind real time the emulated clock may fall before the debt
+// is dropped and counted as a missed deadline
+#define PACER_DEFAULT_MAX_LAG_US 20000
+
+typedef struct {
+    uint32_t clock_hz;      // target emulated clock
+    uint32_t max_lag_us;
+    uint64_t base_us;       // time the cycle count is measured from
+    uint64_t cycles;        // cycles executed since base_us
+    uint32_t missed;        // number of deadlines missed since init
+    uint64_t dropped;       // total cycles given up on missed deadlines
+} pacer_t;
+
+// Start pacing at clock_hz from time now_us
+void pacer_init(pacer_t *p, uint32_t clock_hz, uint64_t now_us);
+
+// Change the target clock, restarting the time base at now_us
+void pacer_set_clock(pacer_t *p, uint32_t clock_hz, uint64_t now_us);
+
+// Restart the time base at now_us, forgetting any debt (missed count kept)
+void pacer_restart(pacer_t *p, uint64_t now_us);
+
+// Cycles that should run now to catch up with real time (0 if ahead).
+// The target is computed from the absolute time base, so rounding and
+// burst overshoot never accumulate into drift.
+uint32_t pacer_budget(pacer_t *p, uint64_t now_us);
+
+// Record cycles actually executed (may exceed the budget by one instruction)
+void pacer_account(pacer_t *p, uint32_t cycles);
+
+#endif // PACER_H
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include "panel.h"
+#include "lcd.h"
+#include "shift_register.h"
+
+static void button_update(button_state_t *state, uint16_t current) {
+    state->previous = state->current;
+    state->current = current;
+}
+
+static bool button_pressed(button_state_t *state, uint16_t mask, int bit_index, uint32_t now) {
+    bool is_pressed = (state->current & mask) != 0;
+    bool was_pressed = (state->previous & mask) != 0;
+
+    if (is_pressed && !was_pressed) {
+        if (now - state->last_press_time[bit_index] >= DEBOUNCE_MS) {
+            state->last_press_time[bit_index] = now;
+            return true;
+        }
+    }
+    return false;
+}
+
+void panel_init(panel_t *panel) {
+    panel->buttons.current = 0;
+    panel->buttons.previous = 0;
+    for (int i = 0; i < 9; i++) {
+        panel->buttons.last_press_time[i] = 0;
+    }
+    panel->switches = 0;
+    panel->show_registers = false;
+    panel->display_dirty = true;
+    panel->cursor_pos = 0;
+    panel->last_cursor_time = 0;
+    panel->shown_seq = 0;
+    panel->shown_load_seq = 0;
+    panel->message_until = 0;
+    panel->shown_missed = 0;
+    panel->last_pacer_report = 0;
+}
+
+bool panel_scan(panel_t *panel, uint16_t switches, uint16_t buttons, uint32_t now, panel_input_t *out) {
+    static const uint16_t momentary[] = {
+        INPUT_SINGLE_STEP, INPUT_RESET, INPUT_STORE_ADDR, INPUT_STORE_BYTE, INPUT_STORE_WORD
+    };
+
+    bool changed = switches != panel->switches;
+    panel->switches = switches;
+    button_update(&panel->buttons, buttons);
+
+    out->switches = switches;
+    out->buttons = buttons;
+    out->pressed = 0;
+    for (int i = 0; i < (int)(sizeof(momentary) / sizeof(momentary[0])); i++) {
+        // Debounce slots are indexed by input bit number
+        if (button_pressed(&panel->buttons, momentary[i], i + 2, now)) {
+            out->pressed |= momentary[i];
+        }
+    }
+
+    return changed || out->pressed != 0 || buttons != panel->buttons.previous;
+}
+
+static void update_leds(const panel_snapshot_t *snap) {
+    uint16_t pattern = ((snap->cpu.pc >> 8) << 8) | snap->bytes[0];
+    sr_output(pattern);
+}
+
+static void update_lcd_registers(const panel_snapshot_t *snap) {
+    // Show CPU registers (20x2 display)
+    // Line 1: A:xx BC:xxxx DE:xxxx (19 chars)
+    // Line 2: HL:xxxx SP:xxxx F:xx (19 chars)
+    lcd_set_cursor(0, 0);
+    lcd_print("A:");
+    lcd_print_hex8(snap->cpu.a);
+    lcd_print(" BC:");
+    lcd_print_hex16((snap->cpu.b << 8) | snap->cpu.c);
+    lcd_print(" DE:");
+    lcd_print_hex16((snap->cpu.d << 8) | snap->cpu.e);
+
+    lcd_set_cursor(0, 1);
+    lcd_print("HL:");
+    lcd_print_hex16((snap->cpu.h << 8) | snap->cpu.l);
+    lcd_print(" SP:");
+    lcd_print_hex16(snap->cpu.sp);
+    lcd_print(" F:");
+    lcd_print_hex8(snap->cpu.f);
+
+    lcd_display(true, false, false);  // Display on, cursor off
+}
+
+static void update_lcd_disasm(panel_t *panel, const panel_snapshot_t *snap, uint32_t now) {
+    if (panel->display_dirty) {
+        panel->display_dirty = false;
+        panel->cursor_pos = 0;
+        panel->last_cursor_time = now;
+
+        lcd_clear();
+        lcd_set_cursor(0, 0);
+        lcd_print_hex16(snap->cpu.pc);
+        if (snap->pc_banked) {
+            lcd_putchar('/');
+            lcd_print_hex8(snap->bank);
+        }
+        lcd_print(": ");
+        lcd_print(snap->disasm);
+
+        lcd_set_cursor(0, 1);
+        for (int i = 0; i < 7; i++) {
+            if (i > 0) lcd_putchar('.');
+            lcd_print_hex8(snap->bytes[i]);
+        }
+    }
+
+    // Animate cursor every 100ms
+    if (now - panel->last_cursor_time >= 100) {
+        panel->last_cursor_time = now;
+        panel->cursor_pos++;
+        // For 1-byte instruction: cycle through positions 0,1 (2 chars)
+        // For 2-byte instruction: cycle through positions 0,1,3,4 (4 chars)
+        // For 3-byte instruction: cycle through positions 0,1,3,4,6,7 (6 chars)
+        if (panel->cursor_pos >= snap->instr_len * 2) {
+            panel->cursor_pos = 0;
+        }
+    }
+
+    // Calculate cursor column: each byte is 2 chars + 1 dot separator
+    // Byte 0: cols 0,1 | Byte 1: cols 3,4 | Byte 2: cols 6,7
+    uint8_t byte_idx = panel->cursor_pos / 2;
+    uint8_t char_in_byte = panel->cursor_pos % 2;
+    uint8_t col = byte_idx * 3 + char_in_byte;
+
+    lcd_set_cursor(col, 1);
+    lcd_display(true, true, false);  // Display on, cursor on
+}
+
+void panel_render(panel_t *panel, const panel_snapshot_t *snap, uint32_t now) {
+    if (snap->seq != panel->shown_seq) {
+        panel->shown_seq = snap->seq;
+        panel->display_dirty = true;
+    }
+
+    update_leds(snap);
+
+    // Show which program RESET loaded for a moment
+    if (snap->load_seq != panel->shown_load_seq) {
+        panel->shown_load_seq = snap->load_seq;
+        if (snap->loaded_name) {
+            lcd_clear();
+            lcd_set_cursor(0, 0);
+            lcd_print("Loaded: ");
+            lcd_print(snap->loaded_name);
+            lcd_display(true, false, false);
+            panel->message_until = now + PANEL_MESSAGE_MS;
+        }
+    }
+    // Report pacing deadlines missed since the last report
+    if (snap->missed_deadlines != panel->shown_missed &&
+        now - panel->last_pacer_report >= PANEL_PACER_REPORT_MS &&
+        (int32_t)(panel->message_until - now) <= 0) {
+        char line[21];
+        lcd_clear();
+        lcd_set_cursor(0, 0);
+        snprintf(line, sizeof(line), "Missed: %lu",
+                 (unsigned long)(snap->missed_deadlines - panel->shown_missed));
+        lcd_print(line);
+        lcd_set_cursor(0, 1);
+        snprintf(line, sizeof(line), "Dropped: %llu",
+                 (unsigned long long)snap->dropped_cycles);
+        lcd_print(line);
+        lcd_display(true, false, false);
+        panel->shown_missed = snap->missed_deadlines;
+        panel->last_pacer_report = now;
+        panel->message_until = now + PANEL_MESSAGE_MS;
+        panel->display_dirty = true;
+    }
+    if ((int32_t)(panel->message_until - now) > 0) {
+        return;
+    }
+
+    // Check if display mode changed
+    bool key_off = !(panel->buttons.current & INPUT_KEY_SWITCH);
+    if (key_off != panel->show_registers) {
+        panel->show_registers = key_off;
+        lcd_clear();
+        panel->display_dirty = true;
+    }
+
+    if (panel->show_registers) {
+        update_lcd_registers(snap);
+    } else {
+        update_lcd_disasm(panel, snap, now);
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef PANEL_H
+#define PANEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu8080.h"
+
+#define INPUT_STOP_RUN_BIT1   0x001
+#define INPUT_STOP_RUN_BIT2   0x002
+#define INPUT_SINGLE_STEP     0x004
+#define INPUT_RESET           0x008
+#define INPUT_STORE_ADDR      0x010
+#define INPUT_STORE_BYTE      0x020
+#define INPUT_STORE_WORD      0x040
+#define INPUT_AUTO_INC        0x080
+#define INPUT_KEY_SWITCH      0x100
+
+#define DEBOUNCE_MS 50
+
+// How long the "Loaded: <program>" message stays on the LCD
+#define PANEL_MESSAGE_MS 500
+
+// Missed pacing deadlines are shown as a message at most this often, since
+// the USB port carries the console or a session
+#define PANEL_PACER_REPORT_MS 5000
+
+typedef struct {
+    uint16_t current;
+    uint16_t previous;
+    uint32_t last_press_time[9];
+} button_state_t;
+
+// Input event sent from the front panel to the emulator
+typedef struct {
+    uint16_t switches;
+    uint16_t buttons;   // current level of every button/switch
+    uint16_t pressed;   // debounced presses since the previous event
+} panel_input_t;
+
+// Everything the front panel shows, captured by the emulator
+typedef struct {
+    uint32_t seq;               // changes whenever the view changes
+    cpu8080_t cpu;              // register copy, F already materialized
+    uint8_t bytes[7];           // memory starting at cpu.pc
+    bool pc_banked;             // cpu.pc is in the bank-switched window
+    uint8_t bank;               // bank mapped there
+    char disasm[12];
+    uint8_t instr_len;
+    const char *loaded_name;    // program loaded by the last RESET, or NULL
+    uint32_t load_seq;          // bumped on every program load
+    uint32_t missed_deadlines;
+    uint64_t dropped_cycles;
+} panel_snapshot_t;
+
+typedef struct {
+    button_state_t buttons;
+    uint16_t switches;
+    bool show_registers;
+    bool display_dirty;
+    uint8_t cursor_pos;
+    uint32_t last_cursor_time;
+    uint32_t shown_seq;
+    uint32_t shown_load_seq;
+    uint32_t message_until;
+    uint32_t shown_missed;
+    uint32_t last_pacer_report;
+} panel_t;
+
+void panel_init(panel_t *panel);
+
+// Debounce raw switch/button readings. Fills *out and returns true when
+// anything changed since the previous scan.
+bool panel_scan(panel_t *panel, uint16_t switches, uint16_t buttons, uint32_t now, panel_input_t *out);
+
+// Drive the LEDs and LCD from a snapshot
+void panel_render(panel_t *panel, const panel_snapshot_t *snap, uint32_t now);
+
+#endif // PANEL_H
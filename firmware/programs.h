@@ -125,12 +125,221 @@ static const uint8_t prog_stack_test[] = {
 #define PROG_STACK_TEST_ADDR 0x0000
 #define PROG_STACK_TEST_SIZE sizeof(prog_stack_test)
 
+// CP/M 2.2 for a 64K machine: a BIOS for the console (88-2SIO at
+// CONSOLE_PORT) and the floppy controller (disk.h at DISK_PORT), loaded at
+// 0xFA00 with a jump to it at 0x0000. Cold and warm boot both load the CCP
+// and BDOS from the system tracks of drive A, the standard 8" layout: 44
+// sectors from track 0 sector 2 to 0xE400 (the BDOS is entered at
+// 0xEC06). The BIOS on the disk is never loaded.
+//
+// Ports: SIO_STAT 0x10, SIO_DATA 0x11; DSK_SEL 0x20, DSK_TRK 0x21,
+// DSK_SEC 0x22, DSK_DMAL 0x23, DSK_DMAH 0x24, DSK_CMD 0x25
+//
+// Drives A-D are IBM 3740 disks with the standard skew. Their work areas
+// follow the code: DRIVE FBBD, TRACK FBBE, SECTOR FBBF, DMAADR FBC0,
+// DIRBUF FBC2, ALV0-3 FC42 (31 bytes each), CSV0-3 FCBE (16 each), up to
+// FCFE.
+//
+static const uint8_t prog_cpm_bios[] = {
+    0xC3, 0x33, 0xFA, // FA00 JMP BOOT
+    0xC3, 0x4B, 0xFA, // FA03 WBOOTE: JMP WBOOT
+    0xC3, 0xB4, 0xFA, // FA06 JMP CONST
+    0xC3, 0xBC, 0xFA, // FA09 JMP CONIN
+    0xC3, 0xC8, 0xFA, // FA0C JMP CONOUT
+    0xC3, 0xD5, 0xFA, // FA0F JMP LIST
+    0xC3, 0xD5, 0xFA, // FA12 JMP PUNCH
+    0xC3, 0xD3, 0xFA, // FA15 JMP READER
+    0xC3, 0xD8, 0xFA, // FA18 JMP HOME
+    0xC3, 0xEA, 0xFA, // FA1B JMP SELDSK
+    0xC3, 0xDA, 0xFA, // FA1E JMP SETTRK
+    0xC3, 0xDF, 0xFA, // FA21 JMP SETSEC
+    0xC3, 0xE4, 0xFA, // FA24 JMP SETDMA
+    0xC3, 0x0B, 0xFB, // FA27 JMP READ
+    0xC3, 0x10, 0xFB, // FA2A JMP WRITE
+    0xC3, 0xD6, 0xFA, // FA2D JMP LISTST
+    0xC3, 0x05, 0xFB, // FA30 JMP SECTRAN
+    0x31, 0x80, 0x00, // FA33 BOOT: LXI SP, 0x0080
+    0x3E, 0x03,       // FA36 MVI A, 0x03
+    0xD3, 0x10,       // FA38 OUT SIO_STAT
+    0x3E, 0x15,       // FA3A MVI A, 0x15
+    0xD3, 0x10,       // FA3C OUT SIO_STAT
+    0xAF,             // FA3E XRA A
+    0x32, 0x03, 0x00, // FA3F STA 0x0003
+    0x32, 0x04, 0x00, // FA42 STA 0x0004
+    0x21, 0x34, 0xFB, // FA45 LXI H, SIGNON
+    0xCD, 0xA9, 0xFA, // FA48 CALL PRINT
+    0x31, 0x80, 0x00, // FA4B WBOOT: LXI SP, 0x0080
+    0xAF,             // FA4E XRA A
+    0xD3, 0x20,       // FA4F OUT DSK_SEL
+    0xD3, 0x21,       // FA51 OUT DSK_TRK
+    0x21, 0x00, 0xE4, // FA53 LXI H, CCP
+    0x06, 0x2C,       // FA56 MVI B, SYSSECS
+    0x0E, 0x02,       // FA58 MVI C, 2
+    0x79,             // FA5A LOAD: MOV A, C
+    0xD3, 0x22,       // FA5B OUT DSK_SEC
+    0x7D,             // FA5D MOV A, L
+    0xD3, 0x23,       // FA5E OUT DSK_DMAL
+    0x7C,             // FA60 MOV A, H
+    0xD3, 0x24,       // FA61 OUT DSK_DMAH
+    0xAF,             // FA63 XRA A
+    0xD3, 0x25,       // FA64 OUT DSK_CMD
+    0xDB, 0x25,       // FA66 IN DSK_CMD
+    0xB7,             // FA68 ORA A
+    0xC2, 0xA2, 0xFA, // FA69 JNZ LOADERR
+    0x11, 0x80, 0x00, // FA6C LXI D, 128
+    0x19,             // FA6F DAD D
+    0x0C,             // FA70 INR C
+    0x79,             // FA71 MOV A, C
+    0xFE, 0x1B,       // FA72 CPI 27
+    0xC2, 0x7D, 0xFA, // FA74 JNZ LOADNX
+    0x0E, 0x01,       // FA77 MVI C, 1
+    0x3E, 0x01,       // FA79 MVI A, 1
+    0xD3, 0x21,       // FA7B OUT DSK_TRK
+    0x05,             // FA7D LOADNX: DCR B
+    0xC2, 0x5A, 0xFA, // FA7E JNZ LOAD
+    0x3E, 0xC3,       // FA81 MVI A, 0xC3
+    0x32, 0x00, 0x00, // FA83 STA 0x0000
+    0x21, 0x03, 0xFA, // FA86 LXI H, WBOOTE
+    0x22, 0x01, 0x00, // FA89 SHLD 0x0001
+    0x32, 0x05, 0x00, // FA8C STA 0x0005
+    0x21, 0x06, 0xEC, // FA8F LXI H, BDOS
+    0x22, 0x06, 0x00, // FA92 SHLD 0x0006
+    0x01, 0x80, 0x00, // FA95 LXI B, 0x0080
+    0xCD, 0xE4, 0xFA, // FA98 CALL SETDMA
+    0x3A, 0x04, 0x00, // FA9B LDA 0x0004
+    0x4F,             // FA9E MOV C, A
+    0xC3, 0x00, 0xE4, // FA9F JMP CCP
+    0x21, 0x45, 0xFB, // FAA2 LOADERR: LXI H, BOOTERR
+    0xCD, 0xA9, 0xFA, // FAA5 CALL PRINT
+    0x76,             // FAA8 HLT
+    0x7E,             // FAA9 PRINT: MOV A, M
+    0xB7,             // FAAA ORA A
+    0xC8,             // FAAB RZ
+    0x4F,             // FAAC MOV C, A
+    0xCD, 0xC8, 0xFA, // FAAD CALL CONOUT
+    0x23,             // FAB0 INX H
+    0xC3, 0xA9, 0xFA, // FAB1 JMP PRINT
+    0xDB, 0x10,       // FAB4 CONST: IN SIO_STAT
+    0xE6, 0x01,       // FAB6 ANI 0x01
+    0xC8,             // FAB8 RZ
+    0x3E, 0xFF,       // FAB9 MVI A, 0xFF
+    0xC9,             // FABB RET
+    0xDB, 0x10,       // FABC CONIN: IN SIO_STAT
+    0xE6, 0x01,       // FABE ANI 0x01
+    0xCA, 0xBC, 0xFA, // FAC0 JZ CONIN
+    0xDB, 0x11,       // FAC3 IN SIO_DATA
+    0xE6, 0x7F,       // FAC5 ANI 0x7F
+    0xC9,             // FAC7 RET
+    0xDB, 0x10,       // FAC8 CONOUT: IN SIO_STAT
+    0xE6, 0x02,       // FACA ANI 0x02
+    0xCA, 0xC8, 0xFA, // FACC JZ CONOUT
+    0x79,             // FACF MOV A, C
+    0xD3, 0x11,       // FAD0 OUT SIO_DATA
+    0xC9,             // FAD2 RET
+    0x3E, 0x1A,       // FAD3 READER: MVI A, 0x1A
+    0xC9,             // FAD5 LIST: PUNCH: RET
+    0xAF,             // FAD6 LISTST: XRA A
+    0xC9,             // FAD7 RET
+    0x0E, 0x00,       // FAD8 HOME: MVI C, 0
+    0x79,             // FADA SETTRK: MOV A, C
+    0x32, 0xBE, 0xFB, // FADB STA TRACK
+    0xC9,             // FADE RET
+    0x79,             // FADF SETSEC: MOV A, C
+    0x32, 0xBF, 0xFB, // FAE0 STA SECTOR
+    0xC9,             // FAE3 RET
+    0x60,             // FAE4 SETDMA: MOV H, B
+    0x69,             // FAE5 MOV L, C
+    0x22, 0xC0, 0xFB, // FAE6 SHLD DMAADR
+    0xC9,             // FAE9 RET
+    0x21, 0x00, 0x00, // FAEA SELDSK: LXI H, 0
+    0x79,             // FAED MOV A, C
+    0xFE, 0x04,       // FAEE CPI NDISKS
+    0xD0,             // FAF0 RNC
+    0xD3, 0x20,       // FAF1 OUT DSK_SEL
+    0xDB, 0x20,       // FAF3 IN DSK_SEL
+    0xB7,             // FAF5 ORA A
+    0xC0,             // FAF6 RNZ
+    0x79,             // FAF7 MOV A, C
+    0x32, 0xBD, 0xFB, // FAF8 STA DRIVE
+    0x69,             // FAFB MOV L, C
+    0x29,             // FAFC DAD H
+    0x29,             // FAFD DAD H
+    0x29,             // FAFE DAD H
+    0x29,             // FAFF DAD H
+    0x11, 0x54, 0xFB, // FB00 LXI D, DPBASE
+    0x19,             // FB03 DAD D
+    0xC9,             // FB04 RET
+    0xEB,             // FB05 SECTRAN: XCHG
+    0x09,             // FB06 DAD B
+    0x6E,             // FB07 MOV L, M
+    0x26, 0x00,       // FB08 MVI H, 0
+    0xC9,             // FB0A RET
+    0x06, 0x00,       // FB0B READ: MVI B, 0
+    0xC3, 0x12, 0xFB, // FB0D JMP XFER
+    0x06, 0x01,       // FB10 WRITE: MVI B, 1
+    0x3A, 0xBD, 0xFB, // FB12 XFER: LDA DRIVE
+    0xD3, 0x20,       // FB15 OUT DSK_SEL
+    0x3A, 0xBE, 0xFB, // FB17 LDA TRACK
+    0xD3, 0x21,       // FB1A OUT DSK_TRK
+    0x3A, 0xBF, 0xFB, // FB1C LDA SECTOR
+    0xD3, 0x22,       // FB1F OUT DSK_SEC
+    0x2A, 0xC0, 0xFB, // FB21 LHLD DMAADR
+    0x7D,             // FB24 MOV A, L
+    0xD3, 0x23,       // FB25 OUT DSK_DMAL
+    0x7C,             // FB27 MOV A, H
+    0xD3, 0x24,       // FB28 OUT DSK_DMAH
+    0x78,             // FB2A MOV A, B
+    0xD3, 0x25,       // FB2B OUT DSK_CMD
+    0xDB, 0x25,       // FB2D IN DSK_CMD
+    0xB7,             // FB2F ORA A
+    0xC8,             // FB30 RZ
+    0x3E, 0x01,       // FB31 MVI A, 1
+    0xC9,             // FB33 RET
+    0x0D, 0x0A, 0x36, 0x34, 0x4B, 0x20, 0x43, 0x50, // FB34 SIGNON: DB 13, 10, "64K CP/M 2.2", 13, 10, 0
+    0x2F, 0x4D, 0x20, 0x32, 0x2E, 0x32, 0x0D, 0x0A, // FB3C
+    0x00,             // FB44
+    0x0D, 0x0A, 0x42, 0x4F, 0x4F, 0x54, 0x20, 0x45, // FB45 BOOTERR: DB 13, 10, "BOOT ERROR", 13, 10, 0
+    0x52, 0x52, 0x4F, 0x52, 0x0D, 0x0A, 0x00, // FB4D
+    0xA3, 0xFB, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // FB54 DPBASE: DW XLT, 0, 0, 0, DIRBUF, DPB, CSV0, ALV0
+    0xC2, 0xFB, 0x94, 0xFB, 0xBE, 0xFC, 0x42, 0xFC, // FB5C
+    0xA3, 0xFB, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // FB64 DW XLT, 0, 0, 0, DIRBUF, DPB, CSV1, ALV1
+    0xC2, 0xFB, 0x94, 0xFB, 0xCE, 0xFC, 0x61, 0xFC, // FB6C
+    0xA3, 0xFB, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // FB74 DW XLT, 0, 0, 0, DIRBUF, DPB, CSV2, ALV2
+    0xC2, 0xFB, 0x94, 0xFB, 0xDE, 0xFC, 0x80, 0xFC, // FB7C
+    0xA3, 0xFB, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // FB84 DW XLT, 0, 0, 0, DIRBUF, DPB, CSV3, ALV3
+    0xC2, 0xFB, 0x94, 0xFB, 0xEE, 0xFC, 0x9F, 0xFC, // FB8C
+    0x1A, 0x00,       // FB94 DPB: DW 26          ; SPT, sectors per track
+    0x03, 0x07, 0x00, // FB96 DB 3, 7, 0       ; BSH, BLM, EXM: 1K blocks
+    0xF2, 0x00, 0x3F, 0x00, // FB99 DW 242, 63        ; DSM, DRM: 243 blocks, 64 entries
+    0xC0, 0x00,       // FB9D DB 0xC0, 0        ; AL0, AL1: directory blocks
+    0x10, 0x00, 0x02, 0x00, // FB9F DW 16, 2          ; CKS, OFF: 2 system tracks
+    0x01, 0x07, 0x0D, 0x13, 0x19, 0x05, 0x0B, 0x11, // FBA3 XLT: DB 1, 7, 13, 19, 25, 5, 11, 17, 23, 3, 9, 15, 21
+    0x17, 0x03, 0x09, 0x0F, 0x15, // FBAB
+    0x02, 0x08, 0x0E, 0x14, 0x1A, 0x06, 0x0C, 0x12, // FBB0 DB 2, 8, 14, 20, 26, 6, 12, 18, 24, 4, 10, 16, 22
+    0x18, 0x04, 0x0A, 0x10, 0x16 // FBB8
+};
+#define PROG_CPM_BIOS_ADDR 0xFA00
+#define PROG_CPM_BIOS_SIZE sizeof(prog_cpm_bios)
+
+// 0000: JMP FA00     ; BIOS cold boot
+static const uint8_t prog_cpm_boot[] = {
+    0xC3, 0x00, 0xFA  // JMP 0xFA00
+};
+#define PROG_CPM_BOOT_ADDR 0x0000
+#define PROG_CPM_BOOT_SIZE sizeof(prog_cpm_boot)
+
 // Helper to load a program into memory
 #include "memory.h"
-static inline void load_program(uint16_t addr, const uint8_t *prog, uint16_t size) {
+static inline void load_program(bus_t *bus, uint16_t addr, const uint8_t *prog, uint16_t size) {
     for (uint16_t i = 0; i < size; i++) {
-        memory_write(addr + i, prog[i]);
+        memory_write(bus, addr + i, prog[i]);
     }
 }
 
+// CP/M's BIOS and the jump to its cold boot, ready to run from 0x0000
+static inline void load_cpm(bus_t *bus) {
+    load_program(bus, PROG_CPM_BIOS_ADDR, prog_cpm_bios, PROG_CPM_BIOS_SIZE);
+    load_program(bus, PROG_CPM_BOOT_ADDR, prog_cpm_boot, PROG_CPM_BOOT_SIZE);
+}
+
 #endif // PROGRAMS_H
@@ -0,0 +1,173 @@
+#include "rewind.h"
+#include "memory.h"
+
+// Entry layout, oldest byte first:
+//   header      bits 0-1 write count, bit 2 halted, bit 3 inte, bit 4 bank saved
+//   registers   A F B C D E H L, then SP and PC low byte first
+//   interrupts  irq, then cycles until int_at (0 if passed, at most 255)
+//   cycles      low 32 bits, low byte first
+//   writes      address low, high and the old byte, per write
+//   bank        bank mapped before, if saved
+//   length      of the whole entry, so the newest one can be found from head
+#define HDR_WRITES  0x03
+#define HDR_HALTED  0x04
+#define HDR_INTE    0x08
+#define HDR_BANK    0x10
+#define ENTRY_REGS  19
+#define ENTRY_MAX   (ENTRY_REGS + 2 * 3 + 1 + 1)
+
+static uint32_t entry_length(uint8_t hdr) {
+    return ENTRY_REGS + 3 * (hdr & HDR_WRITES) + ((hdr & HDR_BANK) ? 1 : 0) + 1;
+}
+
+void rewind_init(rewind_t *rw, uint8_t *buf, uint32_t size) {
+    rw->buf = buf;
+    rw->size = size;
+    rw->effects = 0;
+    rewind_clear(rw);
+}
+
+void rewind_clear(rewind_t *rw) {
+    rw->head = 0;
+    rw->used = 0;
+    rw->depth = 0;
+    rw->serial = 0;
+}
+
+// Drop the history if a device did something stepping back can't undo
+// since the newest entry, as a run that isn't recorded does
+static bool history_valid(rewind_t *rw, const cpu8080_t *cpu) {
+    if (cpu->bus->port_effects == rw->effects) return true;
+    rewind_clear(rw);
+    rw->effects = cpu->bus->port_effects;
+    return false;
+}
+
+static void drop_oldest(rewind_t *rw) {
+    uint32_t tail = (rw->head + rw->size - rw->used) % rw->size;
+    rw->used -= entry_length(rw->buf[tail]);
+    rw->depth--;
+}
+
+static void record(rewind_t *rw, cpu8080_t *cpu, const uint16_t *addr, int count, bool save_bank) {
+    bus_t *bus = cpu->bus;
+    uint8_t e[ENTRY_MAX];
+    uint8_t hdr = 0;
+    uint32_t n = ENTRY_REGS;
+
+    history_valid(rw, cpu);
+
+    // Device pages can't be written back, so they aren't saved
+    for (int i = 0; i < count; i++) {
+        if (memory_is_ram(bus, addr[i], 1)) {
+            e[n++] = addr[i] & 0xFF;
+            e[n++] = addr[i] >> 8;
+            e[n++] = memory_peek(bus, MEMORY_BANK_CURRENT, addr[i]);
+            hdr++;
+        }
+    }
+    if (save_bank) {
+        e[n++] = bus->banks.current;
+        hdr |= HDR_BANK;
+    }
+    e[n] = n + 1;
+    n++;
+
+    hdr |= (cpu->halted ? HDR_HALTED : 0) | (cpu->inte ? HDR_INTE : 0);
+    e[0] = hdr;
+    e[1] = cpu->a;
+    e[2] = cpu8080_get_f(cpu);
+    e[3] = cpu->b;
+    e[4] = cpu->c;
+    e[5] = cpu->d;
+    e[6] = cpu->e;
+    e[7] = cpu->h;
+    e[8] = cpu->l;
+    e[9] = cpu->sp & 0xFF;
+    e[10] = cpu->sp >> 8;
+    e[11] = cpu->pc & 0xFF;
+    e[12] = cpu->pc >> 8;
+    e[13] = cpu->irq;
+    e[14] = cpu->int_at <= cpu->cycles ? 0 : cpu->int_at - cpu->cycles > 255 ? 255 : cpu->int_at - cpu->cycles;
+    e[15] = cpu->cycles & 0xFF;
+    e[16] = (cpu->cycles >> 8) & 0xFF;
+    e[17] = (cpu->cycles >> 16) & 0xFF;
+    e[18] = (cpu->cycles >> 24) & 0xFF;
+
+    if (n > rw->size) return;
+    while (rw->size - rw->used < n) {
+        drop_oldest(rw);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        rw->buf[(rw->head + i) % rw->size] = e[i];
+    }
+    rw->head = (rw->head + n) % rw->size;
+    rw->used += n;
+    rw->depth++;
+    rw->serial++;
+}
+
+void rewind_record(rewind_t *rw, cpu8080_t *cpu) {
+    bus_t *bus = cpu->bus;
+    uint16_t addr[2];
+    int count = cpu8080_next_writes(cpu, addr);
+
+    // OUT to the bank port remaps memory
+    bool save_bank = bus->banks.count > 1 &&
+                     memory_peek(bus, MEMORY_BANK_CURRENT, cpu->pc) == 0xD3 &&
+                     memory_peek(bus, MEMORY_BANK_CURRENT, cpu->pc + 1) == bus->banks.port;
+    record(rw, cpu, addr, count, save_bank);
+}
+
+void rewind_record_writes(rewind_t *rw, cpu8080_t *cpu, const uint16_t *addr, int count) {
+    record(rw, cpu, addr, count, false);
+}
+
+bool rewind_step_back(rewind_t *rw, cpu8080_t *cpu) {
+    if (!history_valid(rw, cpu) || rw->depth == 0) return false;
+
+    bus_t *bus = cpu->bus;
+    uint8_t e[ENTRY_MAX];
+    uint32_t len = rw->buf[(rw->head + rw->size - 1) % rw->size];
+    uint32_t start = (rw->head + rw->size - len) % rw->size;
+    for (uint32_t i = 0; i < len; i++) {
+        e[i] = rw->buf[(start + i) % rw->size];
+    }
+
+    uint8_t hdr = e[0];
+    uint32_t n = ENTRY_REGS;
+    int writes = hdr & HDR_WRITES;
+
+    // Bytes were saved with the old bank mapped, so put it back first
+    if (hdr & HDR_BANK) {
+        memory_select_bank(bus, e[n + 3 * writes]);
+    }
+    for (int i = 0; i < writes; i++, n += 3) {
+        memory_write(bus, e[n] | (e[n + 1] << 8), e[n + 2]);
+    }
+
+    cpu->a = e[1];
+    cpu->f = e[2];
+    cpu->lazy_pending = false;
+    cpu->b = e[3];
+    cpu->c = e[4];
+    cpu->d = e[5];
+    cpu->e = e[6];
+    cpu->h = e[7];
+    cpu->l = e[8];
+    cpu->sp = e[9] | (e[10] << 8);
+    cpu->pc = e[11] | (e[12] << 8);
+    cpu->halted = (hdr & HDR_HALTED) != 0;
+    cpu->inte = (hdr & HDR_INTE) != 0;
+    cpu->irq = e[13];
+    uint32_t low = e[15] | (e[16] << 8) | (e[17] << 16) | ((uint32_t)e[18] << 24);
+    cpu->cycles -= (uint32_t)((uint32_t)cpu->cycles - low);
+    cpu->int_at = cpu->cycles + e[14];
+    cpu8080_update_attention(cpu);
+
+    rw->head = start;
+    rw->used -= len;
+    rw->depth--;
+    rw->serial--;
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu8080.h"
+
+// Undo history for stepping backwards. Before each recorded instruction
+// (or panel edit) the registers and the RAM bytes it is about to overwrite
+// go into a byte ring, about 21-27 bytes per entry. When the ring is full
+// the oldest entries are dropped.
+//
+// Device I/O and device events that change state can't be undone. Devices
+// report them with memory_port_effect() and the history before them is
+// dropped: stepping back stops at the first instruction after the last one.
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t head;      // where the next entry goes
+    uint32_t used;      // bytes holding entries
+    uint32_t depth;     // entries held
+    uint32_t serial;    // number of the newest entry, counts back on undo
+    uint32_t effects;   // bus->port_effects when the newest entry was made
+} rewind_t;
+
+void rewind_init(rewind_t *rw, uint8_t *buf, uint32_t size);
+
+// Forget everything, e.g. after memory was replaced wholesale
+void rewind_clear(rewind_t *rw);
+
+// Record the state before the instruction at cpu->pc runs
+void rewind_record(rewind_t *rw, cpu8080_t *cpu);
+
+// Record the state before a change that writes count bytes at addr[]
+void rewind_record_writes(rewind_t *rw, cpu8080_t *cpu, const uint16_t *addr, int count);
+
+// Undo the newest entry. Returns false if there's no history left.
+bool rewind_step_back(rewind_t *rw, cpu8080_t *cpu);
+
+#endif
@@ -0,0 +1,157 @@
+#include "session.h"
+#include <string.h>
+
+#define TAG_SWITCHES 0x01
+#define TAG_BUTTONS  0x02
+#define TAG_MS       0x04
+#define TAG_CONSOLE  0x08
+
+static uint32_t put_leb128(uint8_t *buf, uint64_t v) {
+    uint32_t n = 0;
+    do {
+        buf[n++] = (v & 0x7F) | (v > 0x7F ? 0x80 : 0);
+        v >>= 7;
+    } while (v);
+    return n;
+}
+
+// Returns the bytes read, 0 if v runs past left
+static uint32_t get_leb128(const uint8_t *p, uint32_t left, uint64_t *v) {
+    uint32_t n = 0;
+    *v = 0;
+    for (int shift = 0;; shift += 7) {
+        if (n >= left || shift > 63) return 0;
+        uint8_t b = p[n++];
+        *v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return n;
+    }
+}
+
+void session_record_start(session_recorder_t *rec, session_write_t write, void *ctx) {
+    rec->write = write;
+    rec->ctx = ctx;
+    rec->started = false;
+    rec->events = 0;
+    rec->console_len = 0;
+}
+
+void session_record_console(session_recorder_t *rec, const uint8_t *data, uint32_t len) {
+    if (len > session_console_room(rec)) len = session_console_room(rec);
+    memcpy(rec->console + rec->console_len, data, len);
+    rec->console_len += len;
+}
+
+void session_record(session_recorder_t *rec, uint64_t now_us, uint16_t switches, uint16_t buttons) {
+    uint8_t buf[SESSION_HEADER_SIZE + SESSION_EVENT_MAX];
+    uint32_t n = 0;
+
+    if (!rec->started) {
+        memcpy(buf, SESSION_MAGIC, 8);
+        for (int i = 0; i < 8; i++) {
+            buf[8 + i] = now_us >> (8 * i);
+        }
+        n = SESSION_HEADER_SIZE;
+        rec->last.time_us = now_us;
+        rec->last.switches = 0;
+        rec->last.buttons = 0;
+        rec->started = true;
+    }
+
+    // A clock that steps back is held where it was, replay can't go back
+    uint64_t step = now_us > rec->last.time_us ? now_us - rec->last.time_us : 0;
+    uint8_t tag = 0;
+    if (switches != rec->last.switches) tag |= TAG_SWITCHES;
+    if (buttons != rec->last.buttons) tag |= TAG_BUTTONS;
+    if (step % 1000 == 0) tag |= TAG_MS;
+    if (rec->console_len > 0) tag |= TAG_CONSOLE;
+
+    buf[n++] = tag;
+    n += put_leb128(buf + n, (tag & TAG_MS) ? step / 1000 : step);
+    if (tag & TAG_SWITCHES) {
+        buf[n++] = switches & 0xFF;
+        buf[n++] = switches >> 8;
+    }
+    if (tag & TAG_BUTTONS) {
+        buf[n++] = buttons & 0xFF;
+        buf[n++] = buttons >> 8;
+    }
+    if (tag & TAG_CONSOLE) {
+        n += put_leb128(buf + n, rec->console_len);
+    }
+
+    rec->last.time_us += step;
+    rec->last.switches = switches;
+    rec->last.buttons = buttons;
+    rec->events++;
+    rec->write(rec->ctx, buf, n);
+    if (tag & TAG_CONSOLE) {
+        rec->write(rec->ctx, rec->console, rec->console_len);
+        rec->console_len = 0;
+    }
+}
+
+// Decode the event at play->pos into play->next
+static void decode_next(session_player_t *play) {
+    const uint8_t *p = play->data + play->pos;
+    uint32_t left = play->size - play->pos;
+    uint32_t n = 0;
+
+    play->have_next = false;
+    if (left == 0) return;
+
+    uint8_t tag = p[n++];
+    uint64_t step;
+    uint32_t len = get_leb128(p + n, left - n, &step);
+    if (len == 0) return;
+    n += len;
+    if (tag & TAG_MS) step *= 1000;
+
+    uint32_t values = ((tag & TAG_SWITCHES) ? 2 : 0) + ((tag & TAG_BUTTONS) ? 2 : 0);
+    if (left - n < values) return;
+    if (tag & TAG_SWITCHES) {
+        play->next.switches = p[n] | (p[n + 1] << 8);
+        n += 2;
+    }
+    if (tag & TAG_BUTTONS) {
+        play->next.buttons = p[n] | (p[n + 1] << 8);
+        n += 2;
+    }
+    play->next.console = NULL;
+    play->next.console_len = 0;
+    if (tag & TAG_CONSOLE) {
+        uint64_t count;
+        len = get_leb128(p + n, left - n, &count);
+        if (len == 0 || left - n - len < count) return;
+        play->next.console = p + n + len;
+        play->next.console_len = count;
+        n += len + count;
+    }
+    play->next.time_us += step;
+    play->pos += n;
+    play->have_next = true;
+}
+
+bool session_play_start(session_player_t *play, const uint8_t *data, uint32_t size) {
+    play->have_next = false;
+    if (size < SESSION_HEADER_SIZE || memcmp(data, SESSION_MAGIC, 8) != 0) return false;
+
+    play->data = data;
+    play->size = size;
+    play->pos = SESSION_HEADER_SIZE;
+    play->start_us = 0;
+    for (int i = 0; i < 8; i++) {
+        play->start_us |= (uint64_t)data[8 + i] << (8 * i);
+    }
+    play->next.time_us = play->start_us;
+    play->next.switches = 0;
+    play->next.buttons = 0;
+    decode_next(play);
+    return true;
+}
+
+bool session_next(session_player_t *play, session_event_t *ev) {
+    if (!play->have_next) return false;
+    *ev = play->next;
+    decode_next(play);
+    return true;
+}
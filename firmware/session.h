@@ -0,0 +1,91 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Recorded front panel sessions. Every emulator_update() call is logged as
+// (time, switches, buttons), with the console input queued since the
+// previous call (emulator_console_write()), and can be fed back later to
+// reproduce the run exactly, starting from a freshly initialized emulator.
+//
+// Stream format: the 8-byte magic "8080SES1", the start time (8 bytes,
+// little-endian microseconds), then one event per call:
+//   tag      bit 0 switches follow, bit 1 buttons follow, bit 2 the time
+//            step is in whole milliseconds instead of microseconds, bit 3
+//            console input follows
+//   step     time since the previous event, LEB128
+//   values   switches and/or buttons as they changed, 2 bytes each
+//   console  byte count (LEB128) and the bytes, queued before the call runs
+// A truncated last event is ignored, so a capture can be cut off anywhere.
+//
+// Disk contents aren't recorded: a replay only matches when the drives
+// hold what they held when recording started. The web build copies the
+// disks aside at record start and puts the copies back before a replay.
+
+#define SESSION_MAGIC "8080SES1"
+#define SESSION_HEADER_SIZE 16
+#define SESSION_EVENT_MAX 18    // tag, 10-byte step, two values, 3-byte count
+
+// Console bytes one event can carry, a console ring's worth
+#ifndef SESSION_CONSOLE_MAX
+#define SESSION_CONSOLE_MAX 4096
+#endif
+
+typedef struct {
+    uint64_t time_us;
+    uint16_t switches;
+    uint16_t buttons;
+    const uint8_t *console;     // input queued before the event, in the stream
+    uint32_t console_len;
+} session_event_t;
+
+// Where recorded bytes go: USB CDC, a file, a growing buffer...
+typedef void (*session_write_t)(void *ctx, const uint8_t *data, uint32_t len);
+
+typedef struct {
+    session_write_t write;
+    void *ctx;
+    bool started;       // header written
+    session_event_t last;
+    uint32_t events;
+    uint8_t console[SESSION_CONSOLE_MAX];   // input for the next event
+    uint32_t console_len;
+} session_recorder_t;
+
+typedef struct {
+    const uint8_t *data;
+    uint32_t size;
+    uint32_t pos;
+    uint64_t start_us;
+    bool have_next;
+    session_event_t next;   // decoded ahead, so it can be waited for
+} session_player_t;
+
+// Start a new stream. The header goes out with the first event.
+void session_record_start(session_recorder_t *rec, session_write_t write, void *ctx);
+
+void session_record(session_recorder_t *rec, uint64_t now_us, uint16_t switches, uint16_t buttons);
+
+// Console input goes out with the next event
+static inline uint32_t session_console_room(const session_recorder_t *rec) {
+    return SESSION_CONSOLE_MAX - rec->console_len;
+}
+void session_record_console(session_recorder_t *rec, const uint8_t *data, uint32_t len);
+
+// Returns false if data doesn't start with a session header
+bool session_play_start(session_player_t *play, const uint8_t *data, uint32_t size);
+
+// Time of the next event, relative to the start of the stream
+static inline uint64_t session_next_offset_us(const session_player_t *play) {
+    return play->next.time_us - play->start_us;
+}
+
+static inline bool session_play_done(const session_player_t *play) {
+    return !play->have_next;
+}
+
+// Take the next event. Returns false at the end of the stream.
+bool session_next(session_player_t *play, session_event_t *ev);
+
+#endif
@@ -0,0 +1,95 @@
+#include "sio.h"
+
+static bool irq_wanted(sio_t *sio) {
+    return ((sio->control & SIO_CONTROL_RX_INT) && !spsc_empty(&sio->rx)) ||
+           ((sio->control & SIO_CONTROL_TX_MASK) == SIO_CONTROL_TX_INT && !spsc_full(&sio->tx));
+}
+
+static void poll(void *ctx, uint64_t cycle);
+
+// Follow the interrupt line. Input arrives from another thread without
+// telling the CPU, so it is looked for periodically while it would
+// interrupt.
+static void update_irq(sio_t *sio, uint64_t cycle) {
+    if (!sio->cpu) return;
+    if (irq_wanted(sio)) {
+        cpu8080_irq_raise(sio->cpu, sio->irq_level);
+    } else {
+        cpu8080_irq_clear(sio->cpu, sio->irq_level);
+    }
+    if ((sio->control & SIO_CONTROL_RX_INT) && !sio->polling) {
+        sio->polling = cpu8080_schedule(sio->cpu, cycle + SIO_POLL_CYCLES, poll, sio);
+    }
+}
+
+// Only input that arrived changes anything, so a poll that finds none
+// leaves the rewind history alone
+static void poll(void *ctx, uint64_t cycle) {
+    sio_t *sio = ctx;
+    uint8_t line = sio->cpu->irq & (1 << sio->irq_level);
+    sio->polling = false;
+    update_irq(sio, cycle);
+    if ((sio->cpu->irq & (1 << sio->irq_level)) != line) {
+        memory_port_effect(sio->bus);
+    }
+}
+
+static uint8_t sio_in(void *ctx, uint8_t port, uint64_t cycle) {
+    sio_t *sio = ctx;
+    if (port & 1) {
+        memory_port_effect(sio->bus);
+        spsc_pop(&sio->rx, &sio->data);
+        update_irq(sio, cycle);
+        return sio->data;
+    }
+    return (spsc_empty(&sio->rx) ? 0 : SIO_STATUS_RDRF) |
+           (spsc_full(&sio->tx) ? 0 : SIO_STATUS_TDRE) |
+           (irq_wanted(sio) ? SIO_STATUS_IRQ : 0);
+}
+
+static void sio_out(void *ctx, uint8_t port, uint8_t data, uint64_t cycle) {
+    sio_t *sio = ctx;
+    memory_port_effect(sio->bus);
+    if (port & 1) {
+        if (!spsc_push(&sio->tx, &data)) sio->overruns++;
+    } else if ((data & SIO_CONTROL_RESET) == SIO_CONTROL_RESET) {
+        sio_reset(sio);
+        return;
+    } else {
+        sio->control = data;
+    }
+    update_irq(sio, cycle);
+}
+
+void sio_init(sio_t *sio, bus_t *bus, uint8_t base, cpu8080_t *cpu, uint8_t irq_level) {
+    sio->bus = bus;
+    spsc_init(&sio->rx, sio->rx_buf, 1, SIO_RING_SIZE);
+    spsc_init(&sio->tx, sio->tx_buf, 1, SIO_RING_SIZE);
+    sio->data = 0;
+    sio->cpu = cpu;
+    sio->irq_level = irq_level;
+    sio->polling = false;
+    sio->overruns = 0;
+    sio->control = 0;
+    sio->port.in = sio_in;
+    sio->port.out = sio_out;
+    sio->port.ctx = sio;
+    memory_map_port(bus, base, 2, &sio->port);
+}
+
+void sio_reset(sio_t *sio) {
+    sio->control = 0;
+    if (sio->cpu) {
+        cpu8080_cancel(sio->cpu, poll, sio);
+        cpu8080_irq_clear(sio->cpu, sio->irq_level);
+    }
+    sio->polling = false;
+}
+
+uint32_t sio_host_read(sio_t *sio, uint8_t *buf, uint32_t size) {
+    return spsc_pop_n(&sio->tx, buf, size);
+}
+
+uint32_t sio_host_write(sio_t *sio, const uint8_t *buf, uint32_t len) {
+    return spsc_push_n(&sio->rx, buf, len);
+}
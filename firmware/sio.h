@@ -0,0 +1,66 @@
+#ifndef SIO_H
+#define SIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu8080.h"
+#include "memory.h"
+#include "spsc.h"
+
+// One port of an Altair 88-2SIO: a Motorola 6850 ACIA with its status and
+// control register at the base port and data at base + 1. Bytes go through
+// two lock-free rings, so the host side (USB CDC, JavaScript, stdio) moves
+// them in batches from its own thread or core, never per IN or OUT.
+//
+// The CPU's thread owns the 8080 side: IN and OUT, and sio_reset(). One
+// other thread may call sio_host_read() and sio_host_write().
+
+#ifndef SIO_RING_SIZE
+#define SIO_RING_SIZE 4096      // bytes each way, power of 2
+#endif
+
+// How often input from the host is checked for while receive interrupts
+// are enabled (1 ms at 2 MHz)
+#ifndef SIO_POLL_CYCLES
+#define SIO_POLL_CYCLES 2000
+#endif
+
+// Status register
+#define SIO_STATUS_RDRF 0x01    // a received byte is waiting
+#define SIO_STATUS_TDRE 0x02    // room for a byte to send
+#define SIO_STATUS_IRQ  0x80    // interrupt requested
+
+// Control register
+#define SIO_CONTROL_RESET   0x03    // master reset (counter divide bits both set)
+#define SIO_CONTROL_TX_MASK 0x60
+#define SIO_CONTROL_TX_INT  0x20    // interrupt while there is room to send
+#define SIO_CONTROL_RX_INT  0x80    // interrupt while a byte is waiting
+
+typedef struct {
+    memory_port_t port;
+    bus_t *bus;
+    spsc_t rx;                  // host -> 8080
+    spsc_t tx;                  // 8080 -> host
+    uint8_t rx_buf[SIO_RING_SIZE];
+    uint8_t tx_buf[SIO_RING_SIZE];
+    uint8_t control;
+    uint8_t data;               // last byte received, read again while none waits
+    cpu8080_t *cpu;             // raises its interrupts, or NULL for none
+    uint8_t irq_level;
+    bool polling;               // input check scheduled
+    uint32_t overruns;          // bytes sent with no room, dropped
+} sio_t;
+
+// Attach at base (status/control, even) and base + 1 (data). Interrupts
+// go to cpu at RST irq_level, which needs an event queue attached to it.
+void sio_init(sio_t *sio, bus_t *bus, uint8_t base, cpu8080_t *cpu, uint8_t irq_level);
+
+// Master reset: interrupts off. Bytes already in the rings are kept.
+void sio_reset(sio_t *sio);
+
+// Host side: take up to size bytes the 8080 sent, and queue up to len bytes
+// for it to read. Both return how many bytes were moved.
+uint32_t sio_host_read(sio_t *sio, uint8_t *buf, uint32_t size);
+uint32_t sio_host_write(sio_t *sio, const uint8_t *buf, uint32_t len);
+
+#endif // SIO_H
@@ -0,0 +1,126 @@
+#include "snapshot.h"
+#include <string.h>
+
+static inline uint8_t *page_data(snapshot_store_t *st, uint16_t page) {
+    return st->data + (uint32_t)page * MEMORY_PAGE_SIZE;
+}
+
+static uint16_t alloc_page(snapshot_store_t *st) {
+    uint16_t page = st->free_head;
+    memcpy(&st->free_head, page_data(st, page), sizeof(st->free_head));
+    st->free_count--;
+    st->refs[page] = 1;
+    return page;
+}
+
+static void unref_page(snapshot_store_t *st, uint16_t page) {
+    if (page == SNAPSHOT_NO_PAGE || --st->refs[page] > 0) return;
+    memcpy(page_data(st, page), &st->free_head, sizeof(st->free_head));
+    st->free_head = page;
+    st->free_count++;
+}
+
+void snapshot_store_init(snapshot_store_t *st, bus_t *bus, void *pool, uint32_t pool_size) {
+    // Page data, then a use count per page (one byte of slack to align them)
+    uint32_t n = pool_size > 0 ? (pool_size - 1) / (MEMORY_PAGE_SIZE + sizeof(uint16_t)) : 0;
+    if (n > SNAPSHOT_NO_PAGE) n = SNAPSHOT_NO_PAGE;
+
+    st->bus = bus;
+    st->data = pool;
+    st->refs = (uint16_t *)(((uintptr_t)(st->data + n * MEMORY_PAGE_SIZE) + 1) & ~(uintptr_t)1);
+    st->capacity = n;
+    st->free_count = 0;
+    st->free_head = SNAPSHOT_NO_PAGE;
+    for (uint32_t i = n; i-- > 0;) {
+        st->refs[i] = 1;
+        unref_page(st, i);
+    }
+    for (int f = 0; f < MEMORY_FRAMES; f++) {
+        st->base[f] = SNAPSHOT_NO_PAGE;
+    }
+
+    // Nothing is stored yet, so the first snapshot copies every frame
+    memset(bus->dirty, 1, sizeof(bus->dirty));
+}
+
+void snapshot_init(snapshot_t *snap) {
+    snap->valid = false;
+    for (int f = 0; f < MEMORY_FRAMES; f++) {
+        snap->page[f] = SNAPSHOT_NO_PAGE;
+    }
+}
+
+bool snapshot_take(snapshot_store_t *st, snapshot_t *snap, const cpu8080_t *cpu) {
+    bus_t *bus = st->bus;
+    uint16_t frames = memory_frame_count(bus);
+
+    uint32_t dirty = 0;
+    for (uint16_t f = 0; f < frames; f++) {
+        dirty += bus->dirty[f];
+    }
+    if (dirty > st->free_count) return false;
+
+    // Fresh pages for the frames written since the base was last synced
+    for (uint16_t f = 0; f < frames; f++) {
+        if (bus->dirty[f]) {
+            uint16_t page = alloc_page(st);
+            memcpy(page_data(st, page), memory_frame(bus, f), MEMORY_PAGE_SIZE);
+            unref_page(st, st->base[f]);
+            st->base[f] = page;
+            bus->dirty[f] = 0;
+        }
+    }
+
+    snapshot_release(st, snap);
+    for (uint16_t f = 0; f < frames; f++) {
+        snap->page[f] = st->base[f];
+        st->refs[snap->page[f]]++;
+    }
+    snap->cpu = *cpu;
+    snap->bank = bus->banks.current;
+    snap->valid = true;
+    return true;
+}
+
+void snapshot_restore(snapshot_store_t *st, const snapshot_t *snap, cpu8080_t *cpu) {
+    bus_t *bus = st->bus;
+    uint16_t frames = memory_frame_count(bus);
+    uint8_t changed[MEMORY_FRAMES];
+
+    if (!snap->valid) return;
+
+    memory_select_bank(bus, snap->bank);
+    memset(changed, 0, sizeof(changed));
+    for (uint16_t f = 0; f < frames; f++) {
+        uint16_t page = snap->page[f];
+        if (bus->dirty[f] || st->base[f] != page) {
+            memcpy(memory_frame(bus, f), page_data(st, page), MEMORY_PAGE_SIZE);
+            st->refs[page]++;
+            unref_page(st, st->base[f]);
+            st->base[f] = page;
+            bus->dirty[f] = 0;
+            changed[f] = 1;
+        }
+    }
+    memory_frames_changed(bus, changed);
+
+    // Registers only, keep how this CPU is wired up and what its devices request
+    cpu8080_t wiring = *cpu;
+    *cpu = snap->cpu;
+    cpu->bus = wiring.bus;
+    cpu->tcache = wiring.tcache;
+    cpu->breakpoint = wiring.breakpoint;
+    cpu->breakpoint_enabled = wiring.breakpoint_enabled;
+    cpu->events = wiring.events;
+    cpu->irq = wiring.irq;
+    cpu8080_update_attention(cpu);
+}
+
+void snapshot_release(snapshot_store_t *st, snapshot_t *snap) {
+    if (!snap->valid) return;
+    for (int f = 0; f < MEMORY_FRAMES; f++) {
+        unref_page(st, snap->page[f]);
+        snap->page[f] = SNAPSHOT_NO_PAGE;
+    }
+    snap->valid = false;
+}
@@ -0,0 +1,61 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu8080.h"
+#include "memory.h"
+
+// Copy-on-write machine snapshots. RAM frames (see MEMORY_FRAMES) are kept
+// in a shared page pool, and a frame that is the same in several snapshots
+// is stored once. Taking a snapshot copies only the frames written since
+// the last take or restore, and restoring copies back only the frames that
+// differ from what memory holds.
+//
+// A snapshot holds the CPU and memory only: registers, cycles, RAM and the
+// bank mapped. Devices (sio.h, disk.h) and the event queue aren't saved and
+// carry on from where they are, and the CPU's irq lines, which they drive,
+// stay as they are too. Restoring a machine that has devices attached puts
+// them out of step with it, much as a reset of the CPU alone would.
+
+#define SNAPSHOT_NO_PAGE 0xFFFF
+
+typedef struct {
+    cpu8080_t cpu;      // registers only, the CPU's wiring and irq lines stay
+    uint8_t bank;
+    bool valid;
+    uint16_t page[MEMORY_FRAMES];   // pool page holding each frame
+} snapshot_t;
+
+typedef struct {
+    bus_t *bus;
+    uint8_t *data;          // capacity pages of MEMORY_PAGE_SIZE bytes
+    uint16_t *refs;         // users of each page, the store's base included
+    uint16_t capacity;
+    uint16_t free_count;
+    uint16_t free_head;     // free pages are linked through their first bytes
+    uint16_t base[MEMORY_FRAMES];   // pages memory matches, except dirty frames
+} snapshot_store_t;
+
+// Keep snapshots of bus in pool (pool_size bytes). Set up the bus's banks
+// first, the frames in use are fixed from here on.
+void snapshot_store_init(snapshot_store_t *st, bus_t *bus, void *pool, uint32_t pool_size);
+
+// Pool pages still free
+static inline uint32_t snapshot_free_bytes(const snapshot_store_t *st) {
+    return (uint32_t)st->free_count * MEMORY_PAGE_SIZE;
+}
+
+void snapshot_init(snapshot_t *snap);
+
+// Capture cpu and the bus into snap, replacing what it held. Returns false
+// and leaves everything as it was if the pool is out of pages.
+bool snapshot_take(snapshot_store_t *st, snapshot_t *snap, const cpu8080_t *cpu);
+
+// Put the machine back to snap, which stays valid
+void snapshot_restore(snapshot_store_t *st, const snapshot_t *snap, cpu8080_t *cpu);
+
+// Give snap's pages back to the pool
+void snapshot_release(snapshot_store_t *st, snapshot_t *snap);
+
+#endif
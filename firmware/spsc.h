@@ -0,0 +1,86 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+
+// Lock-free single-producer/single-consumer ring of fixed-size elements.
+// Only one thread (or core) may push and only one may pop. Uses plain
+// acquire/release loads and stores, so it works on cores without atomic
+// read-modify-write instructions (Cortex-M0+).
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t elem_size;
+    uint32_t mask;              // capacity - 1, capacity is a power of 2
+    _Atomic uint32_t head;      // next slot to write, owned by the producer
+    _Atomic uint32_t tail;      // next slot to read, owned by the consumer
+} spsc_t;
+
+// buf must hold capacity * elem_size bytes
+static inline void spsc_init(spsc_t *q, void *buf, uint32_t elem_size, uint32_t capacity) {
+    q->buf = (uint8_t *)buf;
+    q->elem_size = elem_size;
+    q->mask = capacity - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+}
+
+static inline bool spsc_empty(spsc_t *q) {
+    return atomic_load_explicit(&q->head, memory_order_acquire) ==
+           atomic_load_explicit(&q->tail, memory_order_acquire);
+}
+
+static inline bool spsc_full(spsc_t *q) {
+    return atomic_load_explicit(&q->head, memory_order_acquire) -
+           atomic_load_explicit(&q->tail, memory_order_acquire) > q->mask;
+}
+
+static inline bool spsc_push(spsc_t *q, const void *elem) {
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head - tail > q->mask) return false;
+    memcpy(q->buf + (head & q->mask) * q->elem_size, elem, q->elem_size);
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return true;
+}
+
+static inline bool spsc_pop(spsc_t *q, void *elem) {
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (head == tail) return false;
+    memcpy(elem, q->buf + (tail & q->mask) * q->elem_size, q->elem_size);
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+// Batched versions for byte streams and the like: one pair of index
+// updates for up to n elements. Return how many were pushed or popped.
+static inline uint32_t spsc_push_n(spsc_t *q, const void *elems, uint32_t n) {
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    uint32_t room = q->mask + 1 - (head - tail);
+    if (n > room) n = room;
+    uint32_t at = head & q->mask;
+    uint32_t first = q->mask + 1 - at < n ? q->mask + 1 - at : n;
+    memcpy(q->buf + at * q->elem_size, elems, first * q->elem_size);
+    memcpy(q->buf, (const uint8_t *)elems + first * q->elem_size, (n - first) * q->elem_size);
+    atomic_store_explicit(&q->head, head + n, memory_order_release);
+    return n;
+}
+
+static inline uint32_t spsc_pop_n(spsc_t *q, void *elems, uint32_t n) {
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (n > head - tail) n = head - tail;
+    uint32_t at = tail & q->mask;
+    uint32_t first = q->mask + 1 - at < n ? q->mask + 1 - at : n;
+    memcpy(elems, q->buf + at * q->elem_size, first * q->elem_size);
+    memcpy((uint8_t *)elems + first * q->elem_size, q->buf, (n - first) * q->elem_size);
+    atomic_store_explicit(&q->tail, tail + n, memory_order_release);
+    return n;
+}
+
+#endif
@@ -0,0 +1,30 @@
+@echo off
+REM Build the benchmark runner with Emscripten and run it under node (Windows)
+REM Run after setting up Emscripten environment: emsdk_env.bat
+REM Usage: bench.bat [CYCLES [REPEAT]]
+REM The CPU8080_* variables select the core as in build.bat
+
+if "%CPU8080_DISPATCH%"=="" set CPU8080_DISPATCH=TABLE
+if "%CPU8080_LAZY_FLAGS%"=="" set CPU8080_LAZY_FLAGS=0
+if "%CPU8080_TCACHE%"=="" if "%CPU8080_DISPATCH%"=="TABLE" (set CPU8080_TCACHE=1) else (set CPU8080_TCACHE=0)
+
+set PATH=%PATH%;%LocalAppData%\emsdk\upstream\emscripten
+
+call emcc bench_web.c ../bench.c ../cpu8080.c ../events.c ../memory.c ../disasm.c ^
+    -O2 ^
+    -s WASM=1 ^
+    -s ENVIRONMENT=node ^
+    -s ALLOW_MEMORY_GROWTH=1 ^
+    -I. ^
+    -I.. ^
+    -DCPU8080_DISPATCH=CPU8080_DISPATCH_%CPU8080_DISPATCH% ^
+    -DCPU8080_LAZY_FLAGS=%CPU8080_LAZY_FLAGS% ^
+    -DCPU8080_TCACHE=%CPU8080_TCACHE% ^
+    -o bench.js 1>&2
+
+if %ERRORLEVEL% NEQ 0 (
+    echo Build failed! 1>&2
+    exit /b 1
+)
+
+node bench.js %*
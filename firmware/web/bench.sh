@@ -0,0 +1,38 @@
+#!/bin/bash
+# Build the benchmark runner with Emscripten and run it under node
+# Run with: ./bench.sh [CYCLES [REPEAT]] (after sourcing emsdk_env.sh)
+# The CPU8080_* variables select the core as in build.sh
+
+set -e
+
+CPU8080_DISPATCH=${CPU8080_DISPATCH:-TABLE}
+CPU8080_LAZY_FLAGS=${CPU8080_LAZY_FLAGS:-0}
+if [ "$CPU8080_DISPATCH" = "TABLE" ]; then
+    CPU8080_TCACHE=${CPU8080_TCACHE:-1}
+else
+    CPU8080_TCACHE=${CPU8080_TCACHE:-0}
+fi
+
+SOURCES=(
+    "bench_web.c"
+    "../bench.c"
+    "../cpu8080.c"
+    "../events.c"
+    "../memory.c"
+    "../disasm.c"
+)
+
+EMCC_FLAGS=(
+    -O2
+    -s WASM=1
+    -s ENVIRONMENT=node
+    -s ALLOW_MEMORY_GROWTH=1
+    -I.
+    -I..
+    -DCPU8080_DISPATCH=CPU8080_DISPATCH_${CPU8080_DISPATCH}
+    -DCPU8080_LAZY_FLAGS=${CPU8080_LAZY_FLAGS}
+    -DCPU8080_TCACHE=${CPU8080_TCACHE}
+)
+
+emcc "${SOURCES[@]}" "${EMCC_FLAGS[@]}" -o bench.js >&2
+node bench.js "$@"
@@ -0,0 +1,23 @@
+/**
+ * Benchmark runner for the Emscripten build, run under node:
+ *   node bench.js [CYCLES [REPEAT]]
+ * Prints the bench.h results as JSON; compare them against a baseline with
+ * the host runner's -C option.
+ */
+
+#include <stdlib.h>
+#include <emscripten.h>
+#include "bench.h"
+
+static uint64_t clock_ns(void) {
+    return (uint64_t)(emscripten_get_now() * 1e6);
+}
+
+int main(int argc, char **argv) {
+    uint64_t cycles = argc > 1 ? strtoull(argv[1], NULL, 0) : 20000000;
+    int repeat = argc > 2 ? atoi(argv[2]) : 3;
+    if (cycles == 0 || repeat < 1) return 1;
+
+    bench_run_all("node", cycles, repeat, clock_ns);
+    return 0;
+}
@@ -4,19 +4,29 @@ REM Run after setting up Emscripten environment: emsdk_env.bat
 
 echo Building 8080 Microcomputer Web Emulator...
 
+REM Set CPU8080_DISPATCH=SWITCH to build with the original switch-based core
+REM Set CPU8080_LAZY_FLAGS=1 to defer flag evaluation until F is read
+REM Set CPU8080_TCACHE=0 to disable the translation cache (TABLE core only)
+if "%CPU8080_DISPATCH%"=="" set CPU8080_DISPATCH=TABLE
+if "%CPU8080_LAZY_FLAGS%"=="" set CPU8080_LAZY_FLAGS=0
+if "%CPU8080_TCACHE%"=="" if "%CPU8080_DISPATCH%"=="TABLE" (set CPU8080_TCACHE=1) else (set CPU8080_TCACHE=0)
+
 REM set path to where The compiler is installed, in "$env:LocalAppData\emsdk"
 
 set PATH=%PATH%;%LocalAppData%\emsdk\upstream\emscripten
 
-emcc main_web.c lcd_web.c shift_register_web.c ../cpu8080.c ../memory.c ../disasm.c ../microcomputer.c ^
+emcc main_web.c lcd_web.c shift_register_web.c ../cpu8080.c ../events.c ../memory.c ../disasm.c ../disk.c ../microcomputer.c ../pacer.c ../panel.c ../snapshot.c ../rewind.c ../session.c ../sio.c ^
     -O2 ^
     -s WASM=1 ^
-    -s EXPORTED_RUNTIME_METHODS="['cwrap','UTF8ToString']" ^
+    -s EXPORTED_RUNTIME_METHODS="['cwrap','UTF8ToString','HEAPU8']" ^
     -s ALLOW_MEMORY_GROWTH=1 ^
     -s MODULARIZE=0 ^
     -s EXPORT_NAME="Module" ^
     -I. ^
     -I.. ^
+    -DCPU8080_DISPATCH=CPU8080_DISPATCH_%CPU8080_DISPATCH% ^
+    -DCPU8080_LAZY_FLAGS=%CPU8080_LAZY_FLAGS% ^
+    -DCPU8080_TCACHE=%CPU8080_TCACHE% ^
     -o emulator.js
 
 if %ERRORLEVEL% NEQ 0 (
@@ -1,32 +1,54 @@
 #!/bin/bash
 # Build script for web emulator using Emscripten
 # Run with: ./build.sh (after sourcing emsdk_env.sh)
+# Set CPU8080_DISPATCH=SWITCH to build with the original switch-based core
+# Set CPU8080_LAZY_FLAGS=1 to defer flag evaluation until F is read
+# Set CPU8080_TCACHE=0 to disable the translation cache (TABLE core only)
 
 set -e
 
 echo "Building 8080 Microcomputer Web Emulator..."
 
+CPU8080_DISPATCH=${CPU8080_DISPATCH:-TABLE}
+CPU8080_LAZY_FLAGS=${CPU8080_LAZY_FLAGS:-0}
+if [ "$CPU8080_DISPATCH" = "TABLE" ]; then
+    CPU8080_TCACHE=${CPU8080_TCACHE:-1}
+else
+    CPU8080_TCACHE=${CPU8080_TCACHE:-0}
+fi
+
 # Source files
 SOURCES=(
     "main_web.c"
     "lcd_web.c"
     "shift_register_web.c"
     "../cpu8080.c"
+    "../events.c"
     "../memory.c"
     "../disasm.c"
+    "../disk.c"
     "../microcomputer.c"
+    "../pacer.c"
+    "../panel.c"
+    "../snapshot.c"
+    "../rewind.c"
+    "../session.c"
+    "../sio.c"
 )
 
 # Emscripten compiler flags
 EMCC_FLAGS=(
     -O2
     -s WASM=1
-    -s EXPORTED_RUNTIME_METHODS='["cwrap","UTF8ToString"]'
+    -s EXPORTED_RUNTIME_METHODS='["cwrap","UTF8ToString","HEAPU8"]'
     -s ALLOW_MEMORY_GROWTH=1
     -s MODULARIZE=0
     -s EXPORT_NAME="Module"
     -I.
     -I..
+    -DCPU8080_DISPATCH=CPU8080_DISPATCH_${CPU8080_DISPATCH}
+    -DCPU8080_LAZY_FLAGS=${CPU8080_LAZY_FLAGS}
+    -DCPU8080_TCACHE=${CPU8080_TCACHE}
 )
 
 # Build
@@ -1,4 +1,5 @@
 #include <emscripten.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -19,6 +20,11 @@ uint32_t to_ms_since_boot(uint64_t t) {
     return web_time_ms;
 }
 
+uint64_t to_us_since_boot(uint64_t t) {
+    (void)t;
+    return (uint64_t)web_time_ms * 1000;
+}
+
 uint64_t get_absolute_time(void) {
     return (uint64_t)web_time_ms;
 }
@@ -31,18 +37,30 @@ void sleep_ms(uint32_t ms) {
 #include "lcd.h"
 #include "shift_register.h"
 #include "../cpu8080.h"
+#include "../disk.h"
 #include "../memory.h"
 #include "../disasm.h"
 #include "../microcomputer.h"
+#include "../session.h"
+#include "../sio.h"
 
 static emulator_t emu;
 
+// Disk images (disk.h), a malloc'd buffer per drive that JavaScript fills
+// from a file. Sector writes land in the buffer.
+static disk_image_t disks[DISK_DRIVES];
+
+static uint32_t clock_hz = PACER_DEFAULT_HZ;
+
 // Export functions for JavaScript
 EMSCRIPTEN_KEEPALIVE
 void emu_init(void) {
-    memory_init();
     emulator_init(&emu);
+    pacer_set_clock(&emu.pacer, clock_hz, (uint64_t)web_time_ms * 1000);
     lcd_init();
+    for (int i = 0; i < DISK_DRIVES; i++) {
+        if (disks[i].data) disk_insert(&emu.disk, i, &disks[i]);
+    }
 }
 
 EMSCRIPTEN_KEEPALIVE
@@ -90,7 +108,7 @@ EMSCRIPTEN_KEEPALIVE
 uint8_t emu_get_reg_a(void) { return emu.cpu.a; }
 
 EMSCRIPTEN_KEEPALIVE
-uint8_t emu_get_reg_f(void) { return emu.cpu.f; }
+uint8_t emu_get_reg_f(void) { return cpu8080_get_f(&emu.cpu); }
 
 EMSCRIPTEN_KEEPALIVE
 uint8_t emu_get_reg_b(void) { return emu.cpu.b; }
@@ -119,19 +137,177 @@ int emu_is_halted(void) { return emu.cpu.halted ? 1 : 0; }
 EMSCRIPTEN_KEEPALIVE
 int emu_get_run_mode(void) { return (int)emu.run_mode; }
 
+// Clock selector. The rate is kept across emu_init().
+EMSCRIPTEN_KEEPALIVE
+void emu_set_clock_hz(uint32_t hz) {
+    clock_hz = hz;
+    pacer_set_clock(&emu.pacer, hz, (uint64_t)web_time_ms * 1000);
+}
+
+EMSCRIPTEN_KEEPALIVE
+uint32_t emu_get_missed_deadlines(void) { return emu.pacer.missed; }
+
 EMSCRIPTEN_KEEPALIVE
 uint8_t emu_read_memory(uint16_t addr) {
-    return memory_read(addr);
+    return memory_read(&emu.bus, addr);
 }
 
 EMSCRIPTEN_KEEPALIVE
 void emu_write_memory(uint16_t addr, uint8_t data) {
-    memory_write(addr, data);
+    memory_write(&emu.bus, addr, data);
 }
 
 EMSCRIPTEN_KEEPALIVE
 int emu_disasm(uint16_t addr, char *buffer, int size) {
-    return disasm_instruction(addr, buffer, size);
+    return disasm_instruction(&emu.bus, MEMORY_BANK_CURRENT, addr, buffer, size);
+}
+
+EMSCRIPTEN_KEEPALIVE
+uint8_t emu_get_bank(void) { return emu.bus.banks.current; }
+
+EMSCRIPTEN_KEEPALIVE
+int emu_step_back(void) { return emulator_step_back(&emu) ? 1 : 0; }
+
+EMSCRIPTEN_KEEPALIVE
+uint32_t emu_get_rewind_depth(void) { return emu.rewind.depth; }
+
+// Console (88-2SIO). JavaScript moves bytes through this buffer in the
+// wasm heap, a frame's worth per call instead of a call per byte.
+static uint8_t console_buf[SIO_RING_SIZE];
+
+EMSCRIPTEN_KEEPALIVE
+uint8_t *emu_console_buffer(void) { return console_buf; }
+
+EMSCRIPTEN_KEEPALIVE
+uint32_t emu_console_buffer_size(void) { return sizeof(console_buf); }
+
+// Move console output into the buffer. Returns how many bytes it holds.
+EMSCRIPTEN_KEEPALIVE
+uint32_t emu_console_read(void) {
+    return sio_host_read(&emu.console, console_buf, sizeof(console_buf));
+}
+
+// Queue the first len bytes of the buffer as console input, recorded with
+// the session if one is. Returns how many fit.
+EMSCRIPTEN_KEEPALIVE
+uint32_t emu_console_write(uint32_t len) {
+    if (len > sizeof(console_buf)) len = sizeof(console_buf);
+    return emulator_console_write(&emu, console_buf, len);
+}
+
+// The disks as they were when the last recording started, so a replay
+// starts from the same contents (sector writes change disks[] in place)
+static uint8_t *disk_saved[DISK_DRIVES];
+
+// Room for a size-byte image in drive, replacing its disk. JavaScript
+// copies the image in; it is read and written there. NULL if it is too
+// big or there is no such drive.
+EMSCRIPTEN_KEEPALIVE
+uint8_t *emu_disk_alloc(int drive, uint32_t size) {
+    if (drive < 0 || drive >= DISK_DRIVES || size == 0 || size > DISK_IMAGE_SIZE) return NULL;
+    disk_image_t *disk = &disks[drive];
+    disk_insert(&emu.disk, drive, NULL);
+    free(disk->ctx);
+    free(disk_saved[drive]);
+    disk_saved[drive] = NULL;
+    uint8_t *buf = malloc(size);
+    disk->data = buf;
+    disk->size = size;
+    disk->write = disk_write_in_place;
+    disk->ctx = buf;
+    if (buf) disk_insert(&emu.disk, drive, disk);
+    return buf;
+}
+
+// Session recording and replay. Both use one growable buffer that
+// JavaScript turns into a Blob to save, or fills from a loaded file.
+static uint8_t *session_buf = NULL;
+static uint32_t session_len = 0;
+static uint32_t session_cap = 0;
+static session_recorder_t recorder;
+static session_player_t player;
+
+static bool session_reserve(uint32_t size) {
+    if (size <= session_cap) return true;
+    uint32_t cap = session_cap ? session_cap : 4096;
+    while (cap < size) cap *= 2;
+    uint8_t *buf = realloc(session_buf, cap);
+    if (!buf) return false;
+    session_buf = buf;
+    session_cap = cap;
+    return true;
+}
+
+static void session_append(void *ctx, const uint8_t *data, uint32_t len) {
+    (void)ctx;
+    if (!session_reserve(session_len + len)) return;
+    memcpy(session_buf + session_len, data, len);
+    session_len += len;
+}
+
+// Restart the machine and log every emu_update() from here on
+EMSCRIPTEN_KEEPALIVE
+void emu_record_start(void) {
+    for (int i = 0; i < DISK_DRIVES; i++) {
+        free(disk_saved[i]);
+        disk_saved[i] = NULL;
+        if (disks[i].data && (disk_saved[i] = malloc(disks[i].size))) {
+            memcpy(disk_saved[i], disks[i].data, disks[i].size);
+        }
+    }
+    emu_init();
+    session_len = 0;
+    session_record_start(&recorder, session_append, NULL);
+    emu.recorder = &recorder;
+}
+
+// Stop recording, the stream stays at emu_session_data()
+EMSCRIPTEN_KEEPALIVE
+uint32_t emu_record_stop(void) {
+    emu.recorder = NULL;
+    return session_len;
+}
+
+EMSCRIPTEN_KEEPALIVE
+uint8_t *emu_session_data(void) { return session_buf; }
+
+// Room for a stream of size bytes to be copied in before emu_replay_start()
+EMSCRIPTEN_KEEPALIVE
+uint8_t *emu_session_alloc(uint32_t size) {
+    emu.recorder = NULL;
+    session_len = 0;
+    return session_reserve(size) ? session_buf : NULL;
+}
+
+// Restart the machine to replay the size bytes loaded, with the disks put
+// back as the last recording found them. Returns 0 if they aren't a session.
+EMSCRIPTEN_KEEPALIVE
+int emu_replay_start(uint32_t size) {
+    session_len = size;
+    if (!session_play_start(&player, session_buf, session_len)) return 0;
+    for (int i = 0; i < DISK_DRIVES; i++) {
+        if (disk_saved[i]) memcpy(disks[i].ctx, disk_saved[i], disks[i].size);
+    }
+    emu_init();
+    return 1;
+}
+
+// Replay the events up to elapsed_ms into the stream. Returns 0 when done.
+EMSCRIPTEN_KEEPALIVE
+int emu_replay_until(uint32_t elapsed_ms) {
+    while (!session_play_done(&player) &&
+           session_next_offset_us(&player) <= (uint64_t)elapsed_ms * 1000) {
+        emulator_replay_step(&emu, &player);
+    }
+    return !session_play_done(&player);
+}
+
+// Replay up to count events regardless of their time. Returns 0 when done.
+EMSCRIPTEN_KEEPALIVE
+int emu_replay_events(uint32_t count) {
+    while (count-- > 0 && emulator_replay_step(&emu, &player)) {
+    }
+    return !session_play_done(&player);
 }
 
 int main(void) {
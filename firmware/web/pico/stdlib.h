@@ -6,6 +6,7 @@
 
 // These are defined in main_web.c
 uint32_t to_ms_since_boot(uint64_t t);
+uint64_t to_us_since_boot(uint64_t t);
 uint64_t get_absolute_time(void);
 void sleep_ms(uint32_t ms);
 